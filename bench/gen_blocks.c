@@ -0,0 +1,73 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Generate the source of a program with a large amount of code executed once or a few times, which stresses
+    discovery of new blocks, the growth of the CFG and writing of the trace rather than the instrumentation of hot
+    code. Every function is a chain of if/else statements; compiled with -O0 each statement produces three blocks, so
+    the defaults generate over 100k blocks. All the functions are called through a single table, so the call site
+    also has thousands of indirect targets.
+
+    Usage: gen_blocks [functions] [branches per function] > large.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char** argv) {
+    long functions = argc > 1 ? atol(argv[1]) : 2000;
+    long branches = argc > 2 ? atol(argv[2]) : 20;
+
+    if (functions < 1 || branches < 1 || branches > 63) {
+        fprintf(stderr, "gen_blocks: Expected at least one function and between 1 and 63 branches\n");
+        return 1;
+    }
+
+    printf("// Generated by bench/gen_blocks %ld %ld\n\n", functions, branches);
+    printf("#include <stdint.h>\n#include <stdio.h>\n#include <stdlib.h>\n\n");
+
+    for (long function = 0; function < functions; function++) {
+        printf("static uint64_t f%ld(uint64_t x) {\n    uint64_t acc = %ldu;\n", function, function);
+        for (long branch = 0; branch < branches; branch++) {
+            printf("    if (x & (1ull << %ld)) {\n        acc += %ldu;\n    } else {\n        acc ^= %ldu;\n    }\n",
+                   branch, function * branches + branch, branch + 1);
+        }
+        printf("    return acc;\n}\n\n");
+    }
+
+    printf("static uint64_t (*const functions[])(uint64_t) = {\n");
+    for (long function = 0; function < functions; function++) {
+        printf("    f%ld,\n", function);
+    }
+    printf("};\n\n");
+
+    // Inputs 0 and all ones take every branch in both directions.
+    printf("int main(int argc, char** argv) {\n"
+           "    long iterations = argc > 1 ? atol(argv[1]) : 4;\n"
+           "    uint64_t result = 0;\n\n"
+           "    for (long iteration = 0; iteration < iterations; iteration++) {\n"
+           "        uint64_t x = iteration & 1 ? ~(uint64_t) 0 : (uint64_t) iteration;\n"
+           "        for (long idx = 0; idx < %ld; idx++) {\n"
+           "            result += functions[idx](x ^ result);\n"
+           "        }\n"
+           "    }\n\n"
+           "    printf(\"large: %%016llx\\n\", (unsigned long long) result);\n\n"
+           "    return 0;\n"
+           "}\n", functions);
+
+    return 0;
+}
@@ -0,0 +1,242 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Compare the per-thread CFG index (cfg_index) against the fixed-size mambo_ht_t it replaced, outside of MAMBO.
+    Every simulated thread sets up its table, adds its blocks (half of them shared by all the threads, as workers of a
+    pool run the same code) and merges them into the global table, the way lift_pre_thread_cb and lift_post_thread_cb
+    do. The mambo_ht_t is initialized with the 1 << 20 entries the plugin used and merged by scanning all its buckets.
+    For both tables the total setup, insertion and merge times and the growth of the peak RSS are printed as JSON
+    objects, one per line.
+
+    Must be built against a MAMBO tree with plugins/trace copied into it (see bench/run.sh), e.g.:
+
+    cc -O2 -std=gnu99 -D_GNU_SOURCE -DPLUGINS_NEW -I<mambo-root> -o index_bench bench/index_bench.c \
+        <mambo-root>/plugins/trace/cfg_index.c <mambo-root>/api/hash_table.c -pthread
+
+    Usage: index_bench [threads] [blocks per thread]
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "plugins/trace/cfg_index.h"
+
+// CONSTANTS
+
+#define MAMBO_HT_SIZE (1 << 20)
+#define MAMBO_HT_FILL_FACTOR 80
+#define CODE_BASE 0x400000
+
+// STRUCTS
+
+typedef struct {
+    double setup; // Total time of the table initialization (seconds).
+    double insert; // Total time of adding the blocks of the threads (seconds).
+    double merge; // Total time of merging the threads into the global table (seconds).
+    long rss_kb; // Growth of the peak RSS (KiB).
+    uint64_t nodes; // Number of blocks of the global table, which has to match between the tables.
+} results;
+
+// FUNCTIONS
+
+/*
+    The plugin allocates through MAMBO, which is not linked into the benchmark.
+*/
+void* mambo_alloc(mambo_context* ctx, size_t size) {
+    return malloc(size);
+}
+
+void mambo_free(mambo_context* ctx, void* ptr) {
+    free(ptr);
+}
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+static long max_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/*
+    Start address of the block of the thread. The first half of the blocks is shared by all the threads.
+*/
+static uintptr_t block_addr(long thread, long block, long blocks) {
+    long shared = blocks / 2;
+    long id = block < shared ? block : shared + thread * (blocks - shared) + (block - shared);
+    return CODE_BASE + (uintptr_t) id * 16;
+}
+
+static void fail(const char* message) {
+    fprintf(stderr, "index_bench: %s!\n", message);
+    exit(1);
+}
+
+static void bench_mambo_ht(long threads, long blocks, cfg_node* nodes, results* out) {
+    mambo_ht_t global;
+    long rss = max_rss_kb();
+
+    memset(out, 0, sizeof(*out));
+
+    if (mambo_ht_init(&global, MAMBO_HT_SIZE, 0, MAMBO_HT_FILL_FACTOR, false)) {
+        fail("Couldn't initialize the global mambo_ht_t");
+    }
+
+    for (long thread = 0; thread < threads; thread++) {
+        // Like the plugin, the entries of the thread tables are never released.
+        mambo_ht_t* cfg = (mambo_ht_t *) malloc(sizeof(mambo_ht_t));
+        double start = now();
+
+        if (cfg == NULL || mambo_ht_init(cfg, MAMBO_HT_SIZE, 0, MAMBO_HT_FILL_FACTOR, false)) {
+            fail("Couldn't initialize the mambo_ht_t of a thread");
+        }
+
+        double setup = now();
+
+        for (long block = 0; block < blocks; block++) {
+            uintptr_t addr = block_addr(thread, block, blocks);
+            nodes[block].start_addr = (void *) addr;
+            mambo_ht_add_nolock(cfg, addr, (uintptr_t) &nodes[block]);
+        }
+
+        double insert = now();
+
+        for (size_t idx = 0; idx < cfg->size; idx++) {
+            if (cfg->entries[idx].key != 0) {
+                cfg_node* local_node = (cfg_node *) cfg->entries[idx].value;
+                uintptr_t global_node;
+
+                if (mambo_ht_get_nolock(&global, (uintptr_t) local_node->start_addr, &global_node)) {
+                    mambo_ht_add_nolock(&global, (uintptr_t) local_node->start_addr, (uintptr_t) local_node);
+                    out->nodes++;
+                }
+            }
+        }
+
+        double merge = now();
+
+        out->setup += setup - start;
+        out->insert += insert - setup;
+        out->merge += merge - insert;
+
+        free(cfg);
+    }
+
+    out->rss_kb = max_rss_kb() - rss;
+}
+
+static void bench_cfg_index(long threads, long blocks, cfg_node* nodes, results* out) {
+    cfg_index global;
+    long rss = max_rss_kb();
+
+    memset(out, 0, sizeof(*out));
+
+    if (cfg_index_init(NULL, &global, CFG_INDEX_INITIAL_CAPACITY)) {
+        fail("Couldn't initialize the global cfg_index");
+    }
+
+    for (long thread = 0; thread < threads; thread++) {
+        cfg_index cfg;
+        double start = now();
+
+        if (cfg_index_init(NULL, &cfg, CFG_INDEX_INITIAL_CAPACITY)) {
+            fail("Couldn't initialize the cfg_index of a thread");
+        }
+
+        double setup = now();
+
+        for (long block = 0; block < blocks; block++) {
+            uintptr_t addr = block_addr(thread, block, blocks);
+            nodes[block].start_addr = (void *) addr;
+            if (cfg_index_add(NULL, &cfg, addr, &nodes[block])) {
+                fail("Couldn't grow the cfg_index of a thread");
+            }
+        }
+
+        double insert = now();
+
+        for (uint64_t idx = 0; idx < cfg.count; idx++) {
+            cfg_node* local_node = cfg.nodes[idx];
+
+            if (cfg_index_get(&global, (uintptr_t) local_node->start_addr) == NULL) {
+                if (cfg_index_add(NULL, &global, (uintptr_t) local_node->start_addr, local_node)) {
+                    fail("Couldn't grow the global cfg_index");
+                }
+                out->nodes++;
+            }
+        }
+
+        double merge = now();
+
+        out->setup += setup - start;
+        out->insert += insert - setup;
+        out->merge += merge - insert;
+
+        cfg_index_destroy(NULL, &cfg);
+    }
+
+    out->rss_kb = max_rss_kb() - rss;
+}
+
+static void print_results(const char* table, long threads, long blocks, results* out) {
+    printf("{\"benchmark\": \"index\", \"mode\": \"%s\", \"threads\": %ld, \"blocks\": %ld, \"setup_seconds\": %.6f, "
+           "\"insert_seconds\": %.6f, \"merge_seconds\": %.6f, \"rss_growth_kb\": %ld, \"nodes\": %llu}\n", table,
+           threads, blocks, out->setup, out->insert, out->merge, out->rss_kb, (unsigned long long) out->nodes);
+}
+
+int main(int argc, char** argv) {
+    long threads = argc > 1 ? atol(argv[1]) : 64;
+    long blocks = argc > 2 ? atol(argv[2]) : 300;
+
+    // The global mambo_ht_t can't grow, so all the blocks have to fit into it.
+    if (threads < 1 || blocks < 2 || blocks / 2 + threads * (blocks - blocks / 2) >
+                                     (long) MAMBO_HT_SIZE * MAMBO_HT_FILL_FACTOR / 100) {
+        fail("Expected at least one thread and two blocks, with all the blocks fitting into the mambo_ht_t");
+    }
+
+    // Nodes are only used for their start address and reused by all the threads.
+    cfg_node* nodes = (cfg_node *) calloc(blocks, sizeof(cfg_node));
+    if (nodes == NULL) {
+        fail("Couldn't allocate the nodes");
+    }
+
+    results ht, index;
+
+    // The cfg_index runs first, so the peak RSS left behind by the leaked mambo_ht_t tables doesn't hide its growth.
+    bench_cfg_index(threads, blocks, nodes, &index);
+    bench_mambo_ht(threads, blocks, nodes, &ht);
+
+    if (ht.nodes != index.nodes) {
+        fail("The tables merged a different number of blocks");
+    }
+
+    print_results("cfg_index", threads, blocks, &index);
+    print_results("mambo_ht", threads, blocks, &ht);
+
+    free(nodes);
+
+    return 0;
+}
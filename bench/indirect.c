@@ -0,0 +1,164 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Indirect-heavy dispatch: an interpreter loop compiled to a jump table (BR), calls through tables of virtual
+    methods (monomorphic and polymorphic BLR sites) and calls through an array of function pointers.
+
+    Usage: indirect [iterations]
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// CONSTANTS
+
+#define PROGRAM_SIZE 4096
+#define SHAPE_COUNT 1024
+
+// STRUCTS
+
+typedef struct shape shape;
+
+typedef struct {
+    uint64_t (*area)(const shape* self);
+    uint64_t (*perimeter)(const shape* self);
+} shape_ops;
+
+struct shape {
+    const shape_ops* ops;
+    uint64_t a;
+    uint64_t b;
+};
+
+// FUNCTIONS
+
+static uint64_t square_area(const shape* self) { return self->a * self->a; }
+static uint64_t square_perimeter(const shape* self) { return 4 * self->a; }
+static uint64_t rect_area(const shape* self) { return self->a * self->b; }
+static uint64_t rect_perimeter(const shape* self) { return 2 * (self->a + self->b); }
+static uint64_t triangle_area(const shape* self) { return self->a * self->b / 2; }
+static uint64_t triangle_perimeter(const shape* self) { return 3 * self->a; }
+static uint64_t circle_area(const shape* self) { return 3 * self->a * self->a; }
+static uint64_t circle_perimeter(const shape* self) { return 6 * self->a; }
+
+static const shape_ops shape_types[] = {
+    {square_area, square_perimeter},
+    {rect_area, rect_perimeter},
+    {triangle_area, triangle_perimeter},
+    {circle_area, circle_perimeter},
+};
+
+static uint64_t op_add(uint64_t x) { return x + 7; }
+static uint64_t op_xor(uint64_t x) { return x ^ 0x5a5a; }
+static uint64_t op_shl(uint64_t x) { return x << 1; }
+static uint64_t op_shr(uint64_t x) { return x >> 1; }
+static uint64_t op_mul(uint64_t x) { return x * 3; }
+static uint64_t op_rot(uint64_t x) { return (x << 13) | (x >> 51); }
+static uint64_t op_not(uint64_t x) { return ~x; }
+static uint64_t op_neg(uint64_t x) { return -x; }
+
+static uint64_t (*const operations[])(uint64_t) = {op_add, op_xor, op_shl, op_shr, op_mul, op_rot, op_not, op_neg};
+
+/*
+    Interpret the program. The dense switch is compiled into a jump table, so every instruction goes through the same
+    indirect branch with up to 16 targets.
+*/
+__attribute__((noinline)) static uint64_t interpret(const uint8_t* program, size_t size, uint64_t acc) {
+    for (size_t pc = 0; pc < size; pc++) {
+        switch (program[pc]) {
+            case 0: acc += 1; break;
+            case 1: acc -= 3; break;
+            case 2: acc ^= acc >> 7; break;
+            case 3: acc *= 5; break;
+            case 4: acc += pc; break;
+            case 5: acc = (acc << 3) | (acc >> 61); break;
+            case 6: acc |= 0x100; break;
+            case 7: acc &= ~(uint64_t) 0x10; break;
+            case 8: acc += acc >> 11; break;
+            case 9: acc ^= 0xdeadbeef; break;
+            case 10: acc -= pc >> 2; break;
+            case 11: acc *= 9; break;
+            case 12: acc += 0x1234; break;
+            case 13: acc ^= acc << 17; break;
+            case 14: acc = ~acc; break;
+            case 15: acc += 42; break;
+        }
+    }
+
+    return acc;
+}
+
+/*
+    Call a virtual method of every shape. The area call site sees all the shape types, the perimeter call site only
+    sees squares, so both polymorphic and monomorphic sites are exercised.
+*/
+__attribute__((noinline)) static uint64_t measure(const shape* shapes, size_t count) {
+    uint64_t total = 0;
+
+    for (size_t idx = 0; idx < count; idx++) {
+        total += shapes[idx].ops->area(&shapes[idx]);
+        if (shapes[idx].ops == &shape_types[0]) {
+            total += shapes[idx].ops->perimeter(&shapes[idx]);
+        }
+    }
+
+    return total;
+}
+
+__attribute__((noinline)) static uint64_t apply(uint64_t seed, size_t count) {
+    uint64_t acc = seed;
+
+    for (size_t idx = 0; idx < count; idx++) {
+        acc = operations[(acc ^ idx) & 7](acc);
+    }
+
+    return acc;
+}
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 2000;
+
+    static uint8_t program[PROGRAM_SIZE];
+    static shape shapes[SHAPE_COUNT];
+    uint64_t random = 0x9e3779b97f4a7c15ULL;
+
+    for (size_t idx = 0; idx < PROGRAM_SIZE; idx++) {
+        random = random * 6364136223846793005ULL + 1442695040888963407ULL;
+        program[idx] = (uint8_t) (random >> 60);
+    }
+
+    for (size_t idx = 0; idx < SHAPE_COUNT; idx++) {
+        random = random * 6364136223846793005ULL + 1442695040888963407ULL;
+        shapes[idx].ops = &shape_types[(random >> 62) & 3];
+        shapes[idx].a = (random >> 8) & 0xff;
+        shapes[idx].b = (random >> 16) & 0xff;
+    }
+
+    uint64_t result = 0;
+
+    for (long iteration = 0; iteration < iterations; iteration++) {
+        result = interpret(program, PROGRAM_SIZE, result);
+        result += measure(shapes, SHAPE_COUNT);
+        result = apply(result, PROGRAM_SIZE);
+    }
+
+    printf("indirect: %016llx\n", (unsigned long long) result);
+
+    return 0;
+}
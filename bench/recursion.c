@@ -0,0 +1,70 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Deep recursion and returns: a naive Fibonacci (many shallow calls returning to two call sites) and a recursive
+    walk tens of thousands of frames deep (returns to the same call site from every depth).
+
+    Usage: recursion [iterations]
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// CONSTANTS
+
+#define FIBONACCI_N 24
+#define WALK_DEPTH 50000
+
+// FUNCTIONS
+
+__attribute__((noinline)) static uint64_t fibonacci(uint64_t n) {
+    if (n < 2) {
+        return n;
+    }
+
+    return fibonacci(n - 1) + fibonacci(n - 2);
+}
+
+/*
+    Recurse depth times. The volatile frame variable prevents the compiler from turning the recursion into a loop.
+*/
+__attribute__((noinline)) static uint64_t walk(uint64_t depth, uint64_t acc) {
+    volatile uint64_t frame = acc ^ depth;
+
+    if (depth == 0) {
+        return frame;
+    }
+
+    return walk(depth - 1, acc * 31 + depth) + (frame & 1);
+}
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 40;
+
+    uint64_t result = 0;
+
+    for (long iteration = 0; iteration < iterations; iteration++) {
+        result += fibonacci(FIBONACCI_N);
+        result ^= walk(WALK_DEPTH, result);
+    }
+
+    printf("recursion: %016llx\n", (unsigned long long) result);
+
+    return 0;
+}
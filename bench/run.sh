@@ -0,0 +1,216 @@
+#!/bin/sh
+#
+#   Copyright 2026 Igor Wodiany
+#   Copyright 2026 The University of Manchester
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#       http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+
+# Build the benchmarks and run each of them natively, under bare MAMBO, under MAMBO with the trace plugin and under
+# MAMBO with the trace plugin built with MODULE_FILTER or PATH_RECORDING.
+#
+# For every run the wall time, peak RSS, size of the saved trace and path and the time spent writing the trace at
+# exit (printed with PERFORMANCE_MONITORING) are reported in JSON, together with the slowdown against the native run.
+#
+# Usage: bench/run.sh [benchmark...]
+#
+# Environment:
+#   CC         Compiler producing AArch64 binaries (default: cc).
+#   HOST_CC    Compiler for the code generator run on the build machine (default: cc).
+#   CFLAGS     Flags of the benchmarks (default: -O2). The generated large benchmark is always built with -O0.
+#   RUNNER     Prefix of every command running an AArch64 binary, e.g. "qemu-aarch64 -L /usr/aarch64-linux-gnu".
+#   MAMBO_DBM  Path to the dbm binary of MAMBO built without plugins; the mode is skipped if not set.
+#   TRACE_DBM  Path to the dbm binary of MAMBO built with plugins/trace; the mode is skipped if not set.
+#   TRACE_FILTERED_DBM
+#              Path to the dbm binary of MAMBO built with plugins/trace and MODULE_FILTER; the mode is skipped if not
+#              set.
+#   TRACE_PATH_DBM
+#              Path to the dbm binary of MAMBO built with plugins/trace and PATH_RECORDING; the mode is skipped if not
+#              set.
+#   MAMBO_ROOT MAMBO tree with plugins/trace copied into it. If set, bench/index_bench.c is built against it and
+#              its comparison of the per-thread CFG index with mambo_ht_t is added to the results.
+#   REPEAT     Number of runs of every benchmark in every mode, the fastest one is reported (default: 3).
+#   BUILD_DIR  Directory for the binaries and the runs (default: bench-build).
+#   OUT        JSON output (default: bench-results.json).
+#   TIME       GNU time used to measure the wall time and the peak RSS (default: /usr/bin/time).
+
+set -u
+
+CC=${CC:-cc}
+HOST_CC=${HOST_CC:-cc}
+CFLAGS=${CFLAGS:--O2}
+RUNNER=${RUNNER:-}
+MAMBO_DBM=${MAMBO_DBM:-}
+TRACE_DBM=${TRACE_DBM:-}
+TRACE_FILTERED_DBM=${TRACE_FILTERED_DBM:-}
+TRACE_PATH_DBM=${TRACE_PATH_DBM:-}
+MAMBO_ROOT=${MAMBO_ROOT:-}
+REPEAT=${REPEAT:-3}
+BUILD_DIR=${BUILD_DIR:-bench-build}
+OUT=${OUT:-bench-results.json}
+TIME=${TIME:-/usr/bin/time}
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+
+# Name, binary and arguments of every benchmark.
+BENCHMARKS="indirect:indirect:10000
+recursion:recursion:500
+syscalls:syscalls:1000000
+threads:threads:32 16
+threads-omp:threads-omp:32 16
+large:large:200"
+
+fail() {
+    echo "bench: $*" >&2
+    exit 1
+}
+
+build() {
+    mkdir -p "$BUILD_DIR" || fail "Couldn't create $BUILD_DIR"
+
+    for name in indirect recursion syscalls; do
+        $CC $CFLAGS -o "$BUILD_DIR/$name" "$BENCH_DIR/$name.c" || fail "Couldn't build $name"
+    done
+
+    $CC $CFLAGS -pthread -o "$BUILD_DIR/threads" "$BENCH_DIR/threads.c" || fail "Couldn't build threads"
+
+    # OpenMP is optional, the benchmark is skipped if the compiler doesn't support it.
+    if ! $CC $CFLAGS -pthread -fopenmp -o "$BUILD_DIR/threads-omp" "$BENCH_DIR/threads.c" 2>/dev/null; then
+        echo "bench: $CC doesn't support OpenMP, threads-omp is skipped" >&2
+        rm -f "$BUILD_DIR/threads-omp"
+    fi
+
+    if [ -n "$MAMBO_ROOT" ]; then
+        $CC $CFLAGS -std=gnu99 -D_GNU_SOURCE -DPLUGINS_NEW -I"$MAMBO_ROOT" -pthread -o "$BUILD_DIR/index_bench" \
+            "$BENCH_DIR/index_bench.c" "$MAMBO_ROOT/plugins/trace/cfg_index.c" "$MAMBO_ROOT/api/hash_table.c" || \
+            fail "Couldn't build index_bench"
+    fi
+
+    $HOST_CC -O2 -o "$BUILD_DIR/gen_blocks" "$BENCH_DIR/gen_blocks.c" || fail "Couldn't build gen_blocks"
+    "$BUILD_DIR/gen_blocks" > "$BUILD_DIR/large.c" || fail "Couldn't generate large.c"
+    $CC -O0 -o "$BUILD_DIR/large" "$BUILD_DIR/large.c" || fail "Couldn't build large"
+}
+
+# Print the time of the trace write at exit reported by the plugin, or null if it was not reported.
+write_seconds() {
+    sed -n -e 's/^mclift: Wrote .* in \([0-9.]*\)s .*/\1/p' \
+           -e 's/^mclift: Streamed .* the final flush took \([0-9.]*\)s.*/\1/p' "$1" | tail -n 1 | grep . || echo null
+}
+
+# Run the benchmark REPEAT times in the given mode and store its JSON object in result. The fastest native run is
+# kept in native_seconds for the slowdown of the following modes.
+run() {
+    name=$1 binary=$2 args=$3 mode=$4 dbm=$5
+
+    best_seconds= best_rss= best_trace= best_path= best_write= status=0
+
+    for iteration in $(seq "$REPEAT"); do
+        dir="$BUILD_DIR/runs/$name-$mode-$iteration"
+        rm -rf "$dir" && mkdir -p "$dir" || fail "Couldn't create $dir"
+
+        # Traces are saved to the working directory, so every run gets its own one.
+        (cd "$dir" && $TIME -f "%e %M" -o time.txt $RUNNER $dbm "$BINARY_DIR/$binary" $args > stdout.txt 2> stderr.txt)
+        ret=$?
+        if [ $ret -ne 0 ]; then
+            echo "bench: $name failed in mode $mode with status $ret, see $dir" >&2
+            status=$ret
+            continue
+        fi
+
+        seconds=$(tail -n 1 "$dir/time.txt" | cut -d ' ' -f 1)
+        rss=$(tail -n 1 "$dir/time.txt" | cut -d ' ' -f 2)
+        trace=$(cat "$dir"/*.mtrace 2>/dev/null | wc -c | tr -d ' ')
+        path=$(cat "$dir"/*.mpath 2>/dev/null | wc -c | tr -d ' ')
+        write=$(write_seconds "$dir/stderr.txt")
+
+        if [ -z "$best_seconds" ] || awk "BEGIN { exit !($seconds < $best_seconds) }"; then
+            best_seconds=$seconds best_rss=$rss best_trace=$trace best_path=$path best_write=$write
+        fi
+    done
+
+    if [ -z "$best_seconds" ]; then
+        result=$(printf '{"benchmark": "%s", "mode": "%s", "status": %d}' "$name" "$mode" "$status")
+        return
+    fi
+
+    if [ "$mode" = native ]; then
+        native_seconds=$best_seconds
+    fi
+
+    slowdown=null
+    if [ -n "$native_seconds" ] && awk "BEGIN { exit !($native_seconds > 0) }"; then
+        slowdown=$(awk "BEGIN { printf \"%.3f\", $best_seconds / $native_seconds }")
+    fi
+
+    result=$(printf '{"benchmark": "%s", "mode": "%s", "status": 0, "seconds": %s, "slowdown": %s, ' \
+                    "$name" "$mode" "$best_seconds" "$slowdown"
+             printf '"max_rss_kb": %s, "trace_bytes": %s, "path_bytes": %s, "write_seconds": %s}' "$best_rss" \
+                    "$best_trace" "$best_path" "$best_write")
+}
+
+[ -x "$TIME" ] && $TIME -f "%e" true 2>/dev/null || fail "GNU time is required at $TIME"
+
+build
+
+BINARY_DIR=$(cd "$BUILD_DIR" && pwd)
+[ -n "$MAMBO_DBM" ] && MAMBO_DBM=$(cd "$(dirname "$MAMBO_DBM")" && pwd)/$(basename "$MAMBO_DBM")
+[ -n "$TRACE_DBM" ] && TRACE_DBM=$(cd "$(dirname "$TRACE_DBM")" && pwd)/$(basename "$TRACE_DBM")
+[ -n "$TRACE_FILTERED_DBM" ] && \
+    TRACE_FILTERED_DBM=$(cd "$(dirname "$TRACE_FILTERED_DBM")" && pwd)/$(basename "$TRACE_FILTERED_DBM")
+[ -n "$TRACE_PATH_DBM" ] && \
+    TRACE_PATH_DBM=$(cd "$(dirname "$TRACE_PATH_DBM")" && pwd)/$(basename "$TRACE_PATH_DBM")
+
+separator=
+{
+    echo "["
+    echo "$BENCHMARKS" | while IFS=: read -r name binary args; do
+        if [ $# -gt 0 ] && ! echo " $* " | grep -q " $name "; then
+            continue
+        fi
+        if [ ! -x "$BUILD_DIR/$binary" ]; then
+            continue
+        fi
+
+        native_seconds=
+        for mode in native mambo trace trace-filtered trace-path; do
+            case $mode in
+                native) dbm= ;;
+                mambo) dbm=$MAMBO_DBM; [ -n "$dbm" ] || continue ;;
+                trace) dbm=$TRACE_DBM; [ -n "$dbm" ] || continue ;;
+                trace-filtered) dbm=$TRACE_FILTERED_DBM; [ -n "$dbm" ] || continue ;;
+                trace-path) dbm=$TRACE_PATH_DBM; [ -n "$dbm" ] || continue ;;
+            esac
+
+            echo "bench: Running $name ($mode)" >&2
+            run "$name" "$binary" "$args" "$mode" "$dbm"
+            printf '%s  %s' "$separator" "$result"
+            separator=",
+"
+        done
+    done
+
+    # The index benchmark prints its results as JSON objects already, one per table.
+    if [ -n "$MAMBO_ROOT" ] && { [ $# -eq 0 ] || echo " $* " | grep -q " index "; }; then
+        echo "bench: Running index" >&2
+        $RUNNER "$BUILD_DIR/index_bench" > "$BUILD_DIR/index.txt" || fail "index_bench failed"
+        while read -r result; do
+            printf '%s  %s' "$separator" "$result"
+            separator=",
+"
+        done < "$BUILD_DIR/index.txt"
+    fi
+    echo
+    echo "]"
+} > "$OUT"
+
+echo "bench: Results saved to $OUT" >&2
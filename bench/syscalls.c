@@ -0,0 +1,67 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Syscall-heavy loop: cheap system calls (getppid), small writes to /dev/null and clock reads, so the run time is
+    dominated by SVC instructions and the code around them.
+
+    Usage: syscalls [iterations]
+*/
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 200000;
+
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        perror("syscalls: open");
+        return 1;
+    }
+
+    uint64_t result = 0;
+    char buffer[64] = {0};
+
+    for (long iteration = 0; iteration < iterations; iteration++) {
+        result += (uint64_t) syscall(SYS_getppid);
+
+        buffer[0] = (char) iteration;
+        if (write(fd, buffer, sizeof(buffer)) != sizeof(buffer)) {
+            perror("syscalls: write");
+            return 1;
+        }
+
+        // Bypass the vDSO so the clock read is a real system call as well.
+        struct timespec now;
+        syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &now);
+        result ^= (uint64_t) now.tv_nsec & 1;
+    }
+
+    close(fd);
+
+    printf("syscalls: %016llx\n", (unsigned long long) result);
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Thread fan-out: waves of pthreads created from the main thread and from the workers themselves, so thread
+    creation, per-thread setup and the merge of thread CFGs dominate. When built with -fopenmp the same work is also
+    distributed with an OpenMP parallel loop.
+
+    Usage: threads [waves] [threads per wave]
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// CONSTANTS
+
+#define WORK_ITERATIONS 20000
+#define MAX_THREADS 256
+
+// STRUCTS
+
+typedef struct {
+    uint64_t seed; // Input of the worker.
+    uint64_t result; // Output of the worker.
+    int spawn_child; // Whether the worker spawns a nested thread.
+} work_item;
+
+// FUNCTIONS
+
+static uint64_t step_add(uint64_t x) { return x + 0x9e37; }
+static uint64_t step_mul(uint64_t x) { return x * 0x2545f491; }
+static uint64_t step_rot(uint64_t x) { return (x << 7) | (x >> 57); }
+static uint64_t step_xor(uint64_t x) { return x ^ (x >> 13); }
+
+static uint64_t (*const steps[])(uint64_t) = {step_add, step_mul, step_rot, step_xor};
+
+static uint64_t work(uint64_t seed) {
+    uint64_t acc = seed;
+
+    for (int idx = 0; idx < WORK_ITERATIONS; idx++) {
+        acc = steps[acc & 3](acc);
+    }
+
+    return acc;
+}
+
+static void* worker(void* arg) {
+    work_item* item = (work_item *) arg;
+
+    // Nested spawn, so thread creation is also seen from a thread other than the main one.
+    if (item->spawn_child) {
+        work_item child = {item->seed ^ 0xabcdef, 0, 0};
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, worker, &child) == 0) {
+            pthread_join(thread, NULL);
+            item->result ^= child.result;
+        }
+    }
+
+    item->result += work(item->seed);
+
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    long waves = argc > 1 ? atol(argv[1]) : 8;
+    long thread_count = argc > 2 ? atol(argv[2]) : 16;
+
+    if (thread_count < 1 || thread_count > MAX_THREADS) {
+        fprintf(stderr, "threads: The number of threads has to be between 1 and %d\n", MAX_THREADS);
+        return 1;
+    }
+
+    static pthread_t threads[MAX_THREADS];
+    static work_item items[MAX_THREADS];
+    uint64_t result = 0;
+
+    for (long wave = 0; wave < waves; wave++) {
+        for (long idx = 0; idx < thread_count; idx++) {
+            items[idx].seed = (uint64_t) (wave * thread_count + idx);
+            items[idx].result = 0;
+            items[idx].spawn_child = (idx & 3) == 0;
+
+            if (pthread_create(&threads[idx], NULL, worker, &items[idx]) != 0) {
+                perror("threads: pthread_create");
+                return 1;
+            }
+        }
+
+        for (long idx = 0; idx < thread_count; idx++) {
+            pthread_join(threads[idx], NULL);
+            result ^= items[idx].result;
+        }
+    }
+
+#ifdef _OPENMP
+    for (long wave = 0; wave < waves; wave++) {
+        uint64_t wave_result = 0;
+
+        #pragma omp parallel for reduction(^:wave_result) num_threads(thread_count)
+        for (long idx = 0; idx < thread_count; idx++) {
+            wave_result ^= work((uint64_t) (wave * thread_count + idx) ^ 0x5555);
+        }
+
+        result += wave_result;
+    }
+#endif
+
+    printf("threads: %016llx\n", (unsigned long long) result);
+
+    return 0;
+}
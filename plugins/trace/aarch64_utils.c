@@ -17,6 +17,13 @@
 
 #include "aarch64_utils.h"
 
+/*
+    TBZ and TBNZ encode the offset in 14 bits (bits 5-18), B.cond, CBZ and CBNZ in 19 bits (bits 5-23).
+*/
+static inline uint32_t conditional_branch_offset_bits(uint32_t inst) {
+    return (inst & 0x7e000000) == 0x36000000 ? 14 : 19;
+}
+
 uint64_t get_virtual_counter(void)
 {
     uint64_t ret;
@@ -34,3 +41,33 @@ uint64_t get_virtual_counter_frequency(void)
 
     return ret;
 }
+
+void* get_conditional_branch_target(uint32_t inst, void* address)
+{
+    uint32_t bits = conditional_branch_offset_bits(inst);
+    int64_t offset = (inst >> 5) & ((1 << bits) - 1);
+
+    // Sign extend the offset.
+    offset = (offset ^ (1 << (bits - 1))) - (1 << (bits - 1));
+
+    return (uint8_t *) address + offset * 4;
+}
+
+void* get_branch_target(uint32_t inst, void* address)
+{
+    int64_t offset = inst & 0x3ffffff;
+
+    // Sign extend the offset.
+    offset = (offset ^ (1 << 25)) - (1 << 25);
+
+    return (uint8_t *) address + offset * 4;
+}
+
+uint32_t retarget_conditional_branch(uint32_t inst, void* address, void* target)
+{
+    uint32_t bits = conditional_branch_offset_bits(inst);
+    uint32_t mask = ((1 << bits) - 1) << 5;
+    int64_t offset = ((uint8_t *) target - (uint8_t *) address) / 4;
+
+    return (inst & ~mask) | (((uint32_t) offset << 5) & mask);
+}
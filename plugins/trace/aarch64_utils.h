@@ -34,3 +34,32 @@ uint64_t get_virtual_counter(void);
  * @return Current frequency of the counter
  */
 uint64_t get_virtual_counter_frequency(void);
+
+/**
+ * Compute the target of a conditional branch (B.cond, CBZ, CBNZ, TBZ or TBNZ).
+ *
+ * @param inst Encoding of the branch
+ * @param address Address of the branch
+ * @return Address the branch jumps to when taken
+ */
+void* get_conditional_branch_target(uint32_t inst, void* address);
+
+/**
+ * Compute the target of an unconditional immediate branch (B or BL).
+ *
+ * @param inst Encoding of the branch
+ * @param address Address of the branch
+ * @return Address the branch jumps to
+ */
+void* get_branch_target(uint32_t inst, void* address);
+
+/**
+ * Encode a copy of the conditional branch (B.cond, CBZ, CBNZ, TBZ or TBNZ) with the same condition but a different
+ * target.
+ *
+ * @param inst Encoding of the original branch
+ * @param address Address the new branch is placed at
+ * @param target Target of the new branch (has to be within the range of the original branch)
+ * @return Encoding of the new branch
+ */
+uint32_t retarget_conditional_branch(uint32_t inst, void* address, void* target);
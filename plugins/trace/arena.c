@@ -0,0 +1,43 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#include "arena.h"
+
+void arena_init(cfg_arena* arena) {
+    arena->current = NULL;
+    arena->end = NULL;
+    arena->allocated = 0;
+}
+
+void* arena_refill(mambo_context* ctx, cfg_arena* arena, size_t size) {
+    // Objects larger than a chunk get a dedicated chunk, so the remainder of the current chunk is not wasted.
+    size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+
+    uint8_t* chunk = (uint8_t *) mambo_alloc(ctx, chunk_size);
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    arena->allocated += chunk_size;
+
+    if (chunk_size == ARENA_CHUNK_SIZE) {
+        arena->current = chunk + size;
+        arena->end = chunk + chunk_size;
+    }
+
+    return chunk;
+}
@@ -0,0 +1,83 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../../plugins.h"
+
+#include "config.h"
+
+// TYPEDEFS
+
+struct cfg_arena;
+typedef struct cfg_arena cfg_arena;
+
+// STRUCTS
+
+/*
+    Bump allocator for the objects of the CFG (nodes, edges and sets of indirect targets). Objects are carved out of
+    large chunks in the order they are allocated, so a node and its edges end up next to each other. Objects are
+    never freed individually - the CFG lives until the trace is written.
+*/
+struct cfg_arena {
+    uint8_t* current; // First free byte of the current chunk.
+    uint8_t* end; // End of the current chunk.
+    uint64_t allocated; // Total size of all chunks allocated by the arena.
+};
+
+// FUNCTIONS
+
+/**
+ * Initialize an empty arena. The first chunk is allocated lazily.
+ *
+ * @param arena Arena to be initialized.
+ */
+void arena_init(cfg_arena* arena);
+
+/**
+ * Allocate a new chunk for the arena and carve the object out of it. Use arena_alloc instead.
+ *
+ * @param ctx Mambo context of the plugin.
+ * @param arena Arena that run out of space.
+ * @param size Size of the object rounded up to ARENA_ALIGNMENT.
+ * @return Pointer to the object or NULL if the chunk couldn't be allocated.
+ */
+void* arena_refill(mambo_context* ctx, cfg_arena* arena, size_t size);
+
+/**
+ * Allocate an object from the arena.
+ *
+ * @param ctx Mambo context of the plugin.
+ * @param arena Arena to allocate from.
+ * @param size Size of the object.
+ * @return Pointer to the object aligned to ARENA_ALIGNMENT or NULL if the allocation failed.
+ */
+static inline void* arena_alloc(mambo_context* ctx, cfg_arena* arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+
+    if ((size_t) (arena->end - arena->current) < size) {
+        return arena_refill(ctx, arena, size);
+    }
+
+    void* object = arena->current;
+    arena->current += size;
+
+    return object;
+}
@@ -16,21 +16,289 @@
 */
 
 #include <stddef.h>
+#include <stdlib.h>
 
 #include "cfg.h"
 
+#ifdef STREAMING_WRITER
+    #include "journal.h"
+#endif
+
+_Static_assert(offsetof(cfg_targets, table) == CFG_TARGETS_TABLE, "See instrumentation.S");
+_Static_assert(offsetof(cfg_targets, mask) == CFG_TARGETS_MASK, "See instrumentation.S");
+_Static_assert(offsetof(cfg_targets, count) == CFG_TARGETS_COUNT, "See instrumentation.S");
+_Static_assert(offsetof(cfg_targets, limit) == CFG_TARGETS_LIMIT, "See instrumentation.S");
+_Static_assert(offsetof(cfg_targets, last) == CFG_TARGETS_LAST, "See instrumentation.S");
+_Static_assert(offsetof(cfg_targets, hits) == CFG_TARGETS_HITS, "See lift_pre_inst_cb");
+_Static_assert(offsetof(cfg_targets, misses) == CFG_TARGETS_MISSES, "See instrumentation.S");
+_Static_assert(offsetof(cfg_targets, quiet) == CFG_TARGETS_QUIET, "See instrumentation.S");
+_Static_assert(offsetof(cfg_targets, shadow_hits) == CFG_TARGETS_SHADOW_HITS, "See lift_pre_inst_cb");
+_Static_assert(offsetof(cfg_targets, generation) == CFG_TARGETS_GENERATION, "See instrumentation.S");
+
+#ifdef FORK_TRACKING
+uint64_t cfg_generation = 0;
+#endif
+
 void initialize_node(cfg_node* node) {
     node->start_addr = 0x0;
     node->end_addr = 0x0;
     node->edges = NULL;
+    node->targets = NULL;
     node->type = CFG_BASIC_BLOCK;
     node->order_id = -1;
     node->profile = CFG_NODE_COLD;
     node->branch_reg = -1;
+    node->exec_count = 0;
 }
 
 void initialize_edge(cfg_edge* edge, cfg_edge_type type) {
     edge->node = NULL;
     edge->next = NULL;
     edge->type = type;
+    edge->exec_count = 0;
+}
+
+void initialize_targets(cfg_targets* targets) {
+    for (int idx = 0; idx < CFG_INLINE_TARGETS; idx++) {
+        targets->inline_targets[idx] = 0;
+    }
+    targets->table = NULL;
+    targets->mask = 0;
+    targets->count = 0;
+    // Any target that misses the inline slots has to allocate the table first.
+    targets->limit = 0;
+    targets->overflow = 0;
+    targets->last = 0;
+    targets->hits = 0;
+    targets->misses = 0;
+    targets->quiet = 0;
+    targets->guards = 0;
+    targets->shadow_hits = 0;
+    targets->generation = 0;
+    targets->journal = NULL;
+    targets->source = NULL;
+}
+
+static void insert_target(uintptr_t* table, uint64_t mask, uintptr_t target) {
+    uint64_t idx = cfg_targets_hash(target, mask);
+
+    while (table[idx] != 0) {
+        idx = (idx + 1) & mask;
+    }
+
+    table[idx] = target;
+}
+
+/*
+    Grow the table and insert the target. Runs on the instrumented thread inside of track_branch_target, so it doesn't
+    have the MAMBO context and allocates directly with calloc. Memory is never released, as targets are needed until
+    the trace is written.
+*/
+static void grow_targets(uintptr_t target, cfg_targets* targets) {
+    uint64_t capacity = targets->table == NULL ? CFG_TARGETS_INITIAL_CAPACITY : 2 * (targets->mask + 1);
+
+    if (capacity > CFG_TARGETS_MAX_CAPACITY) {
+        targets->overflow++;
+        return;
+    }
+
+    uintptr_t* table = (uintptr_t *) calloc(capacity, sizeof(uintptr_t));
+    if (table == NULL) {
+        targets->overflow++;
+        return;
+    }
+
+    if (targets->table != NULL) {
+        for (uint64_t idx = 0; idx <= targets->mask; idx++) {
+            if (targets->table[idx] != 0) {
+                insert_target(table, capacity - 1, targets->table[idx]);
+            }
+        }
+        free(targets->table);
+    }
+
+    insert_target(table, capacity - 1, target);
+
+    targets->mask = capacity - 1;
+    targets->count++;
+    targets->limit = capacity / 2;
+    // Publish the table last, so a reader never sees it with a stale mask.
+    targets->table = table;
+}
+
+void cfg_targets_add(cfg_targets* targets, uintptr_t target) {
+    for (int idx = 0; idx < CFG_INLINE_TARGETS; idx++) {
+        if (targets->inline_targets[idx] == target) {
+            return;
+        }
+        if (targets->inline_targets[idx] == 0) {
+            targets->inline_targets[idx] = target;
+            return;
+        }
+    }
+
+    if (targets->table != NULL) {
+        uint64_t idx = cfg_targets_hash(target, targets->mask);
+
+        while (targets->table[idx] != 0) {
+            if (targets->table[idx] == target) {
+                return;
+            }
+            idx = (idx + 1) & targets->mask;
+        }
+
+        if (targets->count < targets->limit) {
+            targets->table[idx] = target;
+            targets->count++;
+            return;
+        }
+    }
+
+    grow_targets(target, targets);
+}
+
+static void merge_targets(cfg_targets* global_targets, cfg_targets* local_targets) {
+    for (int idx = 0; idx < CFG_INLINE_TARGETS && local_targets->inline_targets[idx] != 0; idx++) {
+        cfg_targets_add(global_targets, local_targets->inline_targets[idx]);
+    }
+
+    if (local_targets->table != NULL) {
+        for (uint64_t idx = 0; idx <= local_targets->mask; idx++) {
+            if (local_targets->table[idx] != 0) {
+                cfg_targets_add(global_targets, local_targets->table[idx]);
+            }
+        }
+        // The local node is dropped after the merge, so nothing else references the table.
+        free(local_targets->table);
+        local_targets->table = NULL;
+    }
+
+    global_targets->overflow += local_targets->overflow;
+    global_targets->hits += local_targets->hits;
+    global_targets->misses += local_targets->misses;
+    global_targets->guards += local_targets->guards;
+    global_targets->shadow_hits += local_targets->shadow_hits;
+
+    if (local_targets->generation > global_targets->generation) {
+        global_targets->generation = local_targets->generation;
+    }
+}
+
+static void merge_edge_count(cfg_edge* global_edge, cfg_edge* local_edge) {
+#ifdef EXECUTION_FLAGS_ONLY
+    global_edge->exec_count |= local_edge->exec_count;
+#else
+    global_edge->exec_count += local_edge->exec_count;
+#endif
+}
+
+void merge_nodes(cfg_node* global_node, cfg_node* local_node) {
+    global_node->type |= local_node->type;
+
+    if (global_node->branch_reg == (uint32_t) -1) {
+        global_node->branch_reg = local_node->branch_reg;
+    }
+
+    if (local_node->profile > global_node->profile) {
+        global_node->profile = local_node->profile;
+    }
+
+    // Keep the order of the first execution across all the threads.
+    if (local_node->order_id < global_node->order_id) {
+        global_node->order_id = local_node->order_id;
+    }
+
+#ifdef EXECUTION_FLAGS_ONLY
+    global_node->exec_count |= local_node->exec_count;
+#else
+    global_node->exec_count += local_node->exec_count;
+#endif
+
+    if (local_node->targets != NULL) {
+        if (global_node->targets == NULL) {
+            global_node->targets = local_node->targets;
+            // The journal of the exited thread is released by the writer.
+            global_node->targets->journal = NULL;
+        } else {
+            merge_targets(global_node->targets, local_node->targets);
+        }
+        local_node->targets = NULL;
+    }
+
+    // Edges are matched by their type and target. Edges not known globally are moved to the end of the global list.
+    cfg_edge* local_edge = local_node->edges;
+
+    while (local_edge != NULL) {
+        cfg_edge* next = local_edge->next;
+        cfg_edge** global_edge = &global_node->edges;
+
+        while (*global_edge != NULL &&
+               ((*global_edge)->type != local_edge->type || (*global_edge)->node != local_edge->node)) {
+            global_edge = &(*global_edge)->next;
+        }
+
+        if (*global_edge == NULL) {
+            local_edge->next = NULL;
+            *global_edge = local_edge;
+        } else {
+            merge_edge_count(*global_edge, local_edge);
+        }
+
+        local_edge = next;
+    }
+
+    local_node->edges = NULL;
+}
+
+/*
+    With STREAMING_WRITER every new target ends up here, so it is logged before being inserted.
+*/
+void cfg_targets_insert_slow(uintptr_t target, cfg_targets* targets) {
+    targets->quiet = 0;
+#ifdef FORK_TRACKING
+    targets->generation = cfg_generation;
+#endif
+
+#ifdef STREAMING_WRITER
+    if (targets->journal != NULL) {
+        journal_put_target(targets->journal, targets->source, target);
+    }
+    cfg_targets_add(targets, target);
+#else
+    grow_targets(target, targets);
+#endif
+}
+
+uint64_t cfg_targets_footprint(cfg_targets* targets) {
+    uint64_t footprint = sizeof(cfg_targets);
+
+    if (targets->table != NULL) {
+        footprint += (targets->mask + 1) * sizeof(uintptr_t);
+    }
+
+    return footprint;
+}
+
+uint64_t cfg_targets_probe_lengths(cfg_targets* targets, uint64_t* total, uint64_t* max) {
+    uint64_t entries = 0;
+
+    if (targets->table == NULL) {
+        return 0;
+    }
+
+    for (uint64_t idx = 0; idx <= targets->mask; idx++) {
+        uintptr_t target = targets->table[idx];
+        if (target != 0) {
+            uint64_t length = ((idx - cfg_targets_hash(target, targets->mask)) & targets->mask)
+                              / CFG_TARGETS_BUCKET_SLOTS + 1;
+
+            entries++;
+            *total += length;
+            if (length > *max) {
+                *max = length;
+            }
+        }
+    }
+
+    return entries;
 }
@@ -17,12 +17,49 @@
 
 #pragma once
 
+#include "config.h"
+
+// CONSTANTS
+
+/// Number of targets of an indirect branch stored directly in cfg_targets before the table is allocated
+#define CFG_INLINE_TARGETS 4
+
+/// Initial number of slots of the table of indirect targets
+#define CFG_TARGETS_INITIAL_CAPACITY 16
+
+/// Maximum number of slots of the table of indirect targets - the table is never filled more than half
+#define CFG_TARGETS_MAX_CAPACITY (2 * NUMBER_INDIRECT_TARGETS)
+
+/// Number of consecutive slots of the table of indirect targets loaded and compared at once by track_branch_target
+/// (a single LDP). The hash always points to the first slot of a bucket
+#define CFG_TARGETS_BUCKET_SLOTS 2
+
+/// Multiplier of the hash of indirect targets (2^64 divided by the golden ratio)
+#define CFG_TARGETS_HASH_MULTIPLIER 0x9e3779b97f4a7c15
+
+/// Offsets of the cfg_targets fields used by instrumentation.S
+#define CFG_TARGETS_TABLE 32
+#define CFG_TARGETS_MASK 40
+#define CFG_TARGETS_COUNT 48
+#define CFG_TARGETS_LIMIT 56
+#define CFG_TARGETS_LAST 72
+#define CFG_TARGETS_HITS 80
+#define CFG_TARGETS_MISSES 88
+#define CFG_TARGETS_QUIET 96
+#define CFG_TARGETS_SHADOW_HITS 112
+#define CFG_TARGETS_GENERATION 120
+
+#ifndef __ASSEMBLER__
+
 #include <stdint.h>
 
 // ENUMS
 
 typedef struct cfg_node cfg_node;
 typedef struct cfg_edge cfg_edge;
+typedef struct cfg_targets cfg_targets;
+
+struct trace_journal;
 
 /// Type of the edge in the CFG
 typedef enum {
@@ -39,7 +76,9 @@ typedef enum {
     CFG_SVC = 0x10, ///< Ends in SVC
     CFG_RETURN = 0x20, ///< Ends in return statement
     CFG_INDIRECT_BLOCK = 0x40, ///< Ends in the indirect branch
-    CFG_NATIVE_CALL = 0x80 ///< Ends in call to a library function that is not being lifted
+    CFG_NATIVE_CALL = 0x80, ///< Ends in call to a library function that is not being lifted
+    CFG_SHADOW_RETURN = 0x100 ///< Return checked against the shadow stack - targets only contain the returns that
+                              ///< didn't go back to the matching call (only with SHADOW_STACK)
 } cfg_node_type;
 
 /// Profile of the node obtained from MAMBO tracing
@@ -51,30 +90,57 @@ typedef enum {
 
 // STRUCTS
 
-/// Edge in the CFG. NOTE: Before modifying see instrumentation.S
+/// Edge in the CFG
 struct cfg_edge{
-    cfg_node* node; ///< NOTE: Has to be the first field for the instrumentation to work correctly.
+    cfg_node* node;
     cfg_edge* next;
 
     cfg_edge_type type;
 
-    intptr_t __pad;
+    uint64_t exec_count; ///< Number of times the edge was followed (only with EXECUTION_COUNTERS)
+};
+
+/// Targets of an indirect branch. The first CFG_INLINE_TARGETS targets are stored inline, the following ones in an
+/// open-addressed table that grows on demand. NOTE: Before modifying see instrumentation.S
+struct cfg_targets {
+    uintptr_t inline_targets[CFG_INLINE_TARGETS]; ///< First targets of the branch - 0 marks an empty slot
+    uintptr_t* table; ///< Table of the remaining targets, NULL until the inline slots are exhausted
+    uint64_t mask; ///< Number of slots in the table minus one
+    uint64_t count; ///< Number of targets stored in the table
+    uint64_t limit; ///< Number of targets in the table above which a new target goes to cfg_targets_insert_slow
+    uint64_t overflow; ///< Number of insertions dropped after the table reached CFG_TARGETS_MAX_CAPACITY
+
+    uintptr_t last; ///< Most recent target - checked inline by the instrumentation before calling track_branch_target
+    uint64_t hits; ///< Number of executions handled by the inline check (only with PERFORMANCE_MONITORING)
+    uint64_t misses; ///< Number of calls to track_branch_target (only with PERFORMANCE_MONITORING)
+    uint64_t quiet; ///< Number of executions since the last new target (only with ADAPTIVE_INSTRUMENTATION)
+    uint64_t guards; ///< Number of guarded copies of the branch emitted in traces (only with ADAPTIVE_INSTRUMENTATION)
+    uint64_t shadow_hits; ///< Number of returns matching the shadow stack (only with SHADOW_STACK and
+                          ///< PERFORMANCE_MONITORING)
+    uint64_t generation; ///< Value of cfg_generation when the last new target was added (only with FORK_TRACKING)
+
+    struct trace_journal* journal; ///< Journal new targets are logged to (only with STREAMING_WRITER)
+    void* source; ///< Start address of the node ending in the branch (only with STREAMING_WRITER)
 };
 
-/// Node in the CFG
+/// Node in the CFG. Fields read by every traversal of the graph are kept together at the beginning of the node.
 struct cfg_node {
     void* start_addr; ///< Start address of the node in the original binary
     void* end_addr; ///< End address of the node in the original binary
 
+    cfg_node_type type; ///< Type of the node
+
+    uint32_t branch_reg; ///< Register used for jumping by the indirect branch
+
     cfg_edge* edges; ///< Out edges of the node
 
-    cfg_node_type type; ///< Type of the node
+    cfg_targets* targets; ///< Targets of the indirect branch ending the node (NULL for other nodes)
 
     uint64_t order_id; ///< Defines order in which basic blocks were first executed
 
-    uint32_t branch_reg; ///< Register used for jumping by the indirect branch
-
     cfg_node_profile profile; ///< Profile of the node - tells if nodes executed more than 256 times
+
+    uint64_t exec_count; ///< Number of executions of the node (only with EXECUTION_COUNTERS)
 };
 
 // FUNCTIONS
@@ -82,3 +148,40 @@ struct cfg_node {
 void initialize_node(cfg_node* node);
 
 void initialize_edge(cfg_edge* edge, cfg_edge_type type);
+
+void initialize_targets(cfg_targets* targets);
+
+/// Merge the local node into the global node describing the same block: union the node types, edges and targets of
+/// the indirect branch, and add the execution counters. Edges and targets are moved out of the local node.
+void merge_nodes(cfg_node* global_node, cfg_node* local_node);
+
+/// Hash used to index the table of indirect targets. Instructions are 4-byte aligned and targets of a branch are
+/// often close to each other, so the address is mixed with a multiplicative hash and the well-mixed upper half of the
+/// product is used. The result is the first slot of a bucket. NOTE: Has to match instrumentation.S
+static inline uint64_t cfg_targets_hash(uintptr_t target, uint64_t mask) {
+    uint64_t hash = ((target >> 2) * CFG_TARGETS_HASH_MULTIPLIER) >> 32;
+    return hash & mask & ~(uint64_t) (CFG_TARGETS_BUCKET_SLOTS - 1);
+}
+
+/// Called by track_branch_target when a new target doesn't fit into the inline slots or the table has to grow. With
+/// STREAMING_WRITER called for every new target, so it can be logged
+void cfg_targets_insert_slow(uintptr_t target, cfg_targets* targets);
+
+/// Add the target unless already present. Same as track_branch_target, but callable from C
+void cfg_targets_add(cfg_targets* targets, uintptr_t target);
+
+#ifdef FORK_TRACKING
+/// Number of forks between the traced process and the first traced process of its family. Stamped on the targets
+/// whenever a new target is added, so a forked process can tell the branches it extended from the inherited ones
+extern uint64_t cfg_generation;
+#endif
+
+/// Number of bytes allocated for the targets, including the table
+uint64_t cfg_targets_footprint(cfg_targets* targets);
+
+/// Add the probe lengths of the targets stored in the table to total and update max. The probe length is the number of
+/// buckets track_branch_target loads to find the target
+/// @return Number of targets stored in the table
+uint64_t cfg_targets_probe_lengths(cfg_targets* targets, uint64_t* total, uint64_t* max);
+
+#endif
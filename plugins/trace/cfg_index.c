@@ -0,0 +1,179 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#include <string.h>
+
+#include "cfg_index.h"
+
+// CONSTANTS
+
+/*
+    Number of slots of the old table migrated on every operation. The table doubles when half full, so it takes at
+    least old capacity / 4 insertions before the next resize, which is enough to migrate the whole old table.
+*/
+#define MIGRATION_STEP 8
+
+// FUNCTIONS
+
+static inline uint64_t hash_key(uintptr_t key, uint64_t mask) {
+    // Code addresses are 4-byte aligned and blocks of one function are close to each other, so mix the bits first.
+    uint64_t hash = (key >> 2) * 0x9e3779b97f4a7c15ULL;
+    return (hash ^ (hash >> 32)) & mask;
+}
+
+static cfg_index_entry* allocate_table(mambo_context* ctx, uint64_t capacity) {
+    cfg_index_entry* entries = (cfg_index_entry *) mambo_alloc(ctx, capacity * sizeof(cfg_index_entry));
+    if (entries != NULL) {
+        memset(entries, 0, capacity * sizeof(cfg_index_entry));
+    }
+    return entries;
+}
+
+static void insert_entry(cfg_index_entry* entries, uint64_t mask, uintptr_t key, cfg_node* node) {
+    uint64_t idx = hash_key(key, mask);
+
+    while (entries[idx].key != 0) {
+        idx = (idx + 1) & mask;
+    }
+
+    entries[idx].key = key;
+    entries[idx].node = node;
+}
+
+static cfg_node* find_entry(cfg_index_entry* entries, uint64_t mask, uintptr_t key) {
+    uint64_t idx = hash_key(key, mask);
+
+    while (entries[idx].key != 0) {
+        if (entries[idx].key == key) {
+            return entries[idx].node;
+        }
+        idx = (idx + 1) & mask;
+    }
+
+    return NULL;
+}
+
+/*
+    Move up to slots entries from the old table to the current one and release the old table once empty.
+*/
+static void migrate(mambo_context* ctx, cfg_index* index, uint64_t slots) {
+    while (slots-- > 0 && index->migrated <= index->old_mask) {
+        cfg_index_entry* entry = &index->old_entries[index->migrated++];
+        if (entry->key != 0) {
+            insert_entry(index->entries, index->mask, entry->key, entry->node);
+        }
+    }
+
+    if (index->migrated > index->old_mask) {
+        mambo_free(ctx, index->old_entries);
+        index->old_entries = NULL;
+    }
+}
+
+int cfg_index_init(mambo_context* ctx, cfg_index* index, uint64_t capacity) {
+    index->entries = allocate_table(ctx, capacity);
+    index->mask = capacity - 1;
+    index->old_entries = NULL;
+    index->old_mask = 0;
+    index->migrated = 0;
+    index->nodes = (cfg_node **) mambo_alloc(ctx, capacity / 2 * sizeof(cfg_node *));
+    index->count = 0;
+    index->capacity = capacity / 2;
+
+    return index->entries == NULL || index->nodes == NULL ? -1 : 0;
+}
+
+void cfg_index_destroy(mambo_context* ctx, cfg_index* index) {
+    if (index->old_entries != NULL) {
+        mambo_free(ctx, index->old_entries);
+    }
+    mambo_free(ctx, index->entries);
+    mambo_free(ctx, index->nodes);
+}
+
+cfg_node* cfg_index_get(cfg_index* index, uintptr_t key) {
+    cfg_node* node = find_entry(index->entries, index->mask, key);
+
+    // Entries that were not migrated yet are still in the old table.
+    if (node == NULL && index->old_entries != NULL) {
+        node = find_entry(index->old_entries, index->old_mask, key);
+    }
+
+    return node;
+}
+
+int cfg_index_add(mambo_context* ctx, cfg_index* index, uintptr_t key, cfg_node* node) {
+    if (index->count == index->capacity) {
+        // Finish the previous migration before starting a new one.
+        if (index->old_entries != NULL) {
+            migrate(ctx, index, index->old_mask + 1);
+        }
+
+        uint64_t capacity = 2 * (index->mask + 1);
+
+        cfg_index_entry* entries = allocate_table(ctx, capacity);
+        cfg_node** nodes = (cfg_node **) mambo_alloc(ctx, capacity / 2 * sizeof(cfg_node *));
+        if (entries == NULL || nodes == NULL) {
+            return -1;
+        }
+
+        memcpy(nodes, index->nodes, index->count * sizeof(cfg_node *));
+        mambo_free(ctx, index->nodes);
+
+        index->old_entries = index->entries;
+        index->old_mask = index->mask;
+        index->migrated = 0;
+        index->entries = entries;
+        index->mask = capacity - 1;
+        index->nodes = nodes;
+        index->capacity = capacity / 2;
+    }
+
+    insert_entry(index->entries, index->mask, key, node);
+    index->nodes[index->count++] = node;
+
+    if (index->old_entries != NULL) {
+        migrate(ctx, index, MIGRATION_STEP);
+    }
+
+    return 0;
+}
+
+static void table_probe_lengths(cfg_index_entry* entries, uint64_t mask, uint64_t first, uint64_t* total,
+                                uint64_t* max) {
+    for (uint64_t idx = first; idx <= mask; idx++) {
+        if (entries[idx].key != 0) {
+            uint64_t length = ((idx - hash_key(entries[idx].key, mask)) & mask) + 1;
+            *total += length;
+            if (length > *max) {
+                *max = length;
+            }
+        }
+    }
+}
+
+void cfg_index_probe_lengths(cfg_index* index, uint64_t* total, uint64_t* max) {
+    *total = 0;
+    *max = 0;
+
+    table_probe_lengths(index->entries, index->mask, 0, total, max);
+
+    // Only the slots that were not migrated yet are still in use in the old table.
+    if (index->old_entries != NULL) {
+        table_probe_lengths(index->old_entries, index->old_mask, index->migrated, total, max);
+    }
+}
@@ -0,0 +1,110 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "../../plugins.h"
+
+#include "cfg.h"
+
+// TYPEDEFS
+
+struct cfg_index;
+typedef struct cfg_index cfg_index;
+
+struct cfg_index_entry;
+typedef struct cfg_index_entry cfg_index_entry;
+
+// STRUCTS
+
+/*
+    Slot of the open-addressed table of the index.
+*/
+struct cfg_index_entry {
+    uintptr_t key; // Start address of the block (0 marks an empty slot).
+    cfg_node* node; // Node describing the block.
+};
+
+/*
+    Look-up table of the CFG nodes keyed by the start address of the block. The table starts small and doubles once
+    half full. Entries are moved from the old table a few at a time on every operation, so there is no pause to
+    rehash the whole table. Nodes are also kept in a dense array in the order they were added, so iterating over the
+    CFG takes time proportional to the number of nodes rather than the capacity of the table.
+*/
+struct cfg_index {
+    cfg_index_entry* entries; // Current table.
+    uint64_t mask; // Number of slots of the current table minus one.
+
+    cfg_index_entry* old_entries; // Table being migrated into the current one (NULL if no resize in progress).
+    uint64_t old_mask; // Number of slots of the old table minus one.
+    uint64_t migrated; // Number of slots of the old table already migrated.
+
+    cfg_node** nodes; // All the nodes in the order they were added.
+    uint64_t count; // Number of nodes.
+    uint64_t capacity; // Number of elements allocated for the nodes array.
+};
+
+// FUNCTIONS
+
+/**
+ * Initialize an empty index.
+ *
+ * @param ctx Mambo context of the plugin.
+ * @param index Index to be initialized.
+ * @param capacity Initial number of slots of the table (has to be a power of two).
+ * @return 0 on success, -1 if the memory couldn't be allocated.
+ */
+int cfg_index_init(mambo_context* ctx, cfg_index* index, uint64_t capacity);
+
+/**
+ * Release the memory of the index (the nodes are not freed).
+ *
+ * @param ctx Mambo context of the plugin.
+ * @param index Index to be destroyed.
+ */
+void cfg_index_destroy(mambo_context* ctx, cfg_index* index);
+
+/**
+ * Find the node of the block.
+ *
+ * @param index Index to search.
+ * @param key Start address of the block.
+ * @return The node or NULL if the block is not in the index.
+ */
+cfg_node* cfg_index_get(cfg_index* index, uintptr_t key);
+
+/**
+ * Add the node of the block. The block must not be in the index already.
+ *
+ * @param ctx Mambo context of the plugin.
+ * @param index Index to add to.
+ * @param key Start address of the block.
+ * @param node Node describing the block.
+ * @return 0 on success, -1 if the memory couldn't be allocated.
+ */
+int cfg_index_add(mambo_context* ctx, cfg_index* index, uintptr_t key, cfg_node* node);
+
+/**
+ * Measure the number of slots visited to find every block of the index (for telemetry).
+ *
+ * @param index Index to measure.
+ * @param total Set to the sum of the probe lengths of all the blocks.
+ * @param max Set to the longest probe.
+ */
+void cfg_index_probe_lengths(cfg_index* index, uint64_t* total, uint64_t* max);
@@ -0,0 +1,290 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Compressed output of the trace (see COMPRESSED_OUTPUT). The compression thread doesn't have the MAMBO context, so
+    all the memory is allocated with malloc.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "compressor.h"
+
+#ifdef COMPRESSED_OUTPUT
+
+#include "aarch64_utils.h"
+#include "writer.h"
+
+#if COMPRESSION_CODEC == MTRACE_CODEC_ZSTD
+    #include <zstd.h>
+#elif COMPRESSION_CODEC == MTRACE_CODEC_LZ4
+    #include <lz4.h>
+    #include <lz4hc.h>
+#else
+    #error Unsupported COMPRESSION_CODEC!
+#endif
+
+// FUNCTIONS
+
+static size_t compress_bound(size_t size) {
+#if COMPRESSION_CODEC == MTRACE_CODEC_ZSTD
+    return ZSTD_compressBound(size);
+#else
+    return LZ4_compressBound(size);
+#endif
+}
+
+/*
+    Compress the chunk with the configured codec. Exits on failure, as the trace would be unreadable.
+*/
+static size_t compress_chunk(void* codec_state, uint8_t* out, size_t capacity, const uint8_t* data, size_t size) {
+#if COMPRESSION_CODEC == MTRACE_CODEC_ZSTD
+    size_t compressed = ZSTD_compressCCtx((ZSTD_CCtx *) codec_state, out, capacity, data, size, COMPRESSION_LEVEL);
+    if (ZSTD_isError(compressed)) {
+        fprintf(stderr, "mclift: Couldn't compress the trace: %s!\n", ZSTD_getErrorName(compressed));
+        exit(-1);
+    }
+#else
+    int compressed;
+    if (COMPRESSION_LEVEL > 1) {
+        compressed = LZ4_compress_HC((const char *) data, (char *) out, size, capacity, COMPRESSION_LEVEL);
+    } else {
+        compressed = LZ4_compress_default((const char *) data, (char *) out, size, capacity);
+    }
+    if (compressed <= 0) {
+        fprintf(stderr, "mclift: Couldn't compress the trace!\n");
+        exit(-1);
+    }
+#endif
+
+    return compressed;
+}
+
+static void put_chunk(trace_compressor* compressor, uint64_t index, uint64_t size, uint64_t compressed) {
+    if (index >= compressor->chunk_capacity) {
+        uint64_t capacity = compressor->chunk_capacity ? 2 * compressor->chunk_capacity : 64;
+        while (capacity <= index) {
+            capacity *= 2;
+        }
+
+        uint64_t* table = (uint64_t *) realloc(compressor->chunk_table, 3 * capacity * sizeof(uint64_t));
+        if (table == NULL) {
+            fprintf(stderr, "mclift: Couldn't allocate the chunk table!\n");
+            exit(-1);
+        }
+        compressor->chunk_table = table;
+        compressor->chunk_capacity = capacity;
+    }
+
+    compressor->chunk_table[3 * index] = compressor->offset;
+    compressor->chunk_table[3 * index + 1] = compressed;
+    compressor->chunk_table[3 * index + 2] = size;
+    compressor->offset += compressed;
+}
+
+static void* compressor_thread(void* arg) {
+    trace_compressor* compressor = (trace_compressor *) arg;
+    size_t capacity = compress_bound(TRACE_BUFFER_SIZE);
+    uint8_t* out = (uint8_t *) malloc(capacity);
+    void* codec_state = NULL;
+
+#if COMPRESSION_CODEC == MTRACE_CODEC_ZSTD
+    codec_state = ZSTD_createCCtx();
+    if (codec_state == NULL) {
+        out = NULL;
+    }
+#endif
+
+    if (out == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the compression buffer!\n");
+        exit(-1);
+    }
+
+    pthread_mutex_lock(&compressor->lock);
+
+    while (true) {
+        while (compressor->queue_head == compressor->queue_tail && !compressor->stop) {
+            pthread_cond_wait(&compressor->queued, &compressor->lock);
+        }
+
+        if (compressor->queue_head == compressor->queue_tail) {
+            break;
+        }
+
+        compressor_chunk chunk = compressor->queue[compressor->queue_head++ % COMPRESSION_QUEUE_SIZE];
+        pthread_mutex_unlock(&compressor->lock);
+
+        uint64_t start = get_virtual_counter();
+        size_t compressed = compress_chunk(codec_state, out, capacity, chunk.data, chunk.size);
+        compressor->compress_time += get_virtual_counter() - start;
+
+        write_all(compressor->fd, out, compressed);
+        put_chunk(compressor, chunk.index, chunk.size, compressed);
+
+        pthread_mutex_lock(&compressor->lock);
+        compressor->free_buffers[compressor->free_count++] = chunk.data;
+        pthread_cond_signal(&compressor->released);
+    }
+
+    pthread_mutex_unlock(&compressor->lock);
+
+#if COMPRESSION_CODEC == MTRACE_CODEC_ZSTD
+    ZSTD_freeCCtx((ZSTD_CCtx *) codec_state);
+#endif
+    free(out);
+
+    return NULL;
+}
+
+/*
+    Take a free buffer or allocate a new one, waiting for the compression thread if all the buffers are in use. The
+    caller has to hold the lock.
+*/
+static uint8_t* take_buffer(trace_compressor* compressor) {
+    if (compressor->free_count == 0 && compressor->buffer_count < COMPRESSOR_BUFFERS) {
+        uint8_t* buffer = (uint8_t *) malloc(TRACE_BUFFER_SIZE);
+        if (buffer == NULL) {
+            fprintf(stderr, "mclift: Couldn't allocate the trace buffer!\n");
+            exit(-1);
+        }
+        compressor->buffers[compressor->buffer_count++] = buffer;
+        return buffer;
+    }
+
+    uint64_t start = get_virtual_counter();
+    while (compressor->free_count == 0) {
+        pthread_cond_wait(&compressor->released, &compressor->lock);
+    }
+    compressor->wait_time += get_virtual_counter() - start;
+
+    return compressor->free_buffers[--compressor->free_count];
+}
+
+/*
+    Queue the chunk, waiting for the compression thread if the queue is full. The caller has to hold the lock.
+*/
+static void queue_chunk(trace_compressor* compressor, compressor_chunk* chunk) {
+    uint64_t start = get_virtual_counter();
+    while (compressor->queue_tail - compressor->queue_head == COMPRESSION_QUEUE_SIZE) {
+        pthread_cond_wait(&compressor->released, &compressor->lock);
+    }
+    compressor->wait_time += get_virtual_counter() - start;
+
+    compressor->queue[compressor->queue_tail++ % COMPRESSION_QUEUE_SIZE] = *chunk;
+    pthread_cond_signal(&compressor->queued);
+}
+
+uint8_t* trace_compressor_start(trace_compressor* compressor, int fd) {
+    memset(compressor, 0, sizeof(*compressor));
+    compressor->fd = fd;
+
+    // The container header is written at the end, the chunks follow the space reserved for it.
+    mtrace_compressed_header header;
+    memset(&header, 0, sizeof(header));
+    write_all(fd, (const uint8_t *) &header, sizeof(header));
+    compressor->offset = sizeof(header);
+
+    if (pthread_mutex_init(&compressor->lock, NULL) || pthread_cond_init(&compressor->queued, NULL)
+        || pthread_cond_init(&compressor->released, NULL)
+        || pthread_create(&compressor->thread, NULL, compressor_thread, compressor)) {
+        fprintf(stderr, "mclift: Couldn't start the compression thread!\n");
+        exit(-1);
+    }
+
+    pthread_mutex_lock(&compressor->lock);
+    uint8_t* buffer = take_buffer(compressor);
+    pthread_mutex_unlock(&compressor->lock);
+
+    return buffer;
+}
+
+uint8_t* trace_compressor_submit(trace_compressor* compressor, uint8_t* data, size_t size) {
+    if (size == 0) {
+        return data;
+    }
+
+    compressor_chunk chunk = {data, size, compressor->chunk_count++};
+    compressor->size += size;
+
+    pthread_mutex_lock(&compressor->lock);
+    if (chunk.index == 0) {
+        compressor->first = chunk;
+    } else {
+        queue_chunk(compressor, &chunk);
+    }
+    uint8_t* buffer = take_buffer(compressor);
+    pthread_mutex_unlock(&compressor->lock);
+
+    return buffer;
+}
+
+void trace_compressor_patch(trace_compressor* compressor, const void* data, size_t size) {
+    if (size > compressor->first.size) {
+        fprintf(stderr, "mclift: Couldn't patch the compressed trace!\n");
+        exit(-1);
+    }
+
+    memcpy(compressor->first.data, data, size);
+}
+
+uint64_t trace_compressor_finish(trace_compressor* compressor) {
+    pthread_mutex_lock(&compressor->lock);
+    if (compressor->first.size > 0) {
+        queue_chunk(compressor, &compressor->first);
+    }
+    compressor->stop = true;
+    pthread_cond_signal(&compressor->queued);
+    pthread_mutex_unlock(&compressor->lock);
+
+    pthread_join(compressor->thread, NULL);
+
+    mtrace_compressed_header header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic = MTRACE_COMPRESSED_MAGIC;
+    header.codec = COMPRESSION_CODEC;
+    header.level = COMPRESSION_LEVEL;
+    header.chunk_size = TRACE_BUFFER_SIZE;
+    header.size = compressor->size;
+    header.chunk_count = compressor->chunk_count;
+    header.chunk_table_offset = compressor->offset;
+
+    size_t table_size = 3 * compressor->chunk_count * sizeof(uint64_t);
+    write_all(compressor->fd, (const uint8_t *) compressor->chunk_table, table_size);
+
+    if (pwrite(compressor->fd, &header, sizeof(header), 0) != sizeof(header)) {
+        fprintf(stderr, "mclift: Couldn't write the trace header: %s!\n", strerror(errno));
+        exit(-1);
+    }
+
+    for (int idx = 0; idx < compressor->buffer_count; idx++) {
+        free(compressor->buffers[idx]);
+    }
+    free(compressor->chunk_table);
+
+    pthread_cond_destroy(&compressor->released);
+    pthread_cond_destroy(&compressor->queued);
+    pthread_mutex_destroy(&compressor->lock);
+
+    return header.chunk_table_offset + table_size;
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "mtrace_format.h"
+
+#ifdef COMPRESSED_OUTPUT
+
+// CONSTANTS
+
+/*
+    Number of buffers of the pipeline: the queued chunks, the chunk being compressed, the chunk being encoded and the
+    first chunk, which is only compressed once the header of the trace is final.
+*/
+#define COMPRESSOR_BUFFERS (COMPRESSION_QUEUE_SIZE + 3)
+
+// STRUCTS
+
+/*
+    Encoded part of the trace waiting for compression.
+*/
+typedef struct {
+    uint8_t* data; // Buffer of TRACE_BUFFER_SIZE bytes.
+    size_t size; // Number of bytes used.
+    uint64_t index; // Position of the chunk in the trace.
+} compressor_chunk;
+
+/*
+    Compression thread of the trace. The encoder hands full buffers over with trace_compressor_submit and gets an
+    empty buffer back, so encoding and compression of consecutive chunks overlap.
+*/
+typedef struct {
+    int fd; // File descriptor of the trace.
+    pthread_t thread; // Thread compressing and writing the chunks.
+    pthread_mutex_t lock; // Lock guarding the queue and the free buffers.
+    pthread_cond_t queued; // Signalled when a chunk is queued or the compressor is stopped.
+    pthread_cond_t released; // Signalled when a buffer is released by the compression thread.
+    bool stop; // Set once all the chunks were submitted.
+    compressor_chunk queue[COMPRESSION_QUEUE_SIZE]; // Ring buffer of the chunks waiting for compression.
+    uint64_t queue_head; // Number of chunks taken by the compression thread.
+    uint64_t queue_tail; // Number of chunks queued.
+    uint8_t* buffers[COMPRESSOR_BUFFERS]; // All the buffers allocated so far.
+    int buffer_count; // Number of buffers allocated.
+    uint8_t* free_buffers[COMPRESSOR_BUFFERS]; // Buffers not used by either of the threads.
+    int free_count; // Number of free buffers.
+    compressor_chunk first; // First chunk, kept until the header of the trace is patched.
+    uint64_t chunk_count; // Number of chunks submitted.
+    uint64_t* chunk_table; // Offset, compressed and uncompressed size of every chunk (see mtrace_format.h).
+    uint64_t chunk_capacity; // Number of chunks the table can hold.
+    uint64_t offset; // Offset of the next compressed chunk in the file.
+    uint64_t size; // Total size of the uncompressed trace.
+    uint64_t compress_time; // Ticks of the virtual counter spent compressing.
+    uint64_t wait_time; // Ticks of the virtual counter the encoder waited for a free buffer.
+} trace_compressor;
+
+// FUNCTIONS
+
+/**
+ * Start the compression thread. The container header is written once the compressor is finished.
+ *
+ * @param compressor Compressor to be initialized.
+ * @param fd File descriptor of the empty trace file.
+ * @return The first buffer to encode the trace into.
+ */
+uint8_t* trace_compressor_start(trace_compressor* compressor, int fd);
+
+/**
+ * Queue the encoded chunk for compression, blocking if the queue is full.
+ *
+ * @param compressor Running compressor.
+ * @param data Buffer returned by the previous call (or by trace_compressor_start).
+ * @param size Number of bytes used.
+ * @return An empty buffer of TRACE_BUFFER_SIZE bytes.
+ */
+uint8_t* trace_compressor_submit(trace_compressor* compressor, uint8_t* data, size_t size);
+
+/**
+ * Overwrite the beginning of the trace (e.g., the header rewritten once the offsets are known). The first chunk is
+ * only compressed by trace_compressor_finish, so it can be modified until then.
+ *
+ * @param compressor Running compressor.
+ * @param data New content.
+ * @param size Size of the content (at most the size of the first chunk).
+ */
+void trace_compressor_patch(trace_compressor* compressor, const void* data, size_t size);
+
+/**
+ * Compress the remaining chunks, write the chunk table and the container header, stop the thread and release all
+ * the buffers.
+ *
+ * @param compressor Running compressor.
+ * @return Size of the compressed file.
+ */
+uint64_t trace_compressor_finish(trace_compressor* compressor);
+
+#endif
@@ -0,0 +1,290 @@
+/*
+    Copyright 2021-2026 Igor Wodiany
+    Copyright 2021-2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Compile time configuration of the tracer. MAMBO does not support passing arguments to plugins, so all the settings
+    are selected here. The file is shared between the C sources and instrumentation.S, so it must only contain
+    preprocessor directives.
+*/
+
+#pragma once
+
+/*
+    Enables checks for NULL pointers (WARNING: May introduce a small performance
+    degradation, but makes the application to fail gracefully, and allows
+    debugging of any potential problems).
+*/
+// #define ALLOW_CRITICAL_PATH_CHECKS
+
+/*
+    Maximum number of targets tracked for a single indirect branch. Targets are stored in a set that starts with a
+    few inline slots and grows on demand (see cfg_targets). Once the limit is reached new targets are dropped and
+    counted as an overflow of the branch. Has to be a power of two.
+*/
+#define NUMBER_INDIRECT_TARGETS 4096
+
+/*
+    Used for programs compiled with GNU libc (Linux default).
+*/
+#define RECOVER_MAIN_ADDR_GLIBC
+
+/*
+    Load main address from the symbol table. Only works with non-stripped binaries.
+*/
+#define LOAD_MAIN_ADDR
+
+/*
+    Enable support for multi-threaded applications. This introduces a performance degradation
+    as extra instrumentation has to be added to track an address of the most recent function
+    call of every thread. Threads can be spawned from any thread and all unique spawns are
+    saved in the trace (version 2 only).
+*/
+// #define THREADS_SUPPORT
+
+#ifdef THREADS_SUPPORT
+    /*
+        Enable support for pthreads applications.
+    */
+    #define PTHREADS_SUPPORT
+
+    /*
+        Enable support for OpenMP applications. Enabling OpenMP and pthreads support will result
+        in excessive lifting, as pthreads calls from the OpenMP runtime will be followed alongside
+        GOMP_parallel.
+    */
+    #define OPENMP_SUPPORT
+#endif
+
+/*
+    Measure execution times of various parts of the lifter. Results in extra prints to stderr.
+*/
+#define PERFORMANCE_MONITORING
+
+/*
+    Collect the time spent in every phase of the plugin and statistics of the CFG and its hash tables (occupancy,
+    probe lengths, memory) for every thread and save them as JSON next to the trace (<trace>.json). Threads only
+    update their own records, which are combined when the thread exits. Compiled out entirely when disabled.
+*/
+// #define TELEMETRY
+
+/*
+    Count executions of basic blocks and of both directions of conditional branches. Counters are updated inline in
+    the thread private CFG (no atomics or function calls), summed when threads exit and saved in the trace (version 2
+    only).
+*/
+// #define EXECUTION_COUNTERS
+
+#ifdef EXECUTION_COUNTERS
+    /*
+        Only record whether blocks and branch directions were executed instead of counting them. Storing a flag is
+        cheaper than incrementing a counter, as it doesn't need to load the old value.
+    */
+    // #define EXECUTION_FLAGS_ONLY
+#endif
+
+/*
+    Stop tracking indirect branches that no longer discover new targets. Every branch counts its executions since the
+    last new target. When MAMBO re-translates the block into a trace (after 256 executions) and the count reached
+    ADAPTIVE_QUIET_THRESHOLD, the trace only compares the jump target against the known targets and falls back to the
+    full instrumentation if none of them matches, so new targets are still recorded.
+*/
+// #define ADAPTIVE_INSTRUMENTATION
+
+#ifdef ADAPTIVE_INSTRUMENTATION
+    /*
+        Number of executions without a new target after which the branch is considered saturated. Has to be lower
+        than the threshold of MAMBO traces for any branch to be guarded.
+    */
+    #define ADAPTIVE_QUIET_THRESHOLD 128
+#endif
+
+/*
+    Only record and instrument blocks of the main binary (the address range recorded by the ELF loader of MAMBO).
+    Shared libraries and the dynamic linker run without any instrumentation. Calls leaving the binary - direct calls
+    and indirect branches (e.g., PLT stubs) with a target outside of it - are marked with CFG_NATIVE_CALL. With
+    STREAMING_WRITER only direct calls are marked, as nodes are streamed before their targets are known.
+*/
+// #define MODULE_FILTER
+
+/*
+    Check returns against a per-thread shadow stack of return addresses pushed by calls (BL, BLR). Returns to the
+    instruction after the matching call skip the tracking of the target and only mismatched returns (longjmp,
+    exceptions, unusual tail calls) are recorded as targets. Such returns are marked with CFG_SHADOW_RETURN in the
+    trace - returns to the instructions following the calls are implied and a return without targets always matched.
+*/
+// #define SHADOW_STACK
+
+#ifdef SHADOW_STACK
+    /*
+        Number of entries of the shadow stack of every thread. The stack is a ring buffer, so deeper recursion only
+        overwrites the oldest entries and the returns to them are recorded as mismatches. Has to be a power of two.
+    */
+    #define SHADOW_STACK_SIZE 1024
+#endif
+
+/*
+    Size of the buffer the trace is serialized into before being written to the file. The buffer is flushed only
+    when full, so the number of system calls depends on the size of the trace and not on the number of nodes.
+*/
+#define TRACE_BUFFER_SIZE (4 << 20)
+
+/*
+    Format of the saved trace (see mtrace_format.h). Version 2 is compact and indexed, version 1 is the legacy
+    format kept for compatibility with existing consumers.
+*/
+#define TRACE_FORMAT_VERSION 2
+
+/*
+    Compress the trace written at exit. The trace is split into independently compressed chunks of up to
+    TRACE_BUFFER_SIZE bytes (see mtrace_format.h), which are compressed on a separate thread while the next chunk is
+    being encoded. Requires the library of the codec to be linked into MAMBO (e.g., -lzstd added to LIBS of the
+    makefile). Has no effect with STREAMING_WRITER.
+*/
+// #define COMPRESSED_OUTPUT
+
+#ifdef COMPRESSED_OUTPUT
+    /*
+        Codec of the chunks: MTRACE_CODEC_ZSTD or MTRACE_CODEC_LZ4.
+    */
+    #define COMPRESSION_CODEC MTRACE_CODEC_ZSTD
+
+    /*
+        Level of the codec: 1-19 for zstd, 1-12 for LZ4 (levels above 1 use LZ4HC). See mtrace-zbench (tools/mtrace)
+        for the ratio and throughput of the levels on a given trace.
+    */
+    #define COMPRESSION_LEVEL 3
+
+    /*
+        Number of encoded chunks waiting for the compression thread. The encoder blocks once the queue is full.
+    */
+    #define COMPRESSION_QUEUE_SIZE 4
+#endif
+
+/*
+    Size of the chunks the nodes and edges of the CFG are allocated from (see arena.h).
+*/
+#define ARENA_CHUNK_SIZE (1 << 20)
+
+/*
+    Alignment of the objects allocated from the arena.
+*/
+#define ARENA_ALIGNMENT 16
+
+/*
+    Initial number of slots of the CFG index of every thread and of the global CFG (see cfg_index.h). The index
+    doubles when half full, so a small value keeps thread creation cheap. Has to be a power of two.
+*/
+#define CFG_INDEX_INITIAL_CAPACITY 1024
+
+/*
+    Number of shards of the global CFG. Every shard has its own lock, so threads exiting at the same time can merge
+    their CFGs in parallel. Has to be a power of two and at most 64.
+*/
+#define CFG_MERGE_SHARDS 64
+
+/*
+    Stream the trace to the file while the application runs instead of writing it at exit. Newly discovered nodes and
+    indirect targets are appended to per-thread journals, which a background thread writes to the file every
+    JOURNAL_FLUSH_INTERVAL_MS. The exit only saves the remaining records and a killed process leaves a usable partial
+    trace. The journal is not indexed and doesn't contain execution counters; use tools/mtrace/mtrace-compact to
+    convert it to the version 2 format (see mtrace_format.h).
+*/
+// #define STREAMING_WRITER
+
+/*
+    Size of the blocks the journals of STREAMING_WRITER are made of.
+*/
+#define JOURNAL_BLOCK_SIZE (64 << 10)
+
+/*
+    Maximum number of blocks of a single journal not yet written. Once exceeded, the thread writes its journal itself,
+    which bounds the memory used by the log.
+*/
+#define JOURNAL_MAX_BLOCKS 16
+
+/*
+    Period of the background writer of STREAMING_WRITER.
+*/
+#define JOURNAL_FLUSH_INTERVAL_MS 100
+
+/*
+    Start from the CFG of a previous run of the same binary saved in WARM_START_TRACE (e.g., the trace of the previous
+    nightly run, possibly merged with mtrace-merge). Indirect branches start with the targets known from the trace
+    and, with ADAPTIVE_INSTRUMENTATION, branches all the known targets of which are mapped are guarded as soon as they
+    are first translated. The saved trace is the union of the known and the newly discovered CFG, so repeated runs
+    converge. Blocks of modules not mapped in this run are not carried over. The plugin starts cold if the trace
+    doesn't exist. Only uncompressed version 2 traces are supported and STREAMING_WRITER can't be used.
+*/
+// #define WARM_START
+
+#ifdef WARM_START
+    /*
+        Path of the trace to start from.
+    */
+    #define WARM_START_TRACE "warm.mtrace"
+
+    #ifdef STREAMING_WRITER
+        #error WARM_START is not supported with STREAMING_WRITER!
+    #endif
+#endif
+
+/*
+    Trace the processes forked by the application. A forked process continues from the copy-on-write snapshot of the
+    CFG of its parent and only saves the blocks it discovered or changed (new indirect targets and, with
+    EXECUTION_COUNTERS, executions after the fork), as the rest is saved by the parent. A process replacing its image
+    with execve saves its trace first, as the exit callback never runs. All the processes write to
+    <family>.<pid>.<counter>.mtrace (see trace_path), so the traces of one family can be merged with
+    mtrace-merge <output> <family>.*.mtrace. STREAMING_WRITER can't be used.
+*/
+// #define FORK_TRACKING
+
+#ifdef FORK_TRACKING
+    #ifdef STREAMING_WRITER
+        #error FORK_TRACKING is not supported with STREAMING_WRITER!
+    #endif
+#endif
+
+/*
+    Record the sequence of blocks executed by every thread (the path) next to the trace. Every executed block appends
+    its order id to a ring buffer of the thread and a background thread saves the filled parts of the buffers to
+    <family>.<pid>.<counter>.mpath every PATH_FLUSH_INTERVAL_MS, encoded as differences of the ids and repetitions of
+    the recent blocks, so loops take a few bytes per iteration (see mtrace_format.h and tools/mtrace/mtrace-path). A
+    thread the writer fell behind saves its buffer itself, so the memory stays bounded. FORK_TRACKING can't be used.
+*/
+// #define PATH_RECORDING
+
+#ifdef PATH_RECORDING
+    /*
+        Number of entries of the ring buffer of every thread (4 bytes each). Has to be a power of two.
+    */
+    #define PATH_BUFFER_ENTRIES (1 << 18)
+
+    /*
+        Number of entries the thread hands over to the writer at once. Has to be a power of two, at most half of
+        PATH_BUFFER_ENTRIES.
+    */
+    #define PATH_CHUNK_ENTRIES (1 << 14)
+
+    /*
+        Period of the background writer of the path.
+    */
+    #define PATH_FLUSH_INTERVAL_MS 100
+
+    #ifdef FORK_TRACKING
+        #error PATH_RECORDING is not supported with FORK_TRACKING!
+    #endif
+#endif
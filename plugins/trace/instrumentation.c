@@ -16,83 +16,587 @@
 */
 #ifdef PLUGINS_NEW
 #include <assert.h>
+#include <errno.h>
+#include <linux/sched.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
 #include "cfg.h"
+#include "cfg_index.h"
 #include "writer.h"
 
+#include "aarch64_utils.h"
 #include "instrumentation.h"
 
-/* 
-    Enables checks for NULL pointers (WARNING: May introduce a small performance
-    degradation, but makes the application to fail gracefully, and allows
-    debugging of any potential problems).
+#ifdef PERFORMANCE_MONITORING
+struct timers {
+    uint64_t dynamic_execution;
+    uint64_t thread_init; // Total time spent setting up thread data (all threads).
+    uint64_t thread_merge; // Total time spent merging thread CFGs into the global CFG (all threads).
+    uint64_t threads; // Number of threads that exited.
+    uint64_t indirect_sites; // Number of instrumented indirect branches, including their copies in traces.
+    uint64_t indirect_site_bytes; // Code cache used by the instrumentation of indirect branches (all threads).
+} timers;
+#endif
+
+/*
+    Store target of an indirect branch into a set of targets. Function implemented directly in assembly to increase the
+    performance and avoid registers spilling. See instrumentation.S.
 */
-// #define ALLOW_CRITICAL_PATH_CHECKS 
+void track_branch_target(void *target_address, cfg_targets *targets);
 
 /*
-    Number of indirect branches that can be tracked. Exceeding this number causes
-    an undefined behaviour within the lifter and some data may be lost. This is
-    intentional as we avoid any dynamic allocation during the control flow
-    recovery to improve the overall performance. Changing this value without
-    consulting instrumentation.S will result in an incorrect execution.
+    Out-of-line stubs calling track_branch_target, shared by all the instrumented indirect branches. The stub of the
+    register xN expects the target in xN and the targets of the branch in x9 (x10 for the stub of x9), saves the
+    registers used by track_branch_target and returns to the link register. There is no stub of the link register
+    itself, as the call overwrites it. See instrumentation.S.
 */
-#define NUMBER_INDIRECT_TARGETS 4096 
+extern void *const track_branch_target_stubs[lr];
+
+void track_pthread_entry(lift_plugin_data* plugin_data, void** call_site_ptr, void* entry_addr);
 
+#ifdef EXECUTION_COUNTERS
 /*
-    Used for programs compiled with GNU libc (Linux default).
+    Emit an update of the execution counter - an increment or, with EXECUTION_FLAGS_ONLY, a store of 1.
 */
-#define RECOVER_MAIN_ADDR_GLIBC
+static void emit_exec_count_update(mambo_context *ctx, uint64_t *counter) {
+#ifdef EXECUTION_FLAGS_ONLY
+    emit_push(ctx, (1 << x0) | (1 << x1));
+    emit_set_reg_ptr(ctx, x0, counter);
+    emit_set_reg(ctx, x1, 1);
+    emit_a64_LDR_STR_unsigned_immed(ctx, 0, 0, 0, 0, x0, x1);
+    emit_pop(ctx, (1 << x0) | (1 << x1));
+#else
+    emit_counter64_incr(ctx, counter, 1);
+#endif
+}
 
 /*
-    Load main address from the symbol table. Only works with non-stripped binaries.
+    Emit instrumentation recording the direction of the conditional branch. A copy of the branch, evaluating the same
+    condition, jumps to the update of the taken edge, while the fall-through path updates the skipped edge. Both paths
+    then continue to the original branch.
 */
-#define LOAD_MAIN_ADDR 
+static void emit_direction_counters(mambo_context *ctx, uint32_t inst, cfg_edge *taken, cfg_edge *skipped) {
+    uint32_t *branch = (uint32_t *) mambo_get_cc_addr(ctx);
+    mambo_set_cc_addr(ctx, branch + 1);
+
+    emit_exec_count_update(ctx, &skipped->exec_count);
+
+    mambo_branch done;
+    mambo_reserve_branch(ctx, &done);
+
+    *branch = retarget_conditional_branch(inst, branch, mambo_get_cc_addr(ctx));
+    emit_exec_count_update(ctx, &taken->exec_count);
+
+    emit_local_branch(ctx, &done);
+}
+#endif
 
 /*
-    Enable support for multi-threaded applications. This introduces a performance degradation
-    as extra instrumentation has to be added to track an address of the most recent function
-    call. For now it only support sequential control programs, i.e, only the main thread can
-    spawn new threads.
+    Maximum number of instructions following a call scanned for the registers it overwrites (see dead_registers).
 */
-// #define THREADS_SUPPORT 
+#define LIVENESS_SCAN_LIMIT 16
 
-#ifdef THREADS_SUPPORT
-    /*
-        Enable support for pthreads applications.
-    */
-    #define PTHREADS_SUPPORT
+/*
+    Decode the general-purpose registers read (uses) and written (defs) by the instruction. Only the common data
+    processing and load/store encodings are recognised; false is returned for anything else, including all branches,
+    so the caller has to treat the instruction as reading every register. Register 31 (SP or XZR) is never reported.
+*/
+static bool instruction_registers(uint32_t inst, uint32_t *uses, uint32_t *defs) {
+    uint32_t rd = inst & 0x1f;
+    uint32_t rn = (inst >> 5) & 0x1f;
+    uint32_t rm = (inst >> 16) & 0x1f;
+    uint32_t rt2 = (inst >> 10) & 0x1f;
+
+    *uses = 0;
+    *defs = 0;
+
+    if ((inst & 0x1f000000) == 0x10000000) {
+        // ADR, ADRP
+        *defs = 1u << rd;
+    } else if ((inst & 0x1f800000) == 0x11000000 || (inst & 0x1f800000) == 0x12000000) {
+        // ADD/SUB (immediate), logical (immediate)
+        *uses = 1u << rn;
+        *defs = 1u << rd;
+    } else if ((inst & 0x1f800000) == 0x12800000) {
+        // MOVN, MOVZ, MOVK - MOVK keeps the other bits of the register
+        uint32_t opc = (inst >> 29) & 0x3;
+        if (opc == 1) {
+            return false;
+        }
+        *uses = (opc == 3) ? (1u << rd) : 0;
+        *defs = 1u << rd;
+    } else if ((inst & 0x1f000000) == 0x0a000000 || (inst & 0x1f200000) == 0x0b000000) {
+        // Logical (shifted register), ADD/SUB (shifted register)
+        *uses = (1u << rn) | (1u << rm);
+        *defs = 1u << rd;
+    } else if ((inst & 0x3b000000) == 0x39000000) {
+        // LDR/STR (unsigned immediate), including SIMD&FP registers and PRFM
+        bool simd = (inst >> 26) & 0x1;
+        bool store = ((inst >> 22) & 0x3) == 0;
+        bool prefetch = (inst >> 30) == 0x3 && ((inst >> 22) & 0x3) == 0x2;
+        *uses = 1u << rn;
+        if (!simd && store) {
+            *uses |= 1u << rd;
+        } else if (!simd && !prefetch) {
+            *defs = 1u << rd;
+        }
+    } else if ((inst & 0x3a000000) == 0x28000000) {
+        // LDP/STP, including SIMD&FP registers and the pre- and post-index forms
+        bool simd = (inst >> 26) & 0x1;
+        bool load = (inst >> 22) & 0x1;
+        uint32_t index = (inst >> 23) & 0x3;
+        *uses = 1u << rn;
+        if (!simd && !load) {
+            *uses |= (1u << rd) | (1u << rt2);
+        } else if (!simd) {
+            *defs = (1u << rd) | (1u << rt2);
+        }
+        if (index == 1 || index == 3) {
+            *defs |= 1u << rn;
+        }
+    } else {
+        return false;
+    }
+
+    *uses &= 0x7fffffff;
+    *defs &= 0x7fffffff;
+
+    return true;
+}
+
+/*
+    Backward liveness scan of the instructions starting at code. The scan covers the instructions up to the first one
+    that isn't recognised by instruction_registers (or LIVENESS_SCAN_LIMIT of them), which is assumed to read all the
+    registers. Returns the registers that may be read before they are written, i.e., live at code. The scan never
+    crosses into the next page, which may not be mapped.
+*/
+static uint32_t live_registers(uint32_t *code) {
+    uint32_t uses[LIVENESS_SCAN_LIMIT], defs[LIVENESS_SCAN_LIMIT];
+    int count = 0;
+
+    while (count < LIVENESS_SCAN_LIMIT && ((uintptr_t) &code[count] & 4095) != 0 &&
+           instruction_registers(code[count], &uses[count], &defs[count])) {
+        count++;
+    }
+
+    uint32_t live = 0xffffffff;
+    for (int idx = count - 1; idx >= 0; idx--) {
+        live = (live & ~defs[idx]) | uses[idx];
+    }
+
+    return live;
+}
+
+/*
+    Registers dead at the indirect branch at source, which the instrumentation may use without saving them. A register
+    is only dead if it is provably written before it is read on every path from the branch. The successors of RET and
+    BR are unknown, so nothing is dead at them. BLR itself overwrites the link register, and the callee returns to the
+    instruction after the call, so the temporaries x9-x15 overwritten there (see live_registers) are dead as well.
+    The callee can't read them, as they don't pass arguments, but it may expect them to be preserved (e.g., TLS
+    descriptor resolvers or callees compiled with -fipa-ra), so they are never assumed to be dead without the scan.
+*/
+static uint32_t dead_registers(a64_instruction inst_type, enum reg rn, uint32_t *source) {
+    uint32_t temporaries = (1 << x9) | (1 << x10) | (1 << x11) | (1 << x12) | (1 << x13) | (1 << x14) | (1 << x15);
+    uint32_t dead = 0;
 
-    /*
-        Enable support for OpenMP applications. Enabling OpenMP and pthreads support will result
-        in excessive lifting, as pthreads calls from the OpenMP runtime will be followed alongside
-        GOMP_parallel.
-    */
-    #define OPENMP_SUPPORT
+    if (inst_type == A64_BLR) {
+        dead = (1 << lr) | (temporaries & ~live_registers(source + 1));
+    }
+
+    return dead & ~(1 << rn);
+}
+
+#ifdef ADAPTIVE_INSTRUMENTATION
+/*
+    Emit a guard comparing the target of the indirect branch in rn against the targets discovered so far. The targets
+    are embedded as immediates, so a match costs neither a memory access nor a call. Matching targets jump to the
+    branch reserved in done, other targets fall through to the instrumentation emitted after the guard. Returns false
+    without emitting anything if the branch is not saturated yet or has too many targets to be checked inline.
+*/
+static bool emit_target_guard(mambo_context *ctx, cfg_targets *targets, enum reg rn, mambo_branch *done) {
+    if (targets->quiet < ADAPTIVE_QUIET_THRESHOLD || targets->table != NULL || targets->inline_targets[0] == 0) {
+        return false;
+    }
+
+    enum reg scratch = (rn == x0) ? x1 : x0;
+    mambo_branch hits[CFG_INLINE_TARGETS], miss;
+    int count = 0;
+
+    emit_push(ctx, 1 << scratch);
+    for (int idx = 0; idx < CFG_INLINE_TARGETS && targets->inline_targets[idx] != 0; idx++) {
+        emit_set_reg(ctx, scratch, targets->inline_targets[idx]);
+        emit_a64_logical_reg(ctx, 1, 2, 0, 0, rn, 0, scratch, scratch);
+        mambo_reserve_branch(ctx, &hits[count++]);
+    }
+    emit_pop(ctx, 1 << scratch);
+    mambo_reserve_branch(ctx, &miss);
+
+    // Hit - skip the instrumentation
+    for (int idx = 0; idx < count; idx++) {
+        emit_local_branch_cbz(ctx, &hits[idx], scratch);
+    }
+    emit_pop(ctx, 1 << scratch);
+    mambo_reserve_branch(ctx, done);
+
+    emit_local_branch(ctx, &miss);
+
+    targets->guards++;
+
+    return true;
+}
 #endif
 
+#ifdef SHADOW_STACK
+_Static_assert(SHADOW_STACK_SIZE >= 2 && (SHADOW_STACK_SIZE & (SHADOW_STACK_SIZE - 1)) == 0,
+               "SHADOW_STACK_SIZE has to be a power of two");
+
 /*
-    Measure execution times of various parts of the lifter. Results in extra prints to stderr.
+    Emit an AND of the index in rn with the size of the shadow stack minus one (wraps the index around).
 */
-#define PERFORMANCE_MONITORING 
+static inline void emit_shadow_stack_wrap(mambo_context *ctx, enum reg rn, enum reg rd) {
+    emit_a64_logical_immed(ctx, 1, 0, 1, 0, __builtin_ctz(SHADOW_STACK_SIZE) - 1, rn, rd);
+}
+
+/*
+    Emit a push of the return address of the call onto the shadow stack of the thread.
+*/
+static void emit_shadow_stack_push(mambo_context *ctx, lift_shadow_stack *stack, void *return_addr) {
+    emit_push(ctx, (1 << x0) | (1 << x1) | (1 << x2));
+    emit_set_reg_ptr(ctx, x0, stack);
+    emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 1, 0, x0, x1);
+    emit_a64_ADD_SUB_immed(ctx, 1, 0, 0, 0, 1, x1, x1);
+    emit_shadow_stack_wrap(ctx, x1, x1);
+    emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 0, 0, x0, x1);
+    emit_set_reg(ctx, x2, (uintptr_t) return_addr);
+    emit_a64_ADD_SUB_shift_reg(ctx, 1, 0, 0, 0, x1, 3, x0, x0);
+    emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 0, offsetof(lift_shadow_stack, entries) >> 3, x0, x2);
+    emit_pop(ctx, (1 << x0) | (1 << x1) | (1 << x2));
+}
 
+/*
+    Emit a pop of the shadow stack of the thread and a comparison of the popped address against the target of the
+    return in rn. Matching returns jump to the branch reserved in hit, other returns fall through to the tracking of
+    the target emitted after the check.
+*/
+static void emit_shadow_stack_check(mambo_context *ctx, lift_shadow_stack *stack, cfg_targets *targets, enum reg rn,
+                                    mambo_branch *hit) {
+    enum reg scratch[3];
+    int count = 0;
+
+    for (enum reg reg = x0; count < 3; reg++) {
+        if (reg != rn) {
+            scratch[count++] = reg;
+        }
+    }
+
+    enum reg base = scratch[0], top = scratch[1], next = scratch[2];
+    uint32_t regs = (1 << base) | (1 << top) | (1 << next);
+    mambo_branch miss;
+
+    emit_push(ctx, regs);
+    emit_set_reg_ptr(ctx, base, stack);
+    emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 1, 0, base, top);
+    emit_a64_ADD_SUB_immed(ctx, 1, 1, 0, 0, 1, top, next);
+    emit_shadow_stack_wrap(ctx, next, next);
+    emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 0, 0, base, next);
+    emit_a64_ADD_SUB_shift_reg(ctx, 1, 0, 0, 0, top, 3, base, base);
+    emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 1, offsetof(lift_shadow_stack, entries) >> 3, base, base);
+    emit_a64_logical_reg(ctx, 1, 2, 0, 0, rn, 0, base, base);
+    mambo_reserve_branch(ctx, &miss);
 #ifdef PERFORMANCE_MONITORING
-    #include "aarch64_utils.h"
+    emit_set_reg_ptr(ctx, top, targets);
+    emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 1, CFG_TARGETS_SHADOW_HITS >> 3, top, next);
+    emit_a64_ADD_SUB_immed(ctx, 1, 0, 0, 0, 1, next, next);
+    emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 0, CFG_TARGETS_SHADOW_HITS >> 3, top, next);
 #endif
+    emit_pop(ctx, regs);
+    mambo_reserve_branch(ctx, hit);
 
-#ifdef PERFORMANCE_MONITORING
-struct timers {
-    uint64_t dynamic_execution;
-} timers;
+    // Miss - the entry stays popped, so the stack realigns with the following calls and returns
+    emit_local_branch_cbnz(ctx, &miss, base);
+    emit_pop(ctx, regs);
+}
 #endif
 
+#ifdef PATH_RECORDING
+_Static_assert(offsetof(path_buffer, head) == 0, "The head of the path buffer has to be its first field");
+_Static_assert(offsetof(path_buffer, entries) < (4096 << 2), "Entries of the path buffer are out of the LDR/STR range");
+
 /*
-    Store target of an indirect branch into a hash map. Function implemented directly in assembly to increase the
-    performance and avoid registers spilling. See instrumentation.S.
+    Emit an append of the id of the block to the path buffer of the thread. Every PATH_CHUNK_ENTRIES blocks the filled
+    chunk is handed over to the writer with a safe call to path_buffer_full. The flags are not affected, as the block
+    may end in a conditional branch.
+*/
+static void emit_path_record(mambo_context *ctx, path_buffer *buffer, uint64_t order_id) {
+    mambo_branch full, done;
+
+    emit_push(ctx, (1 << x0) | (1 << x1) | (1 << x2));
+    emit_set_reg_ptr(ctx, x0, buffer);
+    emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 1, 0, x0, x1);
+    emit_a64_ADD_SUB_immed(ctx, 1, 0, 0, 0, 1, x1, x2);
+    emit_a64_logical_immed(ctx, 1, 0, 1, 0, __builtin_ctz(PATH_BUFFER_ENTRIES) - 1, x2, x2);
+    emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 0, 0, x0, x2);
+    emit_a64_ADD_SUB_shift_reg(ctx, 1, 0, 0, 0, x1, 2, x0, x1);
+    emit_set_reg(ctx, x0, (uint32_t) order_id);
+    emit_a64_LDR_STR_unsigned_immed(ctx, 2, 0, 0, offsetof(path_buffer, entries) >> 2, x1, x0);
+    emit_a64_logical_immed(ctx, 1, 0, 1, 0, __builtin_ctz(PATH_CHUNK_ENTRIES) - 1, x2, x2);
+    mambo_reserve_branch(ctx, &full);
+    emit_pop(ctx, (1 << x0) | (1 << x1) | (1 << x2));
+    mambo_reserve_branch(ctx, &done);
+
+    // Full - the head wrapped around to the beginning of a chunk
+    emit_local_branch_cbz(ctx, &full, x2);
+    emit_set_reg_ptr(ctx, x0, buffer);
+    emit_safe_fcall(ctx, path_buffer_full, 1);
+    emit_pop(ctx, (1 << x0) | (1 << x1) | (1 << x2));
+
+    emit_local_branch(ctx, &done);
+}
+#endif
+
+#ifdef MODULE_FILTER
+/*
+    Check whether the address belongs to the main binary, the only module traced with MODULE_FILTER.
+*/
+static inline bool is_traced_address(void *address) {
+    return (uintptr_t) address - global_data.base_addr < global_data.end_addr - global_data.base_addr;
+}
+
+/*
+    Check whether any of the targets of the indirect branch is outside of the traced binary.
+*/
+static bool leaves_traced_binary(cfg_targets *targets) {
+    for (int idx = 0; idx < CFG_INLINE_TARGETS; idx++) {
+        if (targets->inline_targets[idx] != 0 && !is_traced_address((void *) targets->inline_targets[idx])) {
+            return true;
+        }
+    }
+
+    if (targets->table != NULL) {
+        for (uint64_t idx = 0; idx <= targets->mask; idx++) {
+            if (targets->table[idx] != 0 && !is_traced_address((void *) targets->table[idx])) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/*
+    Mark indirect branches jumping out of the traced binary as native calls. Returns are skipped, as returning to a
+    library that called back into the binary is not a call.
+*/
+static void mark_native_calls(cfg_node **nodes, uint64_t count) {
+    for (uint64_t index = 0; index < count; index++) {
+        cfg_node *node = nodes[index];
+
+        if (node->targets != NULL && !(node->type & CFG_RETURN) && leaves_traced_binary(node->targets)) {
+            node->type |= CFG_NATIVE_CALL;
+        }
+    }
+}
+#endif
+
+#ifdef WARM_START
+/*
+    Add the thread spawn of the warm-start trace to the registry.
+*/
+static void add_warm_thread(void *arg, void *entry_addr, void *call_site) {
+    track_pthread_entry((lift_plugin_data *) arg, &call_site, entry_addr);
+}
+#endif
+
+_Static_assert(CFG_MERGE_SHARDS <= 64 && (CFG_MERGE_SHARDS & (CFG_MERGE_SHARDS - 1)) == 0,
+               "CFG_MERGE_SHARDS has to be a power of two not greater than 64");
+
+/*
+    Shard of the global CFG the block belongs to. Uses different bits of the hash than cfg_index, so the blocks of one
+    shard are still spread over the whole index of the shard.
+*/
+static inline int cfg_shard_id(void *block_address) {
+    uint64_t hash = ((uintptr_t) block_address >> 2) * 0x9e3779b97f4a7c15ULL;
+    return (int) (hash >> 58) & (CFG_MERGE_SHARDS - 1);
+}
+
+/*
+    Merge nodes of the thread into the shard of the global CFG and unlock the shard. The caller has to hold the lock.
+*/
+static void merge_shard(mambo_context *ctx, lift_cfg_shard *shard, cfg_node **nodes, uint64_t count) {
+    int ret;
+
+    for (uint64_t index = 0; index < count; index++) {
+        cfg_node *local_node = nodes[index];
+        cfg_node *global_node = cfg_index_get(&shard->cfg, (uintptr_t) local_node->start_addr);
+
+        if (global_node == NULL) {
+            ret = cfg_index_add(ctx, &shard->cfg, (uintptr_t) local_node->start_addr, local_node);
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+            if (ret) {
+                fprintf(stderr, "mclift: Couldn't add entry to the global CFG index!\n");
+                exit(-1);
+            }
+#endif
+        } else {
+            merge_nodes(global_node, local_node);
+        }
+    }
+
+    ret = pthread_mutex_unlock(&shard->lock);
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+    if (ret) {
+        fprintf(stderr, "mclift: Failed to unlock the mutex!\n");
+        exit(-1);
+    }
+#endif
+}
+
+#ifdef FORK_TRACKING
+/*
+    Clear the execution counters of the node and of its edges.
+*/
+static void reset_exec_counts(cfg_node *node) {
+    node->exec_count = 0;
+    for (cfg_edge *edge = node->edges; edge != NULL; edge = edge->next) {
+        edge->exec_count = 0;
+    }
+}
+
+/*
+    Keep only the nodes discovered or changed since the process was forked, as its parent saves the rest: new nodes,
+    inherited nodes with new indirect targets and, with EXECUTION_COUNTERS, inherited nodes executed since the fork
+    (see continue_forked_process). Returns the number of the kept nodes.
+*/
+static uint64_t drop_inherited_nodes(lift_plugin_data *plugin_data, cfg_node **nodes, uint64_t count) {
+    if (cfg_generation == 0) {
+        return count;
+    }
+
+    uint64_t kept = 0;
+
+    for (uint64_t index = 0; index < count; index++) {
+        cfg_node *node = nodes[index];
+        bool changed = node->order_id >= plugin_data->fork_order_id;
+
+        changed |= node->targets != NULL && node->targets->generation == cfg_generation;
+#ifdef EXECUTION_COUNTERS
+        changed |= node->exec_count != 0;
+#endif
+
+        if (changed) {
+            nodes[kept++] = node;
+        }
+    }
+
+    return kept;
+}
+
+/*
+    Set up the tracing of the forked process. Only the forking thread survives the fork, so the locks that other threads
+    of the parent could have held are reinitialized, and the global CFG, which only holds the blocks of the exited
+    threads of the parent, starts empty (its pages stay shared with the parent). The CFG of the thread is kept, as its
+    code cache refers to the nodes.
+*/
+static void continue_forked_process(mambo_context *ctx, lift_plugin_data *plugin_data, lift_thread_data *thread_data) {
+    int ret;
+
+    cfg_generation++;
+    plugin_data->pid = getpid();
+    plugin_data->fork_order_id = __atomic_load_n(&plugin_data->block_id, __ATOMIC_RELAXED);
+
+    ret = pthread_mutex_init(&plugin_data->lock, NULL);
+    ret |= pthread_mutex_init(&plugin_data->modules.lock, NULL);
+
+    for (int shard = 0; shard < CFG_MERGE_SHARDS; shard++) {
+        ret |= pthread_mutex_init(&plugin_data->shards[shard].lock, NULL);
+        ret |= cfg_index_init(ctx, &plugin_data->shards[shard].cfg, CFG_INDEX_INITIAL_CAPACITY);
+    }
+
+    if (ret) {
+        fprintf(stderr, "mclift: Couldn't reinitialize the plugin data in the forked process %d!\n",
+                plugin_data->pid);
+        exit(-1);
+    }
+
+#ifdef EXECUTION_COUNTERS
+    // Counters of the inherited blocks restart from zero, so the counts of the family add up when merged.
+    for (uint64_t index = 0; index < thread_data->cfg->count; index++) {
+        reset_exec_counts(thread_data->cfg->nodes[index]);
+    }
+#else
+    (void) thread_data;
+#endif
+}
+
+/*
+    Save the trace before execve replaces the process image, as the exit callback never runs. The CFG of the calling
+    thread is combined with the global CFG without being released, so the process can carry on if execve fails. The
+    trace saved at exit then contains everything saved here, so lift_post_syscall_cb removes this trace to avoid
+    counting the executions twice when the family is merged. Blocks only known to other running threads, which are
+    killed by execve, are lost.
 */
-void track_branch_target(void *target_address, cfg_edge *edge);
+static void save_before_exec(mambo_context *ctx, lift_plugin_data *plugin_data, lift_thread_data *thread_data) {
+    cfg_index *cfg = thread_data->cfg;
+    uint64_t node_count = cfg->count;
+
+    // Shards are locked in order and merge_shard only holds one lock at a time, so this can't deadlock.
+    for (int shard = 0; shard < CFG_MERGE_SHARDS; shard++) {
+        pthread_mutex_lock(&plugin_data->shards[shard].lock);
+        node_count += plugin_data->shards[shard].cfg.count;
+    }
+
+    cfg_node **nodes = (cfg_node **) mambo_alloc(ctx, sizeof(cfg_node *) * (node_count + 1));
+    if (nodes == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the list of nodes!\n");
+        exit(-1);
+    }
+
+    memcpy(nodes, cfg->nodes, sizeof(cfg_node *) * cfg->count);
+    node_count = cfg->count;
+
+    for (int shard = 0; shard < CFG_MERGE_SHARDS; shard++) {
+        for (uint64_t index = 0; index < plugin_data->shards[shard].cfg.count; index++) {
+            cfg_node *global_node = plugin_data->shards[shard].cfg.nodes[index];
+            cfg_node *local_node = cfg_index_get(cfg, (uintptr_t) global_node->start_addr);
+
+            if (local_node == NULL) {
+                nodes[node_count++] = global_node;
+            } else {
+                // Nodes of the exited threads are no longer executed, so they can be moved into the live node. The
+                // counters left in the global node are cleared, as the live node is merged back when the thread exits.
+                merge_nodes(local_node, global_node);
+                reset_exec_counts(global_node);
+            }
+        }
+    }
+
+#ifdef MODULE_FILTER
+    mark_native_calls(nodes, node_count);
+#endif
+
+    node_count = drop_inherited_nodes(plugin_data, nodes, node_count);
+
+    trace_path(thread_data->exec_trace, sizeof(thread_data->exec_trace), plugin_data->family, "mtrace");
+
+    pthread_mutex_lock(&plugin_data->lock);
+    write_trace(ctx, thread_data->exec_trace, nodes, node_count, plugin_data->main_addr, &plugin_data->threads,
+                &plugin_data->modules);
+    pthread_mutex_unlock(&plugin_data->lock);
+
+    for (int shard = 0; shard < CFG_MERGE_SHARDS; shard++) {
+        pthread_mutex_unlock(&plugin_data->shards[shard].lock);
+    }
+
+    mambo_free(ctx, nodes);
+}
+#endif
 
 /*
     Allocate per thread data for the newly entered thread.
@@ -100,6 +604,10 @@ void track_branch_target(void *target_address, cfg_edge *edge);
 int lift_pre_thread_cb(mambo_context *ctx) {
     int ret;
 
+#if defined(PERFORMANCE_MONITORING) || defined(TELEMETRY)
+    uint64_t start = get_virtual_counter();
+#endif
+
     lift_thread_data *thread_data = (lift_thread_data *) mambo_alloc(ctx, sizeof(lift_thread_data));
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
     if (thread_data == NULL) {
@@ -109,25 +617,91 @@ int lift_pre_thread_cb(mambo_context *ctx) {
     }
 #endif
 
-    thread_data->cfg = (mambo_ht_t *) mambo_alloc(ctx, sizeof(mambo_ht_t));
+#ifdef TELEMETRY
+    telemetry_thread_init(&thread_data->telemetry, mambo_get_thread_id(ctx));
+#endif
+
+    thread_data->cfg = (cfg_index *) mambo_alloc(ctx, sizeof(cfg_index));
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
     if (thread_data->cfg == NULL) {
-        fprintf(stderr, "mclift: Couldn't allocate the hash map on thread %d!\n",
+        fprintf(stderr, "mclift: Couldn't allocate the CFG index on thread %d!\n",
                 mambo_get_thread_id(ctx));
         exit(-1);
     }
 #endif
 
-    ret = mambo_ht_init(thread_data->cfg, 1 << 20, 0, 80, false);
+    ret = cfg_index_init(ctx, thread_data->cfg, CFG_INDEX_INITIAL_CAPACITY);
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
     if (ret) {
-        fprintf(stderr, "mclift: Couldn't initialize the hash map on thread %d!\n",
+        fprintf(stderr, "mclift: Couldn't initialize the CFG index on thread %d!\n",
+                mambo_get_thread_id(ctx));
+        exit(-1);
+    }
+#endif
+
+    thread_data->current_call_addr = NULL;
+    thread_data->journal = NULL;
+
+#ifdef SHADOW_STACK
+    memset(&thread_data->shadow_stack, 0, sizeof(lift_shadow_stack));
+#endif
+
+#ifdef FORK_TRACKING
+    thread_data->exec_trace[0] = '\0';
+#endif
+
+#if defined(STREAMING_WRITER) || defined(PATH_RECORDING)
+    lift_plugin_data *plugin_data = (lift_plugin_data *) mambo_get_plugin_data(ctx);
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+    if (plugin_data == NULL) {
+        fprintf(stderr, "mclift: Couldn't get the plugin data!\n");
+        exit(-1);
+    }
+#endif
+
+    pthread_mutex_lock(&plugin_data->lock);
+    if (!plugin_data->writer_started) {
+#ifdef STREAMING_WRITER
+        ret = journal_writer_start(&plugin_data->writer, &plugin_data->main_addr, &plugin_data->modules,
+                                   plugin_data->family);
+        if (ret) {
+            exit(-1);
+        }
+#endif
+#ifdef PATH_RECORDING
+        ret = path_writer_start(&plugin_data->path_writer, plugin_data->family);
+        if (ret) {
+            exit(-1);
+        }
+#endif
+        plugin_data->writer_started = true;
+    }
+    pthread_mutex_unlock(&plugin_data->lock);
+#endif
+
+#ifdef STREAMING_WRITER
+    thread_data->journal = journal_open(&plugin_data->writer);
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+    if (thread_data->journal == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the journal on thread %d!\n",
+                mambo_get_thread_id(ctx));
+        exit(-1);
+    }
+#endif
+#endif
+
+#ifdef PATH_RECORDING
+    thread_data->path = path_open(&plugin_data->path_writer, mambo_get_thread_id(ctx));
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+    if (thread_data->path == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the path buffer on thread %d!\n",
                 mambo_get_thread_id(ctx));
         exit(-1);
     }
+#endif
 #endif
 
-    thread_data->block_id = 0;
+    arena_init(&thread_data->arena);
 
     ret = mambo_set_thread_plugin_data(ctx, (void *) thread_data);
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
@@ -137,6 +711,13 @@ int lift_pre_thread_cb(mambo_context *ctx) {
         exit(-1);
     }
 #endif
+
+#ifdef PERFORMANCE_MONITORING
+    __atomic_fetch_add(&timers.thread_init, get_virtual_counter() - start, __ATOMIC_RELAXED);
+#endif
+#ifdef TELEMETRY
+    telemetry_add_time(&thread_data->telemetry, TELEMETRY_THREAD_INIT, start);
+#endif
 }
 
 /*
@@ -145,6 +726,10 @@ int lift_pre_thread_cb(mambo_context *ctx) {
 int lift_post_thread_cb(mambo_context *ctx) {
     int ret;
 
+#if defined(PERFORMANCE_MONITORING) || defined(TELEMETRY)
+    uint64_t start = get_virtual_counter();
+#endif
+
     lift_thread_data *thread_data = (lift_thread_data *) mambo_get_thread_plugin_data(ctx);
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
     if (thread_data == NULL) {
@@ -154,7 +739,145 @@ int lift_post_thread_cb(mambo_context *ctx) {
     }
 #endif
 
-    // We can get the data pointer without locking, but we need to acquire the lock to make any modifications.
+    // We can get the data pointer without locking, but we need to acquire the lock of the shard to modify it.
+    lift_plugin_data *plugin_data = (lift_plugin_data *) mambo_get_plugin_data(ctx);
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+    if (plugin_data == NULL) {
+        fprintf(stderr, "mclift: Couldn't get the plugin data!\n");
+        exit(-1);
+    }
+#endif
+
+#ifdef PATH_RECORDING
+    // The merge may change the order ids of the nodes, so the ids the path refers to are saved first.
+    path_put_blocks(thread_data->path, thread_data->cfg->nodes, thread_data->cfg->count, &plugin_data->modules);
+    path_close(thread_data->path);
+#endif
+
+    // Group the nodes of the thread by the shard of the global CFG they belong to.
+    uint64_t shard_start[CFG_MERGE_SHARDS + 1] = {0};
+    uint64_t shard_fill[CFG_MERGE_SHARDS];
+
+    cfg_node **nodes = (cfg_node **) mambo_alloc(ctx, sizeof(cfg_node *) * (thread_data->cfg->count + 1));
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+    if (nodes == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the merge buffer on thread %d!\n",
+                mambo_get_thread_id(ctx));
+        exit(-1);
+    }
+#endif
+
+    for (uint64_t index = 0; index < thread_data->cfg->count; index++) {
+        shard_start[cfg_shard_id(thread_data->cfg->nodes[index]->start_addr) + 1]++;
+    }
+
+    uint64_t pending = 0;
+
+    for (int shard = 0; shard < CFG_MERGE_SHARDS; shard++) {
+        shard_start[shard + 1] += shard_start[shard];
+        shard_fill[shard] = shard_start[shard];
+        if (shard_start[shard + 1] != shard_start[shard]) {
+            pending |= 1ULL << shard;
+        }
+    }
+
+    for (uint64_t index = 0; index < thread_data->cfg->count; index++) {
+        cfg_node *node = thread_data->cfg->nodes[index];
+        nodes[shard_fill[cfg_shard_id(node->start_addr)]++] = node;
+    }
+
+#ifdef TELEMETRY
+    // The merge moves the targets into the global CFG, so the thread CFG has to be measured first.
+    telemetry_measure_nodes(&thread_data->telemetry.cfg, thread_data->cfg->nodes, thread_data->cfg->count);
+    telemetry_measure_index(&thread_data->telemetry.cfg, thread_data->cfg);
+    thread_data->telemetry.arena_bytes = thread_data->arena.allocated;
+#endif
+
+    // Merge shards not locked by other threads first and only block once all the remaining shards are busy.
+    while (pending != 0) {
+        bool progress = false;
+
+        for (int shard = 0; shard < CFG_MERGE_SHARDS; shard++) {
+            if ((pending & (1ULL << shard)) == 0) {
+                continue;
+            }
+
+            if (pthread_mutex_trylock(&plugin_data->shards[shard].lock) != 0) {
+#if defined(PERFORMANCE_MONITORING) || defined(TELEMETRY)
+                __atomic_fetch_add(&plugin_data->shards[shard].contended, 1, __ATOMIC_RELAXED);
+#endif
+                continue;
+            }
+
+            merge_shard(ctx, &plugin_data->shards[shard], &nodes[shard_start[shard]],
+                        shard_start[shard + 1] - shard_start[shard]);
+
+            pending &= ~(1ULL << shard);
+            progress = true;
+        }
+
+        if (!progress) {
+            int shard = __builtin_ctzll(pending);
+
+#if defined(PERFORMANCE_MONITORING) || defined(TELEMETRY)
+            uint64_t wait_start = get_virtual_counter();
+#endif
+            ret = pthread_mutex_lock(&plugin_data->shards[shard].lock);
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+            if (ret) {
+                fprintf(stderr, "mclift: Failed to lock the mutex!\n");
+                exit(-1);
+            }
+#endif
+#ifdef PERFORMANCE_MONITORING
+            plugin_data->shards[shard].wait_time += get_virtual_counter() - wait_start;
+#endif
+#ifdef TELEMETRY
+            telemetry_add_time(&thread_data->telemetry, TELEMETRY_MERGE_WAIT, wait_start);
+#endif
+
+            merge_shard(ctx, &plugin_data->shards[shard], &nodes[shard_start[shard]],
+                        shard_start[shard + 1] - shard_start[shard]);
+
+            pending &= ~(1ULL << shard);
+        }
+    }
+
+    mambo_free(ctx, nodes);
+
+#ifdef STREAMING_WRITER
+    journal_close(thread_data->journal);
+#endif
+
+#ifdef TELEMETRY
+    telemetry_thread telemetry = thread_data->telemetry;
+#endif
+
+    cfg_index_destroy(ctx, thread_data->cfg);
+    mambo_free(ctx, thread_data->cfg);
+    mambo_free(ctx, thread_data);
+
+#ifdef PERFORMANCE_MONITORING
+    __atomic_fetch_add(&timers.thread_merge, get_virtual_counter() - start, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&timers.threads, 1, __ATOMIC_RELAXED);
+#endif
+#ifdef TELEMETRY
+    telemetry_add_time(&telemetry, TELEMETRY_MERGE, start);
+
+    pthread_mutex_lock(&plugin_data->lock);
+    telemetry_add_thread(&plugin_data->telemetry, &telemetry);
+    pthread_mutex_unlock(&plugin_data->lock);
+#endif
+}
+
+/*
+    Run the lifter and clean-up any global data.
+*/
+int lift_exit_cb(mambo_context *ctx) {
+#ifdef TELEMETRY
+    uint64_t exit_start = get_virtual_counter();
+#endif
+
     lift_plugin_data *plugin_data = (lift_plugin_data *) mambo_get_plugin_data(ctx);
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
     if (plugin_data == NULL) {
@@ -163,59 +886,225 @@ int lift_post_thread_cb(mambo_context *ctx) {
     }
 #endif
 
-    ret = pthread_mutex_lock(&plugin_data->lock);
-#ifdef ALLOW_CRITICAL_PATH_CHECKS
-    if (ret) {
-        fprintf(stderr, "mclift: Failed to lock the mutex!\n");
-        exit(-1);
-    }
+#ifdef FORK_TRACKING
+    // A child sharing the memory of its parent (vfork) would save and release the CFG of the parent.
+    if (plugin_data->pid != getpid()) {
+        return 0;
+    }
+#endif
+
+#ifdef PERFORMANCE_MONITORING
+    fprintf(stderr, "We're done; Finished after %lfs\n",
+            (double) (get_virtual_counter() - timers.dynamic_execution) / (double) get_virtual_counter_frequency());
+    fprintf(stderr, "mclift: %lu threads; thread data setup took %lfs and merging of thread CFGs %lfs in total\n",
+            timers.threads, (double) timers.thread_init / (double) get_virtual_counter_frequency(),
+            (double) timers.thread_merge / (double) get_virtual_counter_frequency());
+#endif
+
+#ifdef WARM_START
+    // Known blocks are merged after all the threads, so the union of both runs is saved. Known blocks keep their
+    // order ids, which are lower than the ids of the blocks discovered by this run.
+    uint64_t warm_count = 0;
+    bool merge_warm = plugin_data->modules.warm != NULL;
+#ifdef FORK_TRACKING
+    // Forked processes only save their changes, the known blocks are saved by the first process of the family.
+    merge_warm &= cfg_generation == 0;
+#endif
+
+    if (merge_warm) {
+        cfg_node **warm_nodes = (cfg_node **) mambo_alloc(ctx, sizeof(cfg_node *) * (plugin_data->warm.node_count + 1));
+        if (warm_nodes == NULL) {
+            fprintf(stderr, "mclift: Couldn't allocate the warm-start nodes!\n");
+            exit(-1);
+        }
+
+        warm_count = warm_start_build_nodes(ctx, &plugin_data->warm, warm_nodes);
+
+        for (uint64_t index = 0; index < warm_count; index++) {
+            lift_cfg_shard *shard = &plugin_data->shards[cfg_shard_id(warm_nodes[index]->start_addr)];
+
+            pthread_mutex_lock(&shard->lock);
+            merge_shard(ctx, shard, &warm_nodes[index], 1);
+        }
+
+        warm_start_threads(&plugin_data->warm, add_warm_thread, plugin_data);
+
+        mambo_free(ctx, warm_nodes);
+    }
+#endif
+
+    // All threads have exited, so the shards can be read without locking.
+    uint64_t node_count = 0;
+
+    for (int shard = 0; shard < CFG_MERGE_SHARDS; shard++) {
+        node_count += plugin_data->shards[shard].cfg.count;
+    }
+
+    cfg_node **nodes = (cfg_node **) mambo_alloc(ctx, sizeof(cfg_node *) * (node_count + 1));
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+    if (nodes == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the list of nodes!\n");
+        exit(-1);
+    }
+#endif
+
+    node_count = 0;
+
+    for (int shard = 0; shard < CFG_MERGE_SHARDS; shard++) {
+        memcpy(&nodes[node_count], plugin_data->shards[shard].cfg.nodes,
+               sizeof(cfg_node *) * plugin_data->shards[shard].cfg.count);
+        node_count += plugin_data->shards[shard].cfg.count;
+    }
+
+#ifdef MODULE_FILTER
+    mark_native_calls(nodes, node_count);
+#endif
+
+#ifdef FORK_TRACKING
+    node_count = drop_inherited_nodes(plugin_data, nodes, node_count);
 #endif
 
-    // Merge thread data into the global hash map.
-    for (int index = 0; index < thread_data->cfg->size; index++) {
-        if (thread_data->cfg->entries[index].key != 0) {
-            cfg_node *local_node = (cfg_node *) thread_data->cfg->entries[index].value;
-            cfg_node *global_node = NULL;
+#ifdef PERFORMANCE_MONITORING
+    uint64_t merge_contended = 0;
+    uint64_t merge_wait_time = 0;
 
-            ret = mambo_ht_get_nolock(plugin_data->cfg, (uintptr_t) local_node->start_addr, (void *) (&global_node));
-            if (ret) {
-                mambo_ht_add_nolock(plugin_data->cfg, (uintptr_t) local_node->start_addr, (uintptr_t) local_node);
-            }
+    for (int shard = 0; shard < CFG_MERGE_SHARDS; shard++) {
+        merge_contended += plugin_data->shards[shard].contended;
+        merge_wait_time += plugin_data->shards[shard].wait_time;
+    }
+
+    fprintf(stderr, "mclift: Merge of thread CFGs: %lu contended shard locks, %lfs spent waiting for locks\n",
+            merge_contended, (double) merge_wait_time / (double) get_virtual_counter_frequency());
+
+    uint64_t indirect_sites = 0;
+    uint64_t targets_footprint = 0;
+    uint64_t targets_overflow = 0;
+    uint64_t inline_hits = 0;
+    uint64_t inline_misses = 0;
+    uint64_t guarded_sites = 0;
+    uint64_t shadow_hits = 0;
+    uint64_t table_targets = 0;
+    uint64_t probe_total = 0;
+    uint64_t probe_max = 0;
+
+    for (uint64_t index = 0; index < node_count; index++) {
+        cfg_node *node = nodes[index];
+        if (node->targets != NULL) {
+            indirect_sites++;
+            targets_footprint += cfg_targets_footprint(node->targets);
+            targets_overflow += node->targets->overflow;
+            inline_hits += node->targets->hits;
+            inline_misses += node->targets->misses;
+            guarded_sites += node->targets->guards != 0;
+            shadow_hits += node->targets->shadow_hits;
+            table_targets += cfg_targets_probe_lengths(node->targets, &probe_total, &probe_max);
         }
     }
 
-    ret = pthread_mutex_unlock(&plugin_data->lock);
-#ifdef ALLOW_CRITICAL_PATH_CHECKS
-    if (ret) {
-        fprintf(stderr, "mclift: Failed to unlock the mutex!\n");
-        exit(-1);
+    // Compare against the fixed layout that preallocated NUMBER_INDIRECT_TARGETS 32-byte edges per site.
+    fprintf(stderr, "mclift: %lu indirect sites use %lu bytes for targets (%lu bytes with fixed tables), "
+            "%lu target insertions dropped\n", indirect_sites, targets_footprint,
+            indirect_sites * NUMBER_INDIRECT_TARGETS * 32, targets_overflow);
+    fprintf(stderr, "mclift: Inline cache of indirect branches: %lu hits, %lu misses (%.2lf%% hit rate)\n",
+            inline_hits, inline_misses,
+            inline_hits + inline_misses ? 100.0 * inline_hits / (double) (inline_hits + inline_misses) : 0.0);
+    fprintf(stderr, "mclift: Instrumentation of indirect branches: %lu sites, %lu bytes of code cache "
+            "(%.1lf per site)\n", timers.indirect_sites, timers.indirect_site_bytes,
+            timers.indirect_sites ? timers.indirect_site_bytes / (double) timers.indirect_sites : 0.0);
+    fprintf(stderr, "mclift: Tables of indirect targets: %lu targets, %.2lf average and %lu worst probe length\n",
+            table_targets, table_targets ? probe_total / (double) table_targets : 0.0, probe_max);
+#ifdef ADAPTIVE_INSTRUMENTATION
+    // Executions handled by the guards are not counted as hits.
+    fprintf(stderr, "mclift: %lu of %lu indirect sites saturated and guarded in traces\n", guarded_sites,
+            indirect_sites);
+#endif
+#ifdef SHADOW_STACK
+    // Returns matching the shadow stack skip the inline cache, so they are not counted as hits or misses.
+    fprintf(stderr, "mclift: %lu returns matched the shadow stack\n", shadow_hits);
+#endif
+#ifdef WARM_START
+    fprintf(stderr, "mclift: Warm start: %lu of %lu known blocks carried over, %lu indirect sites started with known "
+            "targets (%lu with all of them)\n", warm_count, plugin_data->warm.node_count,
+            plugin_data->warm.seeded_sites, plugin_data->warm.complete_sites);
+#endif
+#endif
+
+#ifdef PATH_RECORDING
+    path_writer *writer = &plugin_data->path_writer;
+    path_writer_stop(writer);
+#ifdef PERFORMANCE_MONITORING
+    fprintf(stderr, "mclift: Path: %lu blocks saved to %s in %lu bytes (%.3lf bytes per block); encoding took %lfs, "
+            "threads drained their own buffers %lu times\n", writer->blocks, writer->path, writer->written,
+            writer->blocks ? writer->written / (double) writer->blocks : 0.0,
+            (double) writer->encode_time / (double) get_virtual_counter_frequency(), writer->stalls);
+#endif
+#endif
+
+#ifdef TELEMETRY
+    telemetry_cfg global_stats;
+    memset(&global_stats, 0, sizeof(global_stats));
+
+    telemetry_measure_nodes(&global_stats, nodes, node_count);
+    for (int shard = 0; shard < CFG_MERGE_SHARDS; shard++) {
+        telemetry_measure_index(&global_stats, &plugin_data->shards[shard].cfg);
     }
+
+    uint64_t write_start = get_virtual_counter();
+    plugin_data->telemetry.exit_time = write_start - exit_start;
 #endif
 
-    mambo_free(ctx, thread_data->cfg);
-    mambo_free(ctx, thread_data);
-}
+    char tracename[128];
 
-/*
-    Run the lifter and clean-up any global data.
-*/
-int lift_exit_cb(mambo_context *ctx) {
-    lift_plugin_data *plugin_data = (lift_plugin_data *) mambo_get_plugin_data(ctx);
-#ifdef ALLOW_CRITICAL_PATH_CHECKS
-    if (plugin_data == NULL) {
-        fprintf(stderr, "mclift: Couldn't get the plugin data!\n");
+#ifdef STREAMING_WRITER
+    // Nodes and targets are already in the file, only the tail of the journals and the thread spawns are left.
+#ifdef PERFORMANCE_MONITORING
+    uint64_t flush_start = get_virtual_counter();
+#endif
+
+    trace_journal *journal = journal_open(&plugin_data->writer);
+    if (journal == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the journal!\n");
         exit(-1);
     }
-#endif
+
+    for (uint64_t idx = 0; idx <= plugin_data->threads.mask; idx++) {
+        if (plugin_data->threads.entries[idx].entry_addr != NULL) {
+            journal_put_thread(journal, plugin_data->threads.entries[idx].entry_addr,
+                               plugin_data->threads.entries[idx].call_site);
+        }
+    }
+
+    journal_close(journal);
+    journal_writer_stop(&plugin_data->writer);
 
 #ifdef PERFORMANCE_MONITORING
-    fprintf(stderr, "We're done; Finished after %lfs\n",
-            (double) (get_virtual_counter() - timers.dynamic_execution) / (double) get_virtual_counter_frequency());
+    fprintf(stderr, "mclift: Streamed %lu bytes to %s; the final flush took %lfs, threads drained their own journals "
+            "%lu times\n", plugin_data->writer.written, plugin_data->writer.path,
+            (double) (get_virtual_counter() - flush_start) / (double) get_virtual_counter_frequency(),
+            plugin_data->writer.stalls);
+#endif
+
+    strcpy(tracename, plugin_data->writer.path);
+#else
+    trace_path(tracename, sizeof(tracename), plugin_data->family, "mtrace");
+    write_trace(ctx, tracename, nodes, node_count, plugin_data->main_addr, &plugin_data->threads,
+                &plugin_data->modules);
 #endif
 
-    write_trace(ctx, plugin_data->cfg, plugin_data->main_addr, plugin_data->threads_entries);
+#ifdef TELEMETRY
+    plugin_data->telemetry.write_time = get_virtual_counter() - write_start;
+    telemetry_write(&plugin_data->telemetry, &global_stats, tracename);
+#endif
 
-    mambo_free(ctx, plugin_data->cfg);
+    for (int shard = 0; shard < CFG_MERGE_SHARDS; shard++) {
+        cfg_index_destroy(ctx, &plugin_data->shards[shard].cfg);
+    }
+    free(plugin_data->threads.entries);
+    module_table_destroy(&plugin_data->modules);
+#ifdef WARM_START
+    warm_start_destroy(&plugin_data->warm);
+#endif
+    mambo_free(ctx, nodes);
     mambo_free(ctx, plugin_data);
 }
 
@@ -227,6 +1116,13 @@ int lift_pre_inst_cb(mambo_context *ctx) {
 
     void *inst_source_address = mambo_get_source_addr(ctx);
 
+#ifdef MODULE_FILTER
+    // Code outside of the traced binary is neither recorded nor instrumented.
+    if (!is_traced_address(inst_source_address)) {
+        return 0;
+    }
+#endif
+
     mambo_branch_type branch_type = mambo_get_branch_type(ctx);
 
     uint32_t inst = *(uint32_t *) inst_source_address;
@@ -247,21 +1143,31 @@ int lift_pre_inst_cb(mambo_context *ctx) {
             exit(-1);
         }
 #endif
+#ifdef TELEMETRY
+        uint64_t scan_start = get_virtual_counter();
+#endif
+
         void *block_source_address = thread_data->current_block_address;
 
-        cfg_node *node;
-        ret = mambo_ht_get_nolock(thread_data->cfg, (uintptr_t) block_source_address, (void *) &node);
+        cfg_node *node = cfg_index_get(thread_data->cfg, (uintptr_t) block_source_address);
 
         bool is_trace = false;
+#ifdef ADAPTIVE_INSTRUMENTATION
+        bool warm_complete = false;
+#endif
+#ifdef WARM_START
+        warm_start *warm = NULL;
+        warm_node *known = NULL;
+#endif
 
-        if (!ret) {
+        if (node != NULL) {
             node->profile = (cfg_node_profile) mambo_get_fragment_type(ctx);
             is_trace = true;
         }
 
         // If node forms part of the trace then don't add it again.
         if(!is_trace) {
-            node = (cfg_node *) mambo_alloc(ctx, sizeof(cfg_node));
+            node = (cfg_node *) arena_alloc(ctx, &thread_data->arena, sizeof(cfg_node));
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
             if (node == NULL) {
                 fprintf(stderr, "mclift: Couldn't allocate the node on thread %d!\n",
@@ -273,13 +1179,29 @@ int lift_pre_inst_cb(mambo_context *ctx) {
 
             node->start_addr = block_source_address;
             node->end_addr = inst_source_address;
-            // TODO: This may be thread unsafe and cause problems with multi-thread applications.
-            node->order_id = thread_data->block_id++;
 
-            ret = mambo_ht_add_nolock(thread_data->cfg, (uintptr_t) block_source_address, (uintptr_t) node);
+            lift_plugin_data *plugin_data = (lift_plugin_data *) mambo_get_plugin_data(ctx);
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+            if (plugin_data == NULL) {
+                fprintf(stderr, "mclift: Couldn't get the plugin data!\n");
+                exit(-1);
+            }
+#endif
+            node->order_id = __atomic_fetch_add(&plugin_data->block_id, 1, __ATOMIC_RELAXED);
+
+            // Register the module of the block while it is still mapped (a no-op for already known modules).
+            trace_module *module = module_table_resolve(&plugin_data->modules, (uintptr_t) block_source_address);
+#ifdef WARM_START
+            warm = &plugin_data->warm;
+            known = warm_start_find(warm, module, (uintptr_t) block_source_address);
+#else
+            (void) module;
+#endif
+
+            ret = cfg_index_add(ctx, thread_data->cfg, (uintptr_t) block_source_address, node);
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
             if (ret) {
-                fprintf(stderr, "mclift: Couldn't add entry to the hash map on thread %d!\n",
+                fprintf(stderr, "mclift: Couldn't add entry to the CFG index on thread %d!\n",
                         mambo_get_thread_id(ctx));
                 exit(-1);
             }
@@ -289,7 +1211,7 @@ int lift_pre_inst_cb(mambo_context *ctx) {
         // TOOD: Avoid using is_trace in the if statements.
         if (!is_trace && inst_type == A64_SVC) {
             // SVC - We can recover SVC code statically, so only count executions
-            cfg_edge *edge = (cfg_edge *) mambo_alloc(ctx, sizeof(cfg_edge));
+            cfg_edge *edge = (cfg_edge *) arena_alloc(ctx, &thread_data->arena, sizeof(cfg_edge));
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
             if (edge == NULL) {
                 fprintf(stderr, "mclift: Couldn't allocate the edge on thread %d!\n",
@@ -309,29 +1231,34 @@ int lift_pre_inst_cb(mambo_context *ctx) {
             node->type = CFG_BASIC_BLOCK;
         } else if (branch_type & BRANCH_INDIRECT) {
             // BR, BLR, RET - Branches are indirect so to recover targets we need to instrument them
-            cfg_edge *edges = NULL;
-
-            if(!is_trace) {
-                // Create a linked list of targets (edges) to store targets of indirect branches.
-                edges = (cfg_edge *) mambo_alloc(ctx, sizeof(cfg_edge) * NUMBER_INDIRECT_TARGETS);
+            // For traces, we just continue appending to the same set. Re-initialising it would cause lose of data.
+            if (node->targets == NULL) {
+                node->targets = (cfg_targets *) arena_alloc(ctx, &thread_data->arena, sizeof(cfg_targets));
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
-                if (edges == NULL) {
-                    fprintf(stderr, "mclift: Couldn't allocate the edge on thread %d!\n",
+                if (node->targets == NULL) {
+                    fprintf(stderr, "mclift: Couldn't allocate the targets on thread %d!\n",
                             mambo_get_thread_id(ctx));
                     exit(-1);
                 }
 #endif
-                for (int idx = 0; idx < NUMBER_INDIRECT_TARGETS - 1; idx++) {
-                    initialize_edge(&edges[idx], CFG_EDGE_NOTYPE);
-                    edges[idx].next = &edges[idx + 1];
+                initialize_targets(node->targets);
+#ifdef STREAMING_WRITER
+                node->targets->journal = thread_data->journal;
+                node->targets->source = block_source_address;
+#endif
+#ifdef WARM_START
+                // Branches known from the warm-start trace don't have to discover their targets again.
+                if (known != NULL) {
+#ifdef ADAPTIVE_INSTRUMENTATION
+                    warm_complete = warm_start_seed(warm, known, node->targets);
+                    if (warm_complete) {
+                        node->targets->quiet = ADAPTIVE_QUIET_THRESHOLD;
+                    }
+#else
+                    warm_start_seed(warm, known, node->targets);
+#endif
                 }
-
-                initialize_edge(&edges[NUMBER_INDIRECT_TARGETS - 1], CFG_EDGE_NOTYPE);
-
-                node->edges = edges;
-            } else {
-                // For traces, we just continue appending to the same list. Re-initialising it would cause lose of data.
-                edges = node->edges;
+#endif
             }
 
             unsigned int rn;
@@ -347,7 +1274,11 @@ int lift_pre_inst_cb(mambo_context *ctx) {
                     break;
                 case A64_RET:
                     a64_RET_decode_fields(inst_source_address, &rn);
+#ifdef SHADOW_STACK
+                    node->type = CFG_RETURN | CFG_SHADOW_RETURN;
+#else
                     node->type = CFG_RETURN;
+#endif
                     break;
                 default:
                     fprintf(stderr, "mclift: Cannot instrument unknown indirect branch type %d\n", inst_type);
@@ -356,20 +1287,104 @@ int lift_pre_inst_cb(mambo_context *ctx) {
 
             node->branch_reg = rn;
 
-            // Instrument code to save the value of the jump target
-            emit_push(ctx, (1 << x0) | (1 << x1) | (1 << x8) | (1 << x9) | (1 << x10) | (1 << lr));
-            emit_mov(ctx, x0, rn);
-            emit_set_reg_ptr(ctx, x1, edges);
-            emit_fcall(ctx, track_branch_target);
-            emit_pop(ctx, (1 << x0) | (1 << x1) | (1 << x8) | (1 << x9) | (1 << x10) | (1 << lr));
+#ifdef PERFORMANCE_MONITORING
+            uintptr_t site_start = (uintptr_t) mambo_get_cc_addr(ctx);
+#endif
+
+#ifdef SHADOW_STACK
+            mambo_branch shadow_hit;
+            if (inst_type == A64_RET) {
+                emit_shadow_stack_check(ctx, &thread_data->shadow_stack, node->targets, rn, &shadow_hit);
+            }
+#endif
+
+#ifdef ADAPTIVE_INSTRUMENTATION
+            // Saturated branches are only guarded once MAMBO re-translates them as part of a trace, branches with all
+            // the targets known from the warm-start trace right away.
+            mambo_branch guard_done;
+            bool guarded = (is_trace || warm_complete) && emit_target_guard(ctx, node->targets, rn, &guard_done);
+#endif
+
+            // Inline cache - compare the jump target with the most recent one and only call the stub of the branch
+            // register when they differ. The check uses EOR and CBNZ, so condition flags are not affected. The targets
+            // are passed to the stub in base (see track_branch_target_stubs) and the link register doubles as the
+            // scratch register unless it holds the target. Both are saved unless proven dead (see dead_registers).
+            enum reg base = (rn == x9) ? x10 : x9;
+            enum reg scratch = (rn == lr) ? x10 : lr;
+            uint32_t dead = dead_registers(inst_type, rn, (uint32_t *) inst_source_address);
+            uint32_t saved = ((1 << base) | (1 << scratch)) & ~dead;
+            uint32_t link = (scratch != lr) ? (1 << lr) & ~dead : 0;
+            mambo_branch miss, done;
+
+            if (saved) {
+                emit_push(ctx, saved);
+            }
+            emit_set_reg_ptr(ctx, base, node->targets);
+            emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 1, CFG_TARGETS_LAST >> 3, base, scratch);
+            emit_a64_logical_reg(ctx, 1, 2, 0, 0, rn, 0, scratch, scratch);
+            mambo_reserve_branch(ctx, &miss);
+#ifdef PERFORMANCE_MONITORING
+            emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 1, CFG_TARGETS_HITS >> 3, base, scratch);
+            emit_a64_ADD_SUB_immed(ctx, 1, 0, 0, 0, 1, scratch, scratch);
+            emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 0, CFG_TARGETS_HITS >> 3, base, scratch);
+#endif
+#ifdef ADAPTIVE_INSTRUMENTATION
+            emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 1, CFG_TARGETS_QUIET >> 3, base, scratch);
+            emit_a64_ADD_SUB_immed(ctx, 1, 0, 0, 0, 1, scratch, scratch);
+            emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 0, CFG_TARGETS_QUIET >> 3, base, scratch);
+#endif
+            if (saved) {
+                emit_pop(ctx, saved);
+            }
+            mambo_reserve_branch(ctx, &done);
+
+            // Miss - save the value of the jump target. The call overwrites the link register, so a target in it is
+            // passed in the scratch register instead.
+            emit_local_branch_cbnz(ctx, &miss, scratch);
+            if (link) {
+                emit_push(ctx, link);
+            }
+            if (rn == lr) {
+                emit_mov(ctx, scratch, lr);
+            }
+            emit_fcall(ctx, track_branch_target_stubs[rn == lr ? scratch : rn]);
+            if (link) {
+                emit_pop(ctx, link);
+            }
+            if (saved) {
+                emit_pop(ctx, saved);
+            }
+
+            emit_local_branch(ctx, &done);
+#ifdef ADAPTIVE_INSTRUMENTATION
+            if (guarded) {
+                emit_local_branch(ctx, &guard_done);
+            }
+#endif
+#ifdef SHADOW_STACK
+            if (inst_type == A64_RET) {
+                emit_local_branch(ctx, &shadow_hit);
+            }
+#endif
+#ifdef PERFORMANCE_MONITORING
+            __atomic_fetch_add(&timers.indirect_sites, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&timers.indirect_site_bytes, (uintptr_t) mambo_get_cc_addr(ctx) - site_start,
+                               __ATOMIC_RELAXED);
+#endif
         } else if (!is_trace && (branch_type & BRANCH_COND)) {
             // B.cond, TBZ, CBZ - We can recover targets of those branches statically, so we only count executions
-            cfg_edge *skipped = (cfg_edge *) mambo_alloc(ctx, sizeof(cfg_edge));
+            cfg_edge *skipped = (cfg_edge *) arena_alloc(ctx, &thread_data->arena, sizeof(cfg_edge));
             initialize_edge(skipped, CFG_SKIPPED_BRANCH);
 
-            cfg_edge *taken = (cfg_edge *) mambo_alloc(ctx, sizeof(cfg_edge));
+            cfg_edge *taken = (cfg_edge *) arena_alloc(ctx, &thread_data->arena, sizeof(cfg_edge));
             initialize_edge(taken, CFG_TAKEN_BRANCH);
 
+#ifdef EXECUTION_COUNTERS
+            // Targets are known statically, but counts are only meaningful in the trace with the targets attached.
+            taken->node = (cfg_node *) get_conditional_branch_target(inst, inst_source_address);
+            skipped->node = (cfg_node *) ((uint32_t *) inst_source_address + 1);
+#endif
+
             taken->next = skipped;
 
             node->edges = taken;
@@ -377,7 +1392,7 @@ int lift_pre_inst_cb(mambo_context *ctx) {
             node->type = CFG_CONDITIONAL_BLOCK;
         } else if (!is_trace && (branch_type & BRANCH_CALL)) {
             // BL - We can recover target of this branch statically, so we only count executions
-            cfg_edge *edge = (cfg_edge *) mambo_alloc(ctx, sizeof(cfg_edge));
+            cfg_edge *edge = (cfg_edge *) arena_alloc(ctx, &thread_data->arena, sizeof(cfg_edge));
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
             if (edge == NULL) {
                 fprintf(stderr, "mclift: Couldn't allocate the edge on thread %d!\n",
@@ -389,25 +1404,15 @@ int lift_pre_inst_cb(mambo_context *ctx) {
 
             node->edges = edge;
 
-#ifdef THREADS_SUPPORT
-            lift_plugin_data *plugin_data = (lift_plugin_data *) mambo_get_plugin_data(ctx);
-#ifdef ALLOW_CRITICAL_PATH_CHECKS
-            if (plugin_data == NULL) {
-                fprintf(stderr, "mclift: Couldn't get the plugin data!\n");
-                exit(-1);
+            node->type = CFG_FUNCTION_CALL;
+#ifdef MODULE_FILTER
+            if (!is_traced_address(get_branch_target(inst, inst_source_address))) {
+                node->type |= CFG_NATIVE_CALL;
             }
 #endif
-            emit_push(ctx, (1 << x0) | (1 << x1));
-            emit_set_reg(ctx, x0, (uintptr_t) inst_source_address);
-            emit_set_reg(ctx, x1, (uintptr_t) &plugin_data->current_call_addr);
-            emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 0, 0, x1, x0);
-            emit_pop(ctx, (1 << x0) | (1 << x1));
-#endif
-
-            node->type = CFG_FUNCTION_CALL;
         } else if (!is_trace && (branch_type & BRANCH_DIRECT)) {
             // B - We can recover target of this branch statically, so we only count executions
-            cfg_edge *edge = (cfg_edge *) mambo_alloc(ctx, sizeof(cfg_edge));
+            cfg_edge *edge = (cfg_edge *) arena_alloc(ctx, &thread_data->arena, sizeof(cfg_edge));
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
             if (edge == NULL) {
                 fprintf(stderr, "mclift: Couldn't allocate the edge on thread %d!\n",
@@ -424,6 +1429,49 @@ int lift_pre_inst_cb(mambo_context *ctx) {
             fprintf(stderr, "mclift: Branch type %d not supported!\n", inst_type);
             exit(-1);
         }
+
+#ifdef STREAMING_WRITER
+        if (!is_trace) {
+            journal_put_node(thread_data->journal, node);
+        }
+#endif
+
+#ifdef THREADS_SUPPORT
+        // Calls are tracked in traces as well, as the trace replaces the instrumented copy of the block.
+        if (branch_type & BRANCH_CALL) {
+            emit_push(ctx, (1 << x0) | (1 << x1));
+            emit_set_reg(ctx, x0, (uintptr_t) inst_source_address);
+            emit_set_reg(ctx, x1, (uintptr_t) &thread_data->current_call_addr);
+            emit_a64_LDR_STR_unsigned_immed(ctx, 3, 0, 0, 0, x1, x0);
+            emit_pop(ctx, (1 << x0) | (1 << x1));
+        }
+#endif
+
+#ifdef SHADOW_STACK
+        // Calls are pushed in traces as well, as the trace replaces the instrumented copy of the block.
+        if (branch_type & BRANCH_CALL) {
+            emit_shadow_stack_push(ctx, &thread_data->shadow_stack, (uint32_t *) inst_source_address + 1);
+        }
+#endif
+
+#ifdef EXECUTION_COUNTERS
+        emit_exec_count_update(ctx, &node->exec_count);
+
+        if ((branch_type & BRANCH_COND) && node->type == CFG_CONDITIONAL_BLOCK && node->edges != NULL) {
+            emit_direction_counters(ctx, inst, node->edges, node->edges->next);
+        }
+#endif
+
+#ifdef PATH_RECORDING
+        // Recorded in traces as well, as the trace replaces the instrumented copy of the block.
+        emit_path_record(ctx, thread_data->path, node->order_id);
+#endif
+
+#ifdef TELEMETRY
+        thread_data->telemetry.branches++;
+        thread_data->telemetry.rescans += is_trace;
+        telemetry_add_time(&thread_data->telemetry, TELEMETRY_SCAN, scan_start);
+#endif
     }
 }
 
@@ -446,25 +1494,67 @@ int lift_pre_basic_block_cb(mambo_context *ctx) {
     thread_data->current_block_address = source_address;
 }
 
+static inline uint64_t thread_hash(void* entry_addr, void* call_site, uint64_t mask) {
+    uint64_t hash = (((uintptr_t) entry_addr >> 2) ^ ((uintptr_t) call_site << 7)) * 0x9e3779b97f4a7c15ULL;
+    return (hash ^ (hash >> 32)) & mask;
+}
+
+static void insert_thread(lift_thread_metadata* entries, uint64_t mask, void* entry_addr, void* call_site) {
+    uint64_t idx = thread_hash(entry_addr, call_site, mask);
+
+    while (entries[idx].entry_addr != NULL) {
+        idx = (idx + 1) & mask;
+    }
+
+    entries[idx].entry_addr = entry_addr;
+    entries[idx].call_site = call_site;
+}
+
 /*
     Instrumentation of the thread creation function capturing the thread creating call site and the address of the thread
-    start routine.
+    start routine. Runs on the application thread, so the registry is grown with calloc.
  */
-void track_pthread_entry(lift_thread_metadata threads[NUMBER_THREAD_ENTRIES], void** call_site_ptr, void* entry_addr) {
+void track_pthread_entry(lift_plugin_data* plugin_data, void** call_site_ptr, void* entry_addr) {
     void* call_site = *call_site_ptr;
-    for(int idx = 0; idx < NUMBER_THREAD_ENTRIES; idx++) {
-        if(threads[idx].entry_addr == entry_addr && threads[idx].call_site == call_site) {
+    lift_thread_registry* threads = &plugin_data->threads;
+
+    pthread_mutex_lock(&plugin_data->lock);
+
+    uint64_t idx = thread_hash(entry_addr, call_site, threads->mask);
+
+    while (threads->entries[idx].entry_addr != NULL) {
+        if (threads->entries[idx].entry_addr == entry_addr && threads->entries[idx].call_site == call_site) {
+            pthread_mutex_unlock(&plugin_data->lock);
             return;
         }
-        if(threads[idx].entry_addr == 0) {
-            threads[idx].entry_addr = entry_addr;
-            threads[idx].call_site = call_site;
-            return;
+        idx = (idx + 1) & threads->mask;
+    }
+
+    if (2 * (threads->count + 1) > threads->mask + 1) {
+        uint64_t capacity = 2 * (threads->mask + 1);
+
+        lift_thread_metadata* entries = (lift_thread_metadata *) calloc(capacity, sizeof(lift_thread_metadata));
+        if (entries == NULL) {
+            fprintf(stderr, "mclift: Couldn't grow the registry of threads!\n");
+            exit(-1);
+        }
+
+        for (uint64_t old_idx = 0; old_idx <= threads->mask; old_idx++) {
+            if (threads->entries[old_idx].entry_addr != NULL) {
+                insert_thread(entries, capacity - 1, threads->entries[old_idx].entry_addr,
+                              threads->entries[old_idx].call_site);
+            }
         }
+
+        free(threads->entries);
+        threads->entries = entries;
+        threads->mask = capacity - 1;
     }
 
-    fprintf(stderr, "mclift: Exceeded maximum number of NUMBER_THREAD_ENTRIES!\n");
-    exit(-1);
+    insert_thread(threads->entries, threads->mask, entry_addr, call_site);
+    threads->count++;
+
+    pthread_mutex_unlock(&plugin_data->lock);
 }
 
 /*
@@ -479,9 +1569,19 @@ int lift_pre_pthread_create_cb(mambo_context *ctx) {
     }
 #endif
 
+    // Code caches are thread private, so the call site of the spawning thread can be embedded into the instrumentation.
+    lift_thread_data *thread_data = (lift_thread_data *) mambo_get_thread_plugin_data(ctx);
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+    if (thread_data == NULL) {
+        fprintf(stderr, "mclift: Couldn't get the thread data on thread %d!\n",
+                mambo_get_thread_id(ctx));
+        exit(-1);
+    }
+#endif
+
     emit_push(ctx, (1 << x0) | (1 << x1) | (1 << x2) | (1 << x3));
-    emit_set_reg_ptr(ctx, x0, plugin_data->threads_entries);
-    emit_set_reg(ctx, x1, (uintptr_t) &plugin_data->current_call_addr);
+    emit_set_reg_ptr(ctx, x0, plugin_data);
+    emit_set_reg(ctx, x1, (uintptr_t) &thread_data->current_call_addr);
     // Correct address already in x2
     emit_safe_fcall(ctx, track_pthread_entry, 3);
     emit_pop(ctx, (1 << x0) | (1 << x1) | (1 << x2) | (1 << x3));
@@ -499,10 +1599,19 @@ int lift_pre_gomp_parallel_cb(mambo_context *ctx) {
     }
 #endif
 
+    lift_thread_data *thread_data = (lift_thread_data *) mambo_get_thread_plugin_data(ctx);
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+    if (thread_data == NULL) {
+        fprintf(stderr, "mclift: Couldn't get the thread data on thread %d!\n",
+                mambo_get_thread_id(ctx));
+        exit(-1);
+    }
+#endif
+
     emit_push(ctx, (1 << x0) | (1 << x1) | (1 << x2) | (1 << x3));
     emit_mov(ctx, x2, x0);
-    emit_set_reg_ptr(ctx, x0, plugin_data->threads_entries);
-    emit_set_reg(ctx, x1, (uintptr_t) &plugin_data->current_call_addr);
+    emit_set_reg_ptr(ctx, x0, plugin_data);
+    emit_set_reg(ctx, x1, (uintptr_t) &thread_data->current_call_addr);
     emit_safe_fcall(ctx, track_pthread_entry, 3);
     emit_pop(ctx, (1 << x0) | (1 << x1) | (1 << x2) | (1 << x3));
 }
@@ -528,6 +1637,104 @@ int lift_pre_libc_start_main(mambo_context *ctx) {
     emit_pop(ctx, (1 << x0) | (1 << x1));
 }
 
+#ifdef FORK_TRACKING
+/*
+    Record the flags of clone, which are overwritten by the return value before lift_post_syscall_cb, and save the
+    trace before execve.
+*/
+int lift_pre_syscall_cb(mambo_context *ctx) {
+    uintptr_t number;
+    uintptr_t *args;
+
+    mambo_syscall_get_no(ctx, &number);
+    mambo_syscall_get_args(ctx, &args);
+
+    lift_plugin_data *plugin_data = (lift_plugin_data *) mambo_get_plugin_data(ctx);
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+    if (plugin_data == NULL) {
+        fprintf(stderr, "mclift: Couldn't get the plugin data!\n");
+        exit(-1);
+    }
+#endif
+
+    lift_thread_data *thread_data = (lift_thread_data *) mambo_get_thread_plugin_data(ctx);
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+    if (thread_data == NULL) {
+        fprintf(stderr, "mclift: Couldn't get the thread data on thread %d!\n",
+                mambo_get_thread_id(ctx));
+        exit(-1);
+    }
+#endif
+
+    switch (number) {
+        case __NR_clone:
+            thread_data->clone_flags = args[0];
+            break;
+#ifdef __NR_clone3
+        case __NR_clone3:
+            // Flags are the first field of struct clone_args.
+            thread_data->clone_flags = *(uint64_t *) args[0];
+            break;
+#endif
+        case __NR_execve:
+            // execvp tries every directory of PATH, so only save the trace if the image is likely to be replaced.
+            if (access((const char *) args[0], X_OK) != 0) {
+                break;
+            }
+            // Fall through
+        case __NR_execveat:
+            // A child sharing the memory of its parent (vfork, posix_spawn) would save the CFG of the parent.
+            if (plugin_data->pid == getpid()) {
+                save_before_exec(ctx, plugin_data, thread_data);
+            }
+            break;
+    }
+
+    return 0;
+}
+
+/*
+    Detect the child of fork (clone without CLONE_VM returning 0) and remove the trace saved before execve if it failed.
+*/
+int lift_post_syscall_cb(mambo_context *ctx) {
+    uintptr_t number;
+    uintptr_t result;
+
+    mambo_syscall_get_no(ctx, &number);
+    mambo_syscall_get_return(ctx, &result);
+
+    bool is_clone = number == __NR_clone;
+#ifdef __NR_clone3
+    is_clone |= number == __NR_clone3;
+#endif
+
+    if (!is_clone && number != __NR_execve && number != __NR_execveat) {
+        return 0;
+    }
+
+    lift_thread_data *thread_data = (lift_thread_data *) mambo_get_thread_plugin_data(ctx);
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+    if (thread_data == NULL) {
+        fprintf(stderr, "mclift: Couldn't get the thread data on thread %d!\n",
+                mambo_get_thread_id(ctx));
+        exit(-1);
+    }
+#endif
+
+    if (!is_clone) {
+        // execve only returns on failure, the trace saved at exit will contain the same blocks and counts.
+        if (thread_data->exec_trace[0] != '\0') {
+            unlink(thread_data->exec_trace);
+            thread_data->exec_trace[0] = '\0';
+        }
+    } else if (result == 0 && (thread_data->clone_flags & CLONE_VM) == 0) {
+        continue_forked_process(ctx, (lift_plugin_data *) mambo_get_plugin_data(ctx), thread_data);
+    }
+
+    return 0;
+}
+#endif
+
 /*
     Allocate global plugin data and register the plugin and its callbacks in MAMBO.
 */
@@ -539,6 +1746,11 @@ void init_lift() {
 
 #ifdef PERFORMANCE_MONITORING
     timers.dynamic_execution = get_virtual_counter();
+    timers.thread_init = 0;
+    timers.thread_merge = 0;
+    timers.threads = 0;
+    timers.indirect_sites = 0;
+    timers.indirect_site_bytes = 0;
 #endif
 
     int ret;
@@ -551,22 +1763,27 @@ void init_lift() {
     }
 #endif
 
-    plugin_data->cfg = (mambo_ht_t *) mambo_alloc(ctx, sizeof(mambo_ht_t));
+    for (int shard = 0; shard < CFG_MERGE_SHARDS; shard++) {
+        ret = cfg_index_init(ctx, &plugin_data->shards[shard].cfg, CFG_INDEX_INITIAL_CAPACITY);
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
-    if (plugin_data->cfg == NULL) {
-        fprintf(stderr, "mclift: Couldn't allocate the hash map!\n");
-        exit(-1);
-    }
+        if (ret) {
+            fprintf(stderr, "mclift: Couldn't initialize the CFG index!\n");
+            exit(-1);
+        }
 #endif
 
-    ret = mambo_ht_init(plugin_data->cfg, 1 << 20, 0, 80, false);
+        ret = pthread_mutex_init(&plugin_data->shards[shard].lock, NULL);
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
-    if (ret) {
-        fprintf(stderr, "mclift: Couldn't initialize the hash map!\n");
-        exit(-1);
-    }
+        if (ret) {
+            fprintf(stderr, "mclift: Couldn't initialize the pthread lock!\n");
+            exit(-1);
+        }
 #endif
 
+        plugin_data->shards[shard].contended = 0;
+        plugin_data->shards[shard].wait_time = 0;
+    }
+
     ret = pthread_mutex_init(&plugin_data->lock, NULL);
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
     if (ret) {
@@ -575,10 +1792,44 @@ void init_lift() {
     }
 #endif
 
-    for(int idx = 0; idx < NUMBER_THREAD_ENTRIES; idx++) {
-        plugin_data->threads_entries[idx].entry_addr = NULL;
-        plugin_data->threads_entries[idx].call_site = NULL;
+    plugin_data->threads.entries = (lift_thread_metadata *) calloc(THREAD_REGISTRY_INITIAL_CAPACITY,
+                                                                   sizeof(lift_thread_metadata));
+#ifdef ALLOW_CRITICAL_PATH_CHECKS
+    if (plugin_data->threads.entries == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the registry of threads!\n");
+        exit(-1);
+    }
+#endif
+    plugin_data->threads.mask = THREAD_REGISTRY_INITIAL_CAPACITY - 1;
+    plugin_data->threads.count = 0;
+
+    module_table_init(&plugin_data->modules);
+
+    trace_family(plugin_data->family, sizeof(plugin_data->family));
+#ifdef FORK_TRACKING
+    plugin_data->pid = getpid();
+    plugin_data->fork_order_id = 0;
+#endif
+
+    plugin_data->block_id = 0;
+    plugin_data->writer_started = false;
+
+#ifdef WARM_START
+    ret = warm_start_load(&plugin_data->warm, WARM_START_TRACE);
+    if (ret == 0) {
+        plugin_data->modules.warm = &plugin_data->warm;
+        plugin_data->block_id = plugin_data->warm.next_order_id;
+    } else if (errno == ENOENT) {
+        fprintf(stderr, "mclift: No warm-start trace %s, starting cold\n", WARM_START_TRACE);
+    } else {
+        fprintf(stderr, "mclift: Couldn't load the warm-start trace %s: %s!\n", WARM_START_TRACE, strerror(errno));
+        exit(-1);
     }
+#endif
+
+#ifdef TELEMETRY
+    telemetry_init(&plugin_data->telemetry);
+#endif
 
     ret = mambo_set_plugin_data(ctx, (void *) plugin_data);
 #ifdef ALLOW_CRITICAL_PATH_CHECKS
@@ -597,6 +1848,11 @@ void init_lift() {
 
     mambo_register_exit_cb(ctx, &lift_exit_cb);
 
+#ifdef FORK_TRACKING
+    mambo_register_pre_syscall_cb(ctx, &lift_pre_syscall_cb);
+    mambo_register_post_syscall_cb(ctx, &lift_post_syscall_cb);
+#endif
+
 #if defined(RECOVER_MAIN_ADDR_GLIBC)
     mambo_register_function_cb(ctx, "__libc_start_main", lift_pre_libc_start_main, NULL, 7);
 #elif defined(LOAD_MAIN_ADDR)
@@ -19,39 +19,87 @@
 
 #include <pthread.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #include "../../plugins.h"
 
+#include "arena.h"
+#include "cfg_index.h"
+#include "config.h"
+#include "journal.h"
+#include "modules.h"
+#include "path.h"
+#include "telemetry.h"
+#include "warm_start.h"
+
 // CONSTANTS
 
 /*
-    Maximum number of unique threads spawns that can be traced. A thread spawn is not
-    unique if it differs in an entry_addr or a call_site from other thread spawns.
+    Initial number of slots of the registry of thread spawns. The registry grows on demand. A thread spawn is not
+    unique if it differs in an entry_addr or a call_site from other thread spawns. Has to be a power of two.
 */
-#define NUMBER_THREAD_ENTRIES 32 
+#define THREAD_REGISTRY_INITIAL_CAPACITY 32
 
 // TYPEDEFS
 
 struct lift_thread_data;
 typedef struct lift_thread_data lift_thread_data;
 
+struct lift_shadow_stack;
+typedef struct lift_shadow_stack lift_shadow_stack;
+
 struct lift_thread_metadata;
 typedef struct lift_thread_metadata lift_thread_metadata;
 
+struct lift_thread_registry;
+typedef struct lift_thread_registry lift_thread_registry;
+
+struct lift_cfg_shard;
+typedef struct lift_cfg_shard lift_cfg_shard;
+
 struct lift_plugin_data;
 typedef struct lift_plugin_data lift_plugin_data;
 
 // STRUCTS
 
+#ifdef SHADOW_STACK
+/*
+    Return addresses of the calls executed by the thread. NOTE: The layout is used by the instrumentation emitted in
+    lift_pre_inst_cb.
+*/
+struct lift_shadow_stack {
+    uint64_t top; // Index of the most recent entry.
+    uintptr_t entries[SHADOW_STACK_SIZE]; // Ring buffer of the return addresses.
+};
+#endif
+
 /*
     Data stored in the thread private memory.
 */
 struct lift_thread_data {
-    mambo_ht_t* cfg; // The control flow graph (CFG) in the form of a look-up table with all the nodes in the CFG.
-                     // We use the hashmap to keep track of all the nodes while the application is running. We only
-                     // connect nodes with each other after the instrumented application finishes execution.
+    cfg_index* cfg; // The control flow graph (CFG) in the form of a look-up table with all the nodes in the CFG.
+                    // We use the index to keep track of all the nodes while the application is running. We only
+                    // connect nodes with each other after the instrumented application finishes execution.
     void* current_block_address; // Address of the last encountered basic block.
-    uint64_t block_id; // Counter that tracks the order of the execution of basic blocks.
+    void* current_call_addr; // Address of the most recent function call (branch-link) executed by the thread. This is
+                             // later used to relate new threads to the location where they were spawned.
+    trace_journal* journal; // Log of the CFG changes made by the thread (only with STREAMING_WRITER).
+    cfg_arena arena; // Allocator of the nodes and edges of the thread CFG. The memory is not released when the thread
+                     // exits, as the nodes are merged into the global CFG.
+#ifdef TELEMETRY
+    telemetry_thread telemetry; // Measurements of the thread.
+#endif
+#ifdef SHADOW_STACK
+    lift_shadow_stack shadow_stack; // Return addresses of the calls executed by the thread.
+#endif
+#ifdef PATH_RECORDING
+    path_buffer* path; // Blocks executed by the thread.
+#endif
+#ifdef FORK_TRACKING
+    uint64_t clone_flags; // Flags of the clone system call in progress, as its arguments are overwritten by the return
+                          // value before the post system call callback.
+    char exec_trace[128]; // Trace saved before execve, removed if execve fails (empty if none).
+#endif
 };
 
 /*
@@ -62,6 +110,26 @@ struct lift_thread_metadata {
     void* call_site; // Address of the function call (branch-link) to the function starting the new thread.
 };
 
+/*
+    Set of unique thread spawns in the form of an open-addressed table that doubles when half full.
+*/
+struct lift_thread_registry {
+    lift_thread_metadata* entries; // Table of thread spawns (entry_addr == NULL marks an empty slot).
+    uint64_t mask; // Number of slots minus one.
+    uint64_t count; // Number of thread spawns in the table.
+};
+
+/*
+    Part of the global CFG with its own lock. Blocks are assigned to shards by their start address, so threads merging
+    different blocks don't have to wait for each other.
+*/
+struct lift_cfg_shard {
+    pthread_mutex_t lock; // Lock that needs to be acquired to modify the shard.
+    cfg_index cfg; // Nodes of the global CFG that belong to the shard.
+    uint64_t contended; // Number of times a merging thread found the shard locked (only with PERFORMANCE_MONITORING).
+    uint64_t wait_time; // Time spent waiting for the lock of the shard (only with PERFORMANCE_MONITORING).
+};
+
 /*
     Data stored in the global memory.
 */
@@ -69,12 +137,34 @@ struct lift_plugin_data {
     void* main_addr; // Address of the main function recovered from __libc_start_main. NOTE: Has to be the first field
                      // for the instrumentation to work correctly.
 
-    mambo_ht_t* cfg; // Global CFG - for more information see lift_thread_data.
+    lift_cfg_shard shards[CFG_MERGE_SHARDS]; // Global CFG - for more information see lift_thread_data.
+
+    pthread_mutex_t lock; // Lock that needs to be acquired to modify the global data (except of the CFG).
+
+    uint64_t block_id; // Counter that tracks the order of the first execution of basic blocks across all threads, so
+                       // order ids of nodes discovered by different threads can be compared after the merge.
+
+    lift_thread_registry threads; // Threads spawned by the application.
 
-    pthread_mutex_t lock; // Lock that needs to be acquired to modify the global data.
+    module_table modules; // Modules the traced code was found in, addresses in the trace are relative to them.
 
-    lift_thread_metadata threads_entries[NUMBER_THREAD_ENTRIES]; // Data related to spawned threads.
+    char family[32]; // Family of the process the trace belongs to (see trace_family), inherited by forked processes.
+#ifdef FORK_TRACKING
+    pid_t pid; // Process owning the data. A child sharing the memory of its parent (vfork) must not save the trace.
+    uint64_t fork_order_id; // Value of block_id when the process was forked, lower order ids were inherited.
+#endif
 
-    void* current_call_addr; // Keep track of the most recent address of a function call (branch-link). This is later
-                             // used to relate new threads to the location where they were spawned.
+    journal_writer writer; // Background writer of the trace (only with STREAMING_WRITER).
+    bool writer_started; // Whether the writers (of STREAMING_WRITER and PATH_RECORDING) were started. The writers are
+                         // started with the first thread, as the base address of the binary is not known when the
+                         // plugin is initialized.
+#ifdef PATH_RECORDING
+    path_writer path_writer; // Background writer of the paths of the threads.
+#endif
+#ifdef TELEMETRY
+    telemetry telemetry; // Measurements of the exited threads.
+#endif
+#ifdef WARM_START
+    warm_start warm; // CFG of the previous run (modules.warm is NULL if it wasn't loaded).
+#endif
 };
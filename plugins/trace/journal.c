@@ -0,0 +1,366 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Streaming writer of the trace (see STREAMING_WRITER). Records are appended by the instrumented threads, including
+    from cfg_targets_insert_slow, which doesn't have the MAMBO context, so all the memory is allocated with malloc.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "journal.h"
+#include "mtrace_format.h"
+#include "writer.h"
+
+// CONSTANTS
+
+/*
+    Maximum number of edges saved with the node. Only edges with statically known targets are saved and a block has
+    at most two of them (taken and skipped).
+*/
+#define JOURNAL_MAX_NODE_EDGES 2
+
+/*
+    Upper bound of the size of a single record.
+*/
+#define JOURNAL_MAX_RECORD_SIZE ((7 + 2 * JOURNAL_MAX_NODE_EDGES) * MTRACE_MAX_VARINT_SIZE)
+
+// FUNCTIONS
+
+static inline uint64_t encode_addr(trace_journal* journal, void* addr) {
+    return module_table_encode(journal->writer->modules, (uintptr_t) addr);
+}
+
+/*
+    Encode the address against the modules already in the table. Used with the lock of the writer held, as adding a
+    module would log it to the journal.
+*/
+static uint64_t encode_known_addr(journal_writer* writer, void* addr) {
+    trace_module* module = module_table_lookup(writer->modules, (uintptr_t) addr);
+
+    if (module == NULL) {
+        return mtrace_module_addr(MTRACE_MODULE_UNKNOWN, (uintptr_t) addr);
+    }
+
+    return mtrace_module_addr(module->id, (uintptr_t) addr - module->base);
+}
+
+static journal_block* allocate_block() {
+    journal_block* block = (journal_block *) malloc(sizeof(journal_block));
+    if (block == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the journal block!\n");
+        exit(-1);
+    }
+
+    block->next = NULL;
+    block->committed = 0;
+    block->used = 0;
+
+    return block;
+}
+
+/*
+    Write all the complete records of the journal to the file. The caller has to hold the lock of the writer.
+*/
+static void drain(journal_writer* writer, trace_journal* journal) {
+    while (true) {
+        journal_block* block = journal->head;
+
+        // Once the next block is published the producer doesn't touch this block, so the committed size is final.
+        journal_block* next = __atomic_load_n(&block->next, __ATOMIC_ACQUIRE);
+        uint64_t committed = __atomic_load_n(&block->committed, __ATOMIC_ACQUIRE);
+
+        if (committed > journal->drained) {
+            write_all(writer->fd, block->data + journal->drained, committed - journal->drained);
+            writer->written += committed - journal->drained;
+            journal->drained = committed;
+        }
+
+        if (next == NULL) {
+            break;
+        }
+
+        journal->head = next;
+        journal->drained = 0;
+        free(block);
+        __atomic_fetch_sub(&journal->blocks, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+    Drain all the journals and release the journals of the exited threads. The caller has to hold the lock.
+*/
+static void drain_all(journal_writer* writer) {
+    if (!writer->main_written) {
+        void* main_addr = __atomic_load_n(writer->main_addr, __ATOMIC_RELAXED);
+
+        if (main_addr != NULL) {
+            uint8_t record[2 * MTRACE_MAX_VARINT_SIZE];
+            size_t size = mtrace_put_varint(record, MTRACE_RECORD_MAIN);
+            size += mtrace_put_varint(record + size, encode_known_addr(writer, main_addr));
+
+            write_all(writer->fd, record, size);
+            writer->written += size;
+            writer->main_written = true;
+        }
+    }
+
+    trace_journal** journal = &writer->journals;
+
+    while (*journal != NULL) {
+        bool closed = __atomic_load_n(&(*journal)->closed, __ATOMIC_ACQUIRE);
+
+        drain(writer, *journal);
+
+        if (closed) {
+            trace_journal* released = *journal;
+            *journal = released->next;
+            free(released->head);
+            free(released);
+        } else {
+            journal = &(*journal)->next;
+        }
+    }
+}
+
+static void* writer_thread(void* arg) {
+    journal_writer* writer = (journal_writer *) arg;
+
+    pthread_mutex_lock(&writer->lock);
+
+    while (!writer->stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+
+        deadline.tv_nsec += (JOURNAL_FLUSH_INTERVAL_MS % 1000) * 1000000L;
+        deadline.tv_sec += JOURNAL_FLUSH_INTERVAL_MS / 1000 + deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+
+        pthread_cond_timedwait(&writer->wakeup, &writer->lock, &deadline);
+
+        drain_all(writer);
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+
+    return NULL;
+}
+
+int journal_writer_start(journal_writer* writer, void** main_addr, module_table* modules, const char* family) {
+    trace_path(writer->path, sizeof(writer->path), family, "mtrace");
+
+    writer->fd = open(writer->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        fprintf(stderr, "mclift: Couldn't open %s: %s!\n", writer->path, strerror(errno));
+        return -1;
+    }
+
+    mtrace_header header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic = MTRACE_MAGIC;
+    header.version = MTRACE_VERSION;
+    header.flags = MTRACE_FLAG_JOURNAL | MTRACE_FLAG_MODULES;
+    header.base_addr = global_data.base_addr;
+
+    write_all(writer->fd, (const uint8_t *) &header, sizeof(header));
+
+    writer->stop = false;
+    writer->journals = NULL;
+    writer->main_addr = main_addr;
+    writer->modules = modules;
+    writer->main_written = false;
+    writer->written = sizeof(header);
+    writer->stalls = 0;
+
+    if (pthread_mutex_init(&writer->lock, NULL) || pthread_cond_init(&writer->wakeup, NULL)
+        || pthread_create(&writer->thread, NULL, writer_thread, writer)) {
+        fprintf(stderr, "mclift: Couldn't start the trace writer thread!\n");
+        return -1;
+    }
+
+    // Modules added before the writer started are logged now, later ones as soon as they are added.
+    pthread_mutex_lock(&modules->lock);
+    for (uint64_t id = 0; id < modules->count; id++) {
+        journal_put_module(writer, modules->modules[id]);
+    }
+    modules->journal = writer;
+    pthread_mutex_unlock(&modules->lock);
+
+    return 0;
+}
+
+void journal_writer_stop(journal_writer* writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->stop = true;
+    pthread_cond_signal(&writer->wakeup);
+    pthread_mutex_unlock(&writer->lock);
+
+    pthread_join(writer->thread, NULL);
+
+    // Threads still running at this point are about to be killed, so their journals are only drained.
+    pthread_mutex_lock(&writer->lock);
+    drain_all(writer);
+    pthread_mutex_unlock(&writer->lock);
+
+    close(writer->fd);
+}
+
+trace_journal* journal_open(journal_writer* writer) {
+    trace_journal* journal = (trace_journal *) malloc(sizeof(trace_journal));
+    if (journal == NULL) {
+        return NULL;
+    }
+
+    journal->writer = writer;
+    journal->tail = allocate_block();
+    journal->head = journal->tail;
+    journal->drained = 0;
+    journal->blocks = 1;
+    journal->closed = false;
+
+    pthread_mutex_lock(&writer->lock);
+    journal->next = writer->journals;
+    writer->journals = journal;
+    pthread_mutex_unlock(&writer->lock);
+
+    return journal;
+}
+
+void journal_close(trace_journal* journal) {
+    __atomic_store_n(&journal->closed, true, __ATOMIC_RELEASE);
+}
+
+static void append(trace_journal* journal, const uint8_t* record, size_t size) {
+    journal_block* block = journal->tail;
+
+    if (block->used + size > JOURNAL_BLOCK_SIZE) {
+        journal_block* next = allocate_block();
+
+        __atomic_fetch_add(&journal->blocks, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&block->next, next, __ATOMIC_RELEASE);
+        journal->tail = next;
+        block = next;
+
+        // The writer fell behind - drain the journal on this thread, so the memory used by the log stays bounded.
+        if (__atomic_load_n(&journal->blocks, __ATOMIC_ACQUIRE) > JOURNAL_MAX_BLOCKS) {
+            journal_writer* writer = journal->writer;
+
+            pthread_mutex_lock(&writer->lock);
+            drain(writer, journal);
+            writer->stalls++;
+            pthread_mutex_unlock(&writer->lock);
+        }
+    }
+
+    memcpy(block->data + block->used, record, size);
+    block->used += size;
+    __atomic_store_n(&block->committed, block->used, __ATOMIC_RELEASE);
+}
+
+void journal_put_node(trace_journal* journal, cfg_node* node) {
+    uint8_t record[JOURNAL_MAX_RECORD_SIZE];
+    uint64_t targets[JOURNAL_MAX_NODE_EDGES];
+    cfg_edge_type types[JOURNAL_MAX_NODE_EDGES];
+    size_t edge_count = 0;
+
+    // Edges are sorted by their targets, as in the version 2 nodes.
+    for (cfg_edge* edge = node->edges; edge != NULL && edge_count < JOURNAL_MAX_NODE_EDGES; edge = edge->next) {
+        if (edge->node != NULL) {
+            size_t idx = edge_count++;
+            uint64_t target = encode_addr(journal, edge->node);
+
+            while (idx > 0 && targets[idx - 1] > target) {
+                targets[idx] = targets[idx - 1];
+                types[idx] = types[idx - 1];
+                idx--;
+            }
+
+            targets[idx] = target;
+            types[idx] = edge->type;
+        }
+    }
+
+    uint64_t start_addr = encode_addr(journal, node->start_addr);
+
+    size_t size = mtrace_put_varint(record, MTRACE_RECORD_NODE);
+    size += mtrace_put_varint(record + size, start_addr);
+    size += mtrace_put_varint(record + size, (uintptr_t) node->end_addr - (uintptr_t) node->start_addr);
+    size += mtrace_put_varint(record + size, node->type);
+    size += mtrace_put_varint(record + size, (uint32_t) (node->branch_reg + 1));
+    size += mtrace_put_varint(record + size, node->order_id);
+    size += mtrace_put_varint(record + size, edge_count);
+
+    for (size_t idx = 0; idx < edge_count; idx++) {
+        if (idx == 0) {
+            size += mtrace_put_varint(record + size, mtrace_zigzag_encode((int64_t) (targets[idx] - start_addr)));
+        } else {
+            size += mtrace_put_varint(record + size, targets[idx] - targets[idx - 1]);
+        }
+        size += mtrace_put_varint(record + size, types[idx]);
+    }
+
+    append(journal, record, size);
+}
+
+void journal_put_target(trace_journal* journal, void* source, uintptr_t target) {
+    uint8_t record[3 * MTRACE_MAX_VARINT_SIZE];
+
+    // The target may be in a module not seen before, which has to be logged before the record.
+    uint64_t encoded_target = encode_addr(journal, (void *) target);
+
+    size_t size = mtrace_put_varint(record, MTRACE_RECORD_TARGET);
+    size += mtrace_put_varint(record + size, encode_addr(journal, source));
+    size += mtrace_put_varint(record + size, encoded_target);
+
+    append(journal, record, size);
+}
+
+void journal_put_thread(trace_journal* journal, void* entry_addr, void* call_site) {
+    uint8_t record[3 * MTRACE_MAX_VARINT_SIZE];
+
+    size_t size = mtrace_put_varint(record, MTRACE_RECORD_THREAD);
+    size += mtrace_put_varint(record + size, encode_addr(journal, entry_addr));
+    size += mtrace_put_varint(record + size, encode_addr(journal, call_site));
+
+    append(journal, record, size);
+}
+
+void journal_put_module(journal_writer* writer, trace_module* module) {
+    uint8_t* record = (uint8_t *) malloc(2 * MTRACE_MAX_VARINT_SIZE + MODULE_MAX_ENCODED_SIZE);
+    if (record == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the module record!\n");
+        exit(-1);
+    }
+
+    size_t size = mtrace_put_varint(record, MTRACE_RECORD_MODULE);
+    size += mtrace_put_varint(record + size, module->id);
+    size += module_encode(module, record + size, MODULE_MAX_ENCODED_SIZE);
+
+    pthread_mutex_lock(&writer->lock);
+    write_all(writer->fd, record, size);
+    writer->written += size;
+    pthread_mutex_unlock(&writer->lock);
+
+    free(record);
+}
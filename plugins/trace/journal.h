@@ -0,0 +1,152 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../../plugins.h"
+
+#include "cfg.h"
+#include "config.h"
+#include "modules.h"
+
+// TYPEDEFS
+
+struct journal_block;
+typedef struct journal_block journal_block;
+
+struct trace_journal;
+typedef struct trace_journal trace_journal;
+
+struct journal_writer;
+typedef struct journal_writer journal_writer;
+
+// STRUCTS
+
+/*
+    Fixed-size part of the journal. Records never span two blocks.
+*/
+struct journal_block {
+    journal_block* next; // Next block of the journal, published by the producer once this block is full.
+    uint64_t committed; // Number of bytes of complete records, published by the producer after every record.
+    uint64_t used; // Number of bytes written by the producer (only accessed by the producer).
+    uint8_t data[JOURNAL_BLOCK_SIZE];
+};
+
+/*
+    Append-only log of the CFG changes discovered by a single thread. The thread appends records without any locking
+    and the background writer drains the complete records into the trace file.
+*/
+struct trace_journal {
+    journal_writer* writer; // Writer draining the journal.
+    journal_block* tail; // Block the records are appended to (only accessed by the producer).
+    journal_block* head; // Oldest block not yet fully drained (only accessed with the lock of the writer held).
+    uint64_t drained; // Number of bytes of the head already written to the file.
+    uint64_t blocks; // Number of blocks not yet released by the writer.
+    bool closed; // Set when the thread exits, the journal is released once drained.
+    trace_journal* next; // Next journal drained by the writer.
+};
+
+/*
+    Background thread streaming the journals of all the threads into the trace file.
+*/
+struct journal_writer {
+    int fd; // File descriptor of the trace.
+    pthread_t thread; // Thread draining the journals.
+    pthread_mutex_t lock; // Lock guarding the list of journals and the file.
+    pthread_cond_t wakeup; // Used to wake the writer up early when stopping.
+    bool stop; // Set when the application exits.
+    trace_journal* journals; // Journals of all the threads.
+    void** main_addr; // Location of the address of the main function, saved as soon as it is known.
+    module_table* modules; // Modules the addresses are encoded against.
+    bool main_written; // Whether the address of the main function was already saved.
+    uint64_t written; // Total number of bytes written to the file.
+    uint64_t stalls; // Number of times a thread had to drain its own journal, as the writer fell behind.
+    char path[128]; // Path of the trace.
+};
+
+// FUNCTIONS
+
+/**
+ * Create the trace file and start the writer thread.
+ *
+ * @param writer Writer to be initialized.
+ * @param main_addr Location of the address of the main function (see lift_plugin_data).
+ * @param modules Module table, the modules added from now on are logged to the trace.
+ * @param family Family of the process (see trace_family).
+ * @return 0 on success, -1 on failure.
+ */
+int journal_writer_start(journal_writer* writer, void** main_addr, module_table* modules, const char* family);
+
+/**
+ * Stop the writer thread, save the remaining records and close the file.
+ *
+ * @param writer Running writer.
+ */
+void journal_writer_stop(journal_writer* writer);
+
+/**
+ * Create a journal of a new thread and register it with the writer.
+ *
+ * @param writer Running writer.
+ * @return The journal or NULL if the memory couldn't be allocated.
+ */
+trace_journal* journal_open(journal_writer* writer);
+
+/**
+ * Mark the journal as complete. The writer releases it once all the records are saved.
+ *
+ * @param journal Journal of the exiting thread.
+ */
+void journal_close(trace_journal* journal);
+
+/**
+ * Log a newly discovered node together with its statically known edges.
+ *
+ * @param journal Journal of the thread.
+ * @param node New node.
+ */
+void journal_put_node(trace_journal* journal, cfg_node* node);
+
+/**
+ * Log a new target of the indirect branch.
+ *
+ * @param journal Journal of the thread.
+ * @param source Start address of the node ending in the indirect branch.
+ * @param target Target of the branch.
+ */
+void journal_put_target(trace_journal* journal, void* source, uintptr_t target);
+
+/**
+ * Log a new module. Modules are written directly to the file, so the module is saved before any record using it.
+ *
+ * @param writer Running writer.
+ * @param module New module.
+ */
+void journal_put_module(journal_writer* writer, trace_module* module);
+
+/**
+ * Log a thread spawn.
+ *
+ * @param journal Journal of the thread.
+ * @param entry_addr Address of the thread start routine.
+ * @param call_site Address of the function call that spawned the thread.
+ */
+void journal_put_thread(trace_journal* journal, void* entry_addr, void* call_site);
@@ -0,0 +1,462 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Table of the modules mapped into the traced process. Modules are resolved from /proc/self/maps, which is only read
+    when an address outside of all the known modules is looked up. Lookups run on the instrumented threads, including
+    from cfg_targets_insert_slow, which doesn't have the MAMBO context, so all the memory is allocated with malloc.
+*/
+
+#include <elf.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../plugins.h"
+
+#include "journal.h"
+#include "modules.h"
+#include "warm_start.h"
+
+// CONSTANTS
+
+/*
+    Maximum size of the notes of the binary searched for the build-id.
+*/
+#define MODULE_MAX_NOTES_SIZE 4096
+
+// STRUCTS
+
+/*
+    Address range of a file (or of anonymous code) built from the mappings of the process.
+*/
+typedef struct {
+    uintptr_t base; // Lowest address of the range (the load address for files).
+    uintptr_t end; // First address after the range.
+    uint64_t inode; // Inode of the mapped file, 0 for anonymous mappings.
+    bool exec; // Whether any part of the range is executable.
+    char path[MODULE_MAX_PATH_SIZE]; // Path of the mapped file.
+} mapped_range;
+
+// FUNCTIONS
+
+void module_table_init(module_table* table) {
+    pthread_mutex_init(&table->lock, NULL);
+    table->snapshot = NULL;
+    table->modules = NULL;
+    table->count = 0;
+    table->capacity = 0;
+    table->ranges = NULL;
+    table->range_count = 0;
+    table->journal = NULL;
+    table->warm = NULL;
+}
+
+void module_table_destroy(module_table* table) {
+    module_snapshot* snapshot = table->snapshot;
+
+    while (snapshot != NULL) {
+        module_snapshot* retired = snapshot->retired;
+        free(snapshot);
+        snapshot = retired;
+    }
+
+    for (uint64_t id = 0; id < table->count; id++) {
+        free(table->modules[id]->path);
+        free(table->modules[id]);
+    }
+
+    free(table->modules);
+    free(table->ranges);
+    pthread_mutex_destroy(&table->lock);
+
+    table->snapshot = NULL;
+    table->modules = NULL;
+    table->count = 0;
+    table->ranges = NULL;
+    table->range_count = 0;
+}
+
+trace_module* module_table_lookup(module_table* table, uintptr_t addr) {
+    module_snapshot* snapshot = __atomic_load_n(&table->snapshot, __ATOMIC_ACQUIRE);
+
+    if (snapshot == NULL) {
+        return NULL;
+    }
+
+    // Find the first module starting after addr, the module before it is the only one that may contain addr.
+    uint64_t low = 0;
+    uint64_t high = snapshot->count;
+
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+
+        if (snapshot->modules[middle]->base <= addr) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low == 0) {
+        return NULL;
+    }
+
+    trace_module* module = snapshot->modules[low - 1];
+
+    return addr - module->base < module->size ? module : NULL;
+}
+
+/*
+    Read the GNU build-id from the notes of the ELF file. The build-id is left empty if the file can't be read.
+*/
+static void read_build_id(trace_module* module) {
+    int fd = open(module->path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    Elf64_Ehdr header;
+
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.e_ident, ELFMAG, SELFMAG) != 0
+        || header.e_ident[EI_CLASS] != ELFCLASS64) {
+        close(fd);
+        return;
+    }
+
+    uint8_t notes[MODULE_MAX_NOTES_SIZE];
+
+    for (int idx = 0; idx < header.e_phnum && module->build_id_size == 0; idx++) {
+        Elf64_Phdr segment;
+
+        if (pread(fd, &segment, sizeof(segment), header.e_phoff + idx * header.e_phentsize) != sizeof(segment)
+            || segment.p_type != PT_NOTE) {
+            continue;
+        }
+
+        size_t size = segment.p_filesz < sizeof(notes) ? segment.p_filesz : sizeof(notes);
+        ssize_t ret = pread(fd, notes, size, segment.p_offset);
+        if (ret <= 0) {
+            continue;
+        }
+        size = ret;
+
+        // Names and descriptors of the notes are padded to 4 bytes.
+        size_t offset = 0;
+
+        while (offset + sizeof(Elf64_Nhdr) <= size) {
+            Elf64_Nhdr note;
+            memcpy(&note, notes + offset, sizeof(note));
+
+            size_t name = offset + sizeof(note);
+            size_t desc = name + ((note.n_namesz + 3) & ~3U);
+            if (desc + note.n_descsz > size) {
+                break;
+            }
+
+            if (note.n_type == NT_GNU_BUILD_ID && note.n_namesz == 4 && memcmp(notes + name, "GNU", 4) == 0
+                && note.n_descsz <= MTRACE_MAX_BUILD_ID_SIZE) {
+                memcpy(module->build_id, notes + desc, note.n_descsz);
+                module->build_id_size = note.n_descsz;
+                break;
+            }
+
+            offset = desc + ((note.n_descsz + 3) & ~3U);
+        }
+    }
+
+    close(fd);
+}
+
+/*
+    Read the mappings of the process and find the executable ranges containing addr and main_addr. Mappings of one
+    file are merged into a single range, as the segments may be separated by gaps. All the executable ranges are kept
+    in the table for module_table_encode. Returns false if the mappings can't be read. The caller has to hold the lock.
+*/
+static bool read_mappings(module_table* table, uintptr_t addr, uintptr_t main_addr, mapped_range* found,
+                          mapped_range* main) {
+    FILE* maps = fopen("/proc/self/maps", "r");
+    if (maps == NULL) {
+        return false;
+    }
+
+    mapped_range* ranges = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    char line[MODULE_MAX_PATH_SIZE + 256];
+
+    while (fgets(line, sizeof(line), maps) != NULL) {
+        uintptr_t start, end;
+        uint64_t offset, inode;
+        char perms[5];
+        int path_start = 0;
+
+        if (sscanf(line, "%lx-%lx %4s %lx %*s %lu %n", &start, &end, perms, &offset, &inode, &path_start) < 5) {
+            continue;
+        }
+
+        char* path = line + path_start;
+        path[strcspn(path, "\n")] = '\0';
+
+        // Mappings of the same file are merged, anonymous mappings are kept separate.
+        mapped_range* range = NULL;
+
+        if (inode != 0) {
+            for (size_t idx = 0; idx < count; idx++) {
+                if (ranges[idx].inode == inode && strcmp(ranges[idx].path, path) == 0) {
+                    range = &ranges[idx];
+                    break;
+                }
+            }
+        }
+
+        if (range == NULL) {
+            if (count == capacity) {
+                capacity = capacity ? 2 * capacity : 64;
+                mapped_range* grown = (mapped_range *) realloc(ranges, capacity * sizeof(mapped_range));
+                if (grown == NULL) {
+                    break;
+                }
+                ranges = grown;
+            }
+
+            range = &ranges[count++];
+            // Mappings are sorted by address, so the first mapping of a file determines its load address.
+            range->base = start - (inode != 0 ? offset : 0);
+            range->end = end;
+            range->inode = inode;
+            range->exec = false;
+            snprintf(range->path, sizeof(range->path), "%s", inode != 0 ? path : "");
+        }
+
+        if (end > range->end) {
+            range->end = end;
+        }
+        range->exec |= perms[2] == 'x';
+    }
+
+    fclose(maps);
+
+    found->exec = false;
+    main->exec = false;
+
+    module_range* exec_ranges = (module_range *) malloc((count + 1) * sizeof(module_range));
+    uint64_t exec_count = 0;
+
+    for (size_t idx = 0; idx < count; idx++) {
+        if (exec_ranges != NULL && ranges[idx].exec) {
+            exec_ranges[exec_count].base = ranges[idx].base;
+            exec_ranges[exec_count].end = ranges[idx].end;
+            exec_count++;
+        }
+        if (ranges[idx].exec && addr - ranges[idx].base < ranges[idx].end - ranges[idx].base) {
+            *found = ranges[idx];
+        }
+        if (ranges[idx].exec && main_addr - ranges[idx].base < ranges[idx].end - ranges[idx].base) {
+            *main = ranges[idx];
+        }
+    }
+
+    free(ranges);
+
+    // Without the ranges every lookup reads the mappings again.
+    free(table->ranges);
+    table->ranges = exec_ranges;
+    table->range_count = exec_count;
+
+    return true;
+}
+
+/*
+    Add the module to the table and publish a new snapshot. Modules of the old snapshot overlapping the new module
+    were unloaded, so they are dropped from the lookups (but kept in the table). The caller has to hold the lock.
+*/
+static trace_module* add_module(module_table* table, mapped_range* range) {
+    trace_module* module = (trace_module *) calloc(1, sizeof(trace_module));
+    module_snapshot* old = table->snapshot;
+    uint64_t old_count = old != NULL ? old->count : 0;
+    module_snapshot* snapshot = (module_snapshot *) malloc(sizeof(module_snapshot)
+                                                           + (old_count + 1) * sizeof(trace_module *));
+
+    if (module == NULL || snapshot == NULL || (module->path = strdup(range->path)) == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the module table!\n");
+        exit(-1);
+    }
+
+    if (table->count == table->capacity) {
+        uint64_t capacity = table->capacity ? 2 * table->capacity : 16;
+        trace_module** modules = (trace_module **) realloc(table->modules, capacity * sizeof(trace_module *));
+        if (modules == NULL) {
+            fprintf(stderr, "mclift: Couldn't allocate the module table!\n");
+            exit(-1);
+        }
+        table->modules = modules;
+        table->capacity = capacity;
+    }
+
+    module->id = table->count;
+    module->base = range->base;
+    module->size = range->end - range->base;
+    if (module->path[0] == '/') {
+        read_build_id(module);
+    }
+
+#ifdef WARM_START
+    // Matched before the module is published, so lookups never see a module without its warm-start counterpart.
+    if (table->warm != NULL) {
+        warm_start_match(table->warm, module);
+    }
+#endif
+
+    table->modules[table->count++] = module;
+
+    snapshot->count = 0;
+    for (uint64_t idx = 0; idx <= old_count; idx++) {
+        trace_module* next = idx < old_count ? old->modules[idx] : NULL;
+
+        if (next != NULL && next->base + next->size > module->base && module->base + module->size > next->base) {
+            continue;
+        }
+        if (module != NULL && (next == NULL || module->base < next->base)) {
+            snapshot->modules[snapshot->count++] = module;
+            module = NULL;
+        }
+        if (next != NULL) {
+            snapshot->modules[snapshot->count++] = next;
+        }
+    }
+
+    snapshot->retired = old;
+    __atomic_store_n(&table->snapshot, snapshot, __ATOMIC_RELEASE);
+
+    module = table->modules[table->count - 1];
+
+#ifdef STREAMING_WRITER
+    if (table->journal != NULL) {
+        journal_put_module(table->journal, module);
+    }
+#endif
+
+    return module;
+}
+
+/*
+    Whether the address is within an executable range of the last read of the mappings. Always true before the first
+    read. The caller has to hold the lock.
+*/
+static bool in_known_ranges(module_table* table, uintptr_t addr) {
+    if (table->ranges == NULL) {
+        return true;
+    }
+
+    for (uint64_t idx = 0; idx < table->range_count; idx++) {
+        if (addr - table->ranges[idx].base < table->ranges[idx].end - table->ranges[idx].base) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+    Find the module containing the address and add it if needed. With cached set, the mappings are only read if the
+    address was executable at the last read, see module_table_encode.
+*/
+static trace_module* resolve(module_table* table, uintptr_t addr, bool cached) {
+    trace_module* module = module_table_lookup(table, addr);
+
+    if (module != NULL) {
+        return module;
+    }
+
+    pthread_mutex_lock(&table->lock);
+
+    // Another thread may have added the module in the meantime.
+    module = module_table_lookup(table, addr);
+
+    if (module != NULL || (cached && !in_known_ranges(table, addr))) {
+        pthread_mutex_unlock(&table->lock);
+        return module;
+    }
+
+    mapped_range* found = (mapped_range *) malloc(sizeof(mapped_range));
+    mapped_range* main = (mapped_range *) malloc(sizeof(mapped_range));
+    if (found == NULL || main == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the module table!\n");
+        exit(-1);
+    }
+
+    if (read_mappings(table, addr, global_data.base_addr, found, main)) {
+        // The traced binary is always module 0, so its addresses are the same as without the module table. The
+        // range recorded by the ELF loader of MAMBO takes precedence over the mappings.
+        if (table->count == 0 && main->exec) {
+            main->base = global_data.base_addr;
+            if (global_data.end_addr > global_data.base_addr) {
+                main->end = global_data.end_addr;
+            }
+            add_module(table, main);
+            module = module_table_lookup(table, addr);
+        }
+
+        if (module == NULL && found->exec) {
+            module = add_module(table, found);
+        }
+    }
+
+    pthread_mutex_unlock(&table->lock);
+
+    free(found);
+    free(main);
+
+    return module;
+}
+
+trace_module* module_table_resolve(module_table* table, uintptr_t addr) {
+    return resolve(table, addr, false);
+}
+
+uint64_t module_table_encode(module_table* table, uintptr_t addr) {
+    trace_module* module = addr != 0 ? resolve(table, addr, true) : NULL;
+
+    if (module == NULL) {
+        return mtrace_module_addr(MTRACE_MODULE_UNKNOWN, addr);
+    }
+
+    return mtrace_module_addr(module->id, addr - module->base);
+}
+
+size_t module_encode(trace_module* module, uint8_t* out, size_t size) {
+    size_t path_size = strlen(module->path);
+
+    if (size < 4 * MTRACE_MAX_VARINT_SIZE + path_size + module->build_id_size) {
+        return 0;
+    }
+
+    size_t used = mtrace_put_varint(out, module->base);
+    used += mtrace_put_varint(out + used, module->size);
+    used += mtrace_put_varint(out + used, path_size);
+    memcpy(out + used, module->path, path_size);
+    used += path_size;
+    used += mtrace_put_varint(out + used, module->build_id_size);
+    memcpy(out + used, module->build_id, module->build_id_size);
+    used += module->build_id_size;
+
+    return used;
+}
@@ -0,0 +1,166 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mtrace_format.h"
+
+// CONSTANTS
+
+/*
+    Maximum size of the path of a module, including the terminating null. Longer paths are truncated.
+*/
+#define MODULE_MAX_PATH_SIZE PATH_MAX
+
+/*
+    Upper bound of the size of an encoded module (see module_encode).
+*/
+#define MODULE_MAX_ENCODED_SIZE (4 * MTRACE_MAX_VARINT_SIZE + MODULE_MAX_PATH_SIZE + MTRACE_MAX_BUILD_ID_SIZE)
+
+// TYPEDEFS
+
+struct trace_module;
+typedef struct trace_module trace_module;
+
+struct module_snapshot;
+typedef struct module_snapshot module_snapshot;
+
+struct module_range;
+typedef struct module_range module_range;
+
+struct module_table;
+typedef struct module_table module_table;
+
+struct journal_writer;
+
+struct warm_module;
+
+struct warm_start;
+
+// STRUCTS
+
+/*
+    Executable module (the traced binary, the dynamic linker, a shared library or anonymous code) mapped into the
+    traced process. Modules are never modified or released once added to the table.
+*/
+struct trace_module {
+    uint64_t id; // Id of the module in the trace, assigned in the order the modules were seen (0 is the binary).
+    uintptr_t base; // Load address of the module.
+    uint64_t size; // Size of the address range of the module.
+    char* path; // Path of the mapped file, empty for anonymous code.
+    uint8_t build_id[MTRACE_MAX_BUILD_ID_SIZE]; // GNU build-id of the file.
+    uint32_t build_id_size; // Size of the build-id, 0 if unknown.
+    struct warm_module* warm; // The same module in the warm-start trace (only with WARM_START).
+};
+
+/*
+    Immutable list of the loaded modules sorted by their base addresses. A new snapshot is published whenever a module
+    is added, so lookups never take a lock.
+*/
+struct module_snapshot {
+    module_snapshot* retired; // Previous snapshot, released with the table as lookups may still be using it.
+    uint64_t count; // Number of modules.
+    trace_module* modules[]; // Modules sorted by base.
+};
+
+/*
+    Executable address range of the mappings of the process.
+*/
+struct module_range {
+    uintptr_t base; // Lowest address of the range.
+    uintptr_t end; // First address after the range.
+};
+
+/*
+    Table of all the modules seen by the plugin. Modules are added on the first lookup of an address within them, so
+    modules loaded later (e.g., with dlopen) are picked up as soon as their code runs.
+*/
+struct module_table {
+    pthread_mutex_t lock; // Lock serializing the updates of the table.
+    module_snapshot* snapshot; // Currently loaded modules, read without locking.
+    trace_module** modules; // All the modules indexed by their ids, including the unloaded ones.
+    uint64_t count; // Number of modules.
+    uint64_t capacity; // Number of entries allocated for modules.
+    module_range* ranges; // Executable ranges found by the last read of the mappings (NULL before the first read).
+    uint64_t range_count; // Number of the executable ranges.
+    struct journal_writer* journal; // Writer new modules are logged to (only with STREAMING_WRITER).
+    struct warm_start* warm; // Warm-start trace new modules are matched against (only with WARM_START).
+};
+
+// FUNCTIONS
+
+/**
+ * Initialize the empty table.
+ *
+ * @param table Table to be initialized.
+ */
+void module_table_init(module_table* table);
+
+/**
+ * Release the table and all its modules.
+ *
+ * @param table Initialized table.
+ */
+void module_table_destroy(module_table* table);
+
+/**
+ * Find the module containing the address among the modules already in the table (binary search without locking).
+ *
+ * @param table Module table.
+ * @param addr Address in the traced process.
+ * @return The module or NULL if the address is outside of all the known modules.
+ */
+trace_module* module_table_lookup(module_table* table, uintptr_t addr);
+
+/**
+ * Find the module containing the address. If the module is not in the table yet, the mappings of the process are
+ * read and the module is added (the traced binary is always added first). Must not be called with the lock of the
+ * journal writer held, as new modules are logged to the journal.
+ *
+ * @param table Module table.
+ * @param addr Address in the traced process.
+ * @return The module or NULL if the address is not mapped.
+ */
+trace_module* module_table_resolve(module_table* table, uintptr_t addr);
+
+/**
+ * Encode the address as (module id, offset), see mtrace_module_addr. Adds the module if needed, so the same
+ * restrictions as for module_table_resolve apply. Unlike module_table_resolve, the mappings are only read again if
+ * the address is within an executable range of the last read, so addresses of unloaded modules don't read the
+ * mappings on every lookup. The addresses must have been executed or be next to executed code, whose modules were
+ * already resolved.
+ *
+ * @param table Module table.
+ * @param addr Address in the traced process.
+ * @return Encoded address.
+ */
+uint64_t module_table_encode(module_table* table, uintptr_t addr);
+
+/**
+ * Encode the module as in the version 2 module table (without the id).
+ *
+ * @param module Module to be encoded.
+ * @param out Output buffer.
+ * @param size Size of the output buffer.
+ * @return Number of bytes written or 0 if the buffer is too small.
+ */
+size_t module_encode(trace_module* module, uint8_t* out, size_t size);
@@ -0,0 +1,320 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Layout of the .mtrace files. The header does not depend on MAMBO, so it can be shared with tools that consume the
+    traces on the host machine. All the multi-byte fixed-size fields are stored little-endian.
+
+    Version 1 (legacy, unversioned):
+
+        uint64_t main_addr
+        For every node:
+            int64_t  -1 (marks beginning of the node)
+            uint64_t start_addr
+            uint64_t end_addr
+            uint32_t branch_reg
+            uint32_t type
+            For every edge:
+                uint64_t target
+                uint32_t type
+
+    Version 2:
+
+        mtrace_header
+        Only with MTRACE_FLAG_MODULES:
+            varint number of modules
+            For every module, in the order of module ids:
+                varint base (load address of the module in the traced process)
+                varint size
+                varint length of the path, followed by the path (not NUL-terminated, empty for anonymous code)
+                varint length of the GNU build-id, followed by the build-id (empty if unknown)
+        For every node, sorted by start_addr:
+            varint start_addr - start_addr of the previous node (or start_addr itself for every
+                   MTRACE_INDEX_INTERVAL-th node, so decoding can restart from any entry of the index)
+            varint end_addr - start_addr
+            varint type
+            varint branch_reg + 1 (0 if the node does not end in an indirect branch)
+            varint order_id (only with MTRACE_FLAG_ORDER) - position of the node in the order of the first
+                   execution of basic blocks, shared by all the threads
+            varint number of executions (only with MTRACE_FLAG_EXEC_COUNTS)
+            varint number of edges
+            For every edge, sorted by target:
+                varint zigzag(target - start_addr) for the first edge, target - previous target otherwise
+                varint type
+                varint number of times the edge was followed (only with MTRACE_FLAG_EXEC_COUNTS)
+        uint64_t index[index_count] - offsets (from the beginning of the file) of every MTRACE_INDEX_INTERVAL-th
+                 node, which allows a binary search of the node without parsing the whole file
+        Only with MTRACE_FLAG_THREADS, starting at threads_offset:
+            varint number of thread spawns
+            For every unique thread spawn:
+                varint entry_addr (start routine of the thread)
+                varint call_site (function call that spawned the thread)
+
+    Journal (version 2 with MTRACE_FLAG_JOURNAL, written with STREAMING_WRITER):
+
+        mtrace_header (only magic, version, flags and base_addr are set)
+        Records, appended while the application runs, until the end of the file:
+            varint kind (MTRACE_RECORD_*)
+            MTRACE_RECORD_NODE - a thread discovered a block:
+                varint start_addr
+                varint end_addr - start_addr
+                varint type
+                varint branch_reg + 1
+                varint order_id (order of the first execution, shared by all the threads)
+                varint number of edges, followed by edges encoded as in version 2 (without execution counts)
+            MTRACE_RECORD_TARGET - a thread discovered a target of the indirect branch:
+                varint start_addr of the node ending in the branch
+                varint target
+            MTRACE_RECORD_THREAD - a thread spawn:
+                varint entry_addr
+                varint call_site
+            MTRACE_RECORD_MAIN - the address of the main function became known:
+                varint main_addr
+            MTRACE_RECORD_MODULE - a module was seen for the first time (only with MTRACE_FLAG_MODULES; the record is
+                   saved before any address within the module):
+                varint module id, followed by the module encoded as in version 2
+
+        Blocks discovered by several threads are logged by every one of them. The last record may be truncated if the
+        process was killed, all the previous records are complete. The journal can be converted to the indexed
+        version 2 trace with tools/mtrace/mtrace-compact.
+
+    Traces saved with COMPRESSED_OUTPUT wrap either version in a container of independently compressed chunks, so the
+    chunk holding any offset of the trace (e.g., from the index) can be decompressed without the others:
+
+        mtrace_compressed_header
+        Compressed chunks, in any order (the chunk with the header of the trace is usually the last one)
+        Chunk table at chunk_table_offset, for every chunk in the order of the uncompressed trace:
+            uint64_t offset of the compressed chunk from the beginning of the file
+            uint64_t size of the compressed chunk
+            uint64_t size of the uncompressed chunk (at most chunk_size)
+
+    Paths saved with PATH_RECORDING (<family>.<pid>.<counter>.mpath, next to the trace) hold the sequence of blocks
+    executed by every thread:
+
+        mtrace_path_header
+        Records, appended while the application runs, until the end of the file:
+            varint kind (MTRACE_PATH_RECORD_*)
+            MTRACE_PATH_RECORD_PATH - the next part of the path of a thread:
+                varint thread id
+                varint number of executed blocks
+                varint size of the tokens, followed by the tokens:
+                    varint token - with the lowest bit clear a single block: zigzag(order_id - order_id of the
+                           previous block of the thread) above the lowest bit; with the lowest bit set a repetition:
+                           the distance (minus one) to the block the copy starts at, above the lowest bit
+                    varint number of the repeated blocks - MTRACE_PATH_MIN_RUN (repetitions only) - blocks are
+                           copied one by one, so a repetition longer than its distance repeats a loop
+            MTRACE_PATH_RECORD_BLOCKS - blocks discovered by a thread, saved when the thread exits:
+                varint thread id
+                varint number of blocks
+                For every block:
+                    varint zigzag(order_id - order_id of the previous block)
+                    varint start_addr (encoded as with MTRACE_FLAG_MODULES)
+
+        Repetitions may reach into the previous records of the same thread. Blocks are identified by their order ids
+        in the thread that executed them, as a block discovered by several threads gets an id in each of them and only
+        the lowest one is saved in the trace.
+
+    All the addresses are relative to base_addr of the header (version 2) or to the base address of the traced binary
+    (version 1). With MTRACE_FLAG_MODULES addresses are instead encoded as (module id, offset from the base of the
+    module), see mtrace_module_addr. The traced binary is always module 0 and base_addr is its base, so addresses
+    within it are the same in both encodings, while addresses in shared libraries, the dynamic linker or dlopen-ed
+    code don't depend on where the modules were loaded.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CONSTANTS
+
+#define MTRACE_MAGIC 0x4352544dU // "MTRC"
+
+#define MTRACE_VERSION 2
+
+#define MTRACE_COMPRESSED_MAGIC 0x5a52544dU // "MTRZ"
+
+#define MTRACE_PATH_MAGIC 0x4854504dU // "MPTH"
+
+#define MTRACE_PATH_VERSION 1
+
+/*
+    Codecs of the compressed chunks. Every chunk is a complete zstd frame or a raw LZ4 block.
+*/
+#define MTRACE_CODEC_LZ4 1
+#define MTRACE_CODEC_ZSTD 2
+
+/*
+    Every MTRACE_INDEX_INTERVAL-th node stores its full start address and is referenced from the index.
+*/
+#define MTRACE_INDEX_INTERVAL 16
+
+/*
+    Flags of the version 2 header.
+*/
+#define MTRACE_FLAG_EXEC_COUNTS 0x1 // Nodes and edges carry execution counts (or 0/1 flags, see EXECUTION_FLAGS_ONLY).
+#define MTRACE_FLAG_THREADS 0x2 // The trace ends with the list of threads spawned by the application.
+#define MTRACE_FLAG_JOURNAL 0x4 // The header is followed by the log of records instead of the nodes and the index.
+#define MTRACE_FLAG_ORDER 0x8 // Nodes carry the order of their first execution.
+#define MTRACE_FLAG_MODULES 0x10 // Addresses are encoded as (module id, offset) and the trace has the module table.
+
+/*
+    Kinds of the journal records.
+*/
+#define MTRACE_RECORD_NODE 1
+#define MTRACE_RECORD_TARGET 2
+#define MTRACE_RECORD_THREAD 3
+#define MTRACE_RECORD_MAIN 4
+#define MTRACE_RECORD_MODULE 5
+
+/*
+    Kinds of the path records.
+*/
+#define MTRACE_PATH_RECORD_PATH 1
+#define MTRACE_PATH_RECORD_BLOCKS 2
+
+/*
+    Repetitions of the path reach at most MTRACE_PATH_MAX_DISTANCE blocks back and repeat at least MTRACE_PATH_MIN_RUN
+    blocks, shorter ones are saved as single blocks.
+*/
+#define MTRACE_PATH_MAX_DISTANCE 64
+#define MTRACE_PATH_MIN_RUN 3
+
+/*
+    Encoding of the addresses with MTRACE_FLAG_MODULES: the module id is stored above MTRACE_MODULE_SHIFT bits of the
+    offset. Addresses outside of all the known modules use MTRACE_MODULE_UNKNOWN and keep the absolute address as the
+    offset.
+*/
+#define MTRACE_MODULE_SHIFT 48
+#define MTRACE_MODULE_UNKNOWN 0xffff
+
+/*
+    Maximum size of the build-id of the module.
+*/
+#define MTRACE_MAX_BUILD_ID_SIZE 64
+
+/*
+    Value used in version 1 to mark the beginning of a node.
+*/
+#define MTRACE_V1_BEGIN_NODE ((int64_t) -1)
+
+/*
+    Maximum number of bytes used to encode a 64-bit varint.
+*/
+#define MTRACE_MAX_VARINT_SIZE 10
+
+// STRUCTS
+
+/*
+    Header of the version 2 trace.
+*/
+typedef struct {
+    uint32_t magic; // MTRACE_MAGIC.
+    uint16_t version; // MTRACE_VERSION.
+    uint16_t flags; // Optional content of the trace (MTRACE_FLAG_*).
+    uint64_t base_addr; // Base address of the traced binary; all other addresses are relative to it.
+    uint64_t main_addr; // Address of the main function.
+    uint64_t node_count; // Number of nodes in the trace.
+    uint64_t edge_count; // Total number of edges in the trace.
+    uint64_t index_offset; // Offset of the index from the beginning of the file.
+    uint64_t index_count; // Number of entries in the index.
+    uint64_t threads_offset; // Offset of the thread spawns from the beginning of the file (MTRACE_FLAG_THREADS only).
+} mtrace_header;
+
+/*
+    Header of the compressed trace.
+*/
+typedef struct {
+    uint32_t magic; // MTRACE_COMPRESSED_MAGIC.
+    uint16_t codec; // MTRACE_CODEC_*.
+    uint16_t level; // Compression level the trace was saved with (informative).
+    uint64_t chunk_size; // Maximum size of the uncompressed chunk.
+    uint64_t size; // Size of the uncompressed trace.
+    uint64_t chunk_count; // Number of chunks.
+    uint64_t chunk_table_offset; // Offset of the chunk table from the beginning of the file.
+} mtrace_compressed_header;
+
+/*
+    Header of the path.
+*/
+typedef struct {
+    uint32_t magic; // MTRACE_PATH_MAGIC.
+    uint16_t version; // MTRACE_PATH_VERSION.
+    uint16_t reserved; // Always 0.
+} mtrace_path_header;
+
+// FUNCTIONS
+
+/*
+    Encode an unsigned LEB128 varint. The output has to have at least MTRACE_MAX_VARINT_SIZE bytes available. Returns
+    the number of bytes written.
+*/
+static inline size_t mtrace_put_varint(uint8_t* out, uint64_t value) {
+    size_t size = 0;
+
+    while (value >= 0x80) {
+        out[size++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = (uint8_t) value;
+
+    return size;
+}
+
+/*
+    Decode an unsigned LEB128 varint stored between in and end. Returns the number of bytes consumed or 0 if the
+    varint is truncated or malformed.
+*/
+static inline size_t mtrace_get_varint(const uint8_t* in, const uint8_t* end, uint64_t* value) {
+    // Most of the fields fit into a single byte.
+    if (in < end && in[0] < 0x80) {
+        *value = in[0];
+        return 1;
+    }
+
+    uint64_t result = 0;
+
+    for (size_t size = 0; size < MTRACE_MAX_VARINT_SIZE && in + size < end; size++) {
+        result |= (uint64_t) (in[size] & 0x7f) << (7 * size);
+        if ((in[size] & 0x80) == 0) {
+            *value = result;
+            return size + 1;
+        }
+    }
+
+    return 0;
+}
+
+static inline uint64_t mtrace_zigzag_encode(int64_t value) {
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static inline int64_t mtrace_zigzag_decode(uint64_t value) {
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static inline uint64_t mtrace_module_addr(uint64_t module_id, uint64_t offset) {
+    return (module_id << MTRACE_MODULE_SHIFT) | offset;
+}
+
+static inline uint64_t mtrace_module_id(uint64_t addr) {
+    return addr >> MTRACE_MODULE_SHIFT;
+}
+
+static inline uint64_t mtrace_module_offset(uint64_t addr) {
+    return addr & ((UINT64_C(1) << MTRACE_MODULE_SHIFT) - 1);
+}
@@ -0,0 +1,331 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Writer of the paths of the threads (see PATH_RECORDING). Chunks are handed over from the instrumentation, which
+    doesn't have the MAMBO context, so all the memory is allocated with malloc.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "path.h"
+
+#ifdef PATH_RECORDING
+
+#include "aarch64_utils.h"
+#include "writer.h"
+
+_Static_assert((PATH_BUFFER_ENTRIES & (PATH_BUFFER_ENTRIES - 1)) == 0, "PATH_BUFFER_ENTRIES has to be a power of two");
+_Static_assert((PATH_CHUNK_ENTRIES & (PATH_CHUNK_ENTRIES - 1)) == 0 && PATH_CHUNK_ENTRIES <= PATH_BUFFER_ENTRIES / 2,
+               "PATH_CHUNK_ENTRIES has to be a power of two and at most half of PATH_BUFFER_ENTRIES");
+
+// CONSTANTS
+
+/*
+    Upper bound of the size of the fields preceding the tokens of the path record.
+*/
+#define PATH_RECORD_HEADER_SIZE (4 * MTRACE_MAX_VARINT_SIZE)
+
+/*
+    Upper bound of the size of the tokens of a single chunk - every block saved on its own.
+*/
+#define PATH_MAX_TOKENS_SIZE (PATH_CHUNK_ENTRIES * MTRACE_MAX_VARINT_SIZE)
+
+// FUNCTIONS
+
+/*
+    Encode the ids window[start..end) as tokens, the start ids preceding them were already saved. Every block is
+    either repeated from one of the last MTRACE_PATH_MAX_DISTANCE blocks (the longest repetition wins) or saved as the
+    difference to the previous id. Returns the size of the tokens.
+*/
+static size_t encode_path(const uint32_t* window, uint64_t start, uint64_t end, uint8_t* out) {
+    size_t size = 0;
+    uint64_t idx = start;
+
+    while (idx < end) {
+        uint64_t best_length = 0;
+        uint64_t best_distance = 0;
+        uint64_t max_distance = idx < MTRACE_PATH_MAX_DISTANCE ? idx : MTRACE_PATH_MAX_DISTANCE;
+
+        for (uint64_t distance = 1; distance <= max_distance; distance++) {
+            if (window[idx - distance] != window[idx]) {
+                continue;
+            }
+
+            uint64_t length = 1;
+            while (idx + length < end && window[idx + length] == window[idx + length - distance]) {
+                length++;
+            }
+
+            if (length > best_length) {
+                best_length = length;
+                best_distance = distance;
+            }
+
+            // The repetition covers all the remaining blocks, so none of the longer distances can do better.
+            if (idx + length == end) {
+                break;
+            }
+        }
+
+        if (best_length >= MTRACE_PATH_MIN_RUN) {
+            size += mtrace_put_varint(out + size, ((best_distance - 1) << 1) | 1);
+            size += mtrace_put_varint(out + size, best_length - MTRACE_PATH_MIN_RUN);
+            idx += best_length;
+        } else {
+            int64_t delta = (int64_t) window[idx] - (int64_t) (idx > 0 ? window[idx - 1] : 0);
+            size += mtrace_put_varint(out + size, mtrace_zigzag_encode(delta) << 1);
+            idx++;
+        }
+    }
+
+    return size;
+}
+
+/*
+    Write all the published entries of the buffer to the file. The caller has to hold the lock of the writer.
+*/
+static void drain(path_writer* writer, path_buffer* buffer) {
+    uint64_t published = __atomic_load_n(&buffer->published, __ATOMIC_ACQUIRE);
+
+    while (buffer->drained < published) {
+        uint64_t start = get_virtual_counter();
+
+        // Records never cross the chunks, so they never wrap around the end of the ring.
+        uint64_t count = PATH_CHUNK_ENTRIES - (buffer->drained & (PATH_CHUNK_ENTRIES - 1));
+        if (count > published - buffer->drained) {
+            count = published - buffer->drained;
+        }
+
+        uint64_t history_size = buffer->history_size;
+        memcpy(writer->window, buffer->history, history_size * sizeof(uint32_t));
+        memcpy(writer->window + history_size, &buffer->entries[buffer->drained & (PATH_BUFFER_ENTRIES - 1)],
+               count * sizeof(uint32_t));
+
+        uint8_t* tokens = writer->record + PATH_RECORD_HEADER_SIZE;
+        size_t tokens_size = encode_path(writer->window, history_size, history_size + count, tokens);
+
+        uint8_t header[PATH_RECORD_HEADER_SIZE];
+        size_t header_size = mtrace_put_varint(header, MTRACE_PATH_RECORD_PATH);
+        header_size += mtrace_put_varint(header + header_size, (uint64_t) buffer->thread_id);
+        header_size += mtrace_put_varint(header + header_size, count);
+        header_size += mtrace_put_varint(header + header_size, tokens_size);
+        memcpy(tokens - header_size, header, header_size);
+
+        write_all(writer->fd, tokens - header_size, header_size + tokens_size);
+
+        // Keep the most recent ids, so the repetitions of the next record can reach back into this one.
+        uint64_t total = history_size + count;
+        buffer->history_size = total < MTRACE_PATH_MAX_DISTANCE ? total : MTRACE_PATH_MAX_DISTANCE;
+        memcpy(buffer->history, writer->window + total - buffer->history_size,
+               buffer->history_size * sizeof(uint32_t));
+
+        __atomic_store_n(&buffer->drained, buffer->drained + count, __ATOMIC_RELEASE);
+
+        writer->blocks += count;
+        writer->written += header_size + tokens_size;
+        writer->encode_time += get_virtual_counter() - start;
+    }
+}
+
+/*
+    Drain all the buffers and release the buffers of the exited threads. The caller has to hold the lock.
+*/
+static void drain_all(path_writer* writer) {
+    path_buffer** buffer = &writer->buffers;
+
+    while (*buffer != NULL) {
+        bool closed = __atomic_load_n(&(*buffer)->closed, __ATOMIC_ACQUIRE);
+
+        drain(writer, *buffer);
+
+        if (closed) {
+            path_buffer* released = *buffer;
+            *buffer = released->next;
+            free(released);
+        } else {
+            buffer = &(*buffer)->next;
+        }
+    }
+}
+
+static void* writer_thread(void* arg) {
+    path_writer* writer = (path_writer *) arg;
+
+    pthread_mutex_lock(&writer->lock);
+
+    while (!writer->stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+
+        deadline.tv_nsec += (PATH_FLUSH_INTERVAL_MS % 1000) * 1000000L;
+        deadline.tv_sec += PATH_FLUSH_INTERVAL_MS / 1000 + deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+
+        pthread_cond_timedwait(&writer->wakeup, &writer->lock, &deadline);
+
+        drain_all(writer);
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+
+    return NULL;
+}
+
+int path_writer_start(path_writer* writer, const char* family) {
+    trace_path(writer->path, sizeof(writer->path), family, "mpath");
+
+    writer->window = (uint32_t *) malloc((MTRACE_PATH_MAX_DISTANCE + PATH_CHUNK_ENTRIES) * sizeof(uint32_t));
+    writer->record = (uint8_t *) malloc(PATH_RECORD_HEADER_SIZE + PATH_MAX_TOKENS_SIZE);
+    if (writer->window == NULL || writer->record == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the buffers of the path writer!\n");
+        return -1;
+    }
+
+    writer->fd = open(writer->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        fprintf(stderr, "mclift: Couldn't open %s: %s!\n", writer->path, strerror(errno));
+        return -1;
+    }
+
+    mtrace_path_header header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic = MTRACE_PATH_MAGIC;
+    header.version = MTRACE_PATH_VERSION;
+
+    write_all(writer->fd, (const uint8_t *) &header, sizeof(header));
+
+    writer->stop = false;
+    writer->buffers = NULL;
+    writer->blocks = 0;
+    writer->written = sizeof(header);
+    writer->encode_time = 0;
+    writer->stalls = 0;
+
+    if (pthread_mutex_init(&writer->lock, NULL) || pthread_cond_init(&writer->wakeup, NULL)
+        || pthread_create(&writer->thread, NULL, writer_thread, writer)) {
+        fprintf(stderr, "mclift: Couldn't start the path writer thread!\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+void path_writer_stop(path_writer* writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->stop = true;
+    pthread_cond_signal(&writer->wakeup);
+    pthread_mutex_unlock(&writer->lock);
+
+    pthread_join(writer->thread, NULL);
+
+    // Threads still running at this point are about to be killed, so only their published entries are saved.
+    pthread_mutex_lock(&writer->lock);
+    drain_all(writer);
+    pthread_mutex_unlock(&writer->lock);
+
+    close(writer->fd);
+    free(writer->window);
+    free(writer->record);
+}
+
+path_buffer* path_open(path_writer* writer, int thread_id) {
+    path_buffer* buffer = (path_buffer *) aligned_alloc(64, sizeof(path_buffer));
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    buffer->head = 0;
+    buffer->published = 0;
+    buffer->writer = writer;
+    buffer->thread_id = thread_id;
+    buffer->closed = false;
+    buffer->drained = 0;
+    buffer->history_size = 0;
+
+    pthread_mutex_lock(&writer->lock);
+    buffer->next = writer->buffers;
+    writer->buffers = buffer;
+    pthread_mutex_unlock(&writer->lock);
+
+    return buffer;
+}
+
+void path_close(path_buffer* buffer) {
+    uint64_t pending = (buffer->head - buffer->published) & (PATH_BUFFER_ENTRIES - 1);
+
+    __atomic_store_n(&buffer->published, buffer->published + pending, __ATOMIC_RELEASE);
+    __atomic_store_n(&buffer->closed, true, __ATOMIC_RELEASE);
+}
+
+void path_buffer_full(path_buffer* buffer) {
+    uint64_t published = buffer->published + PATH_CHUNK_ENTRIES;
+
+    __atomic_store_n(&buffer->published, published, __ATOMIC_RELEASE);
+
+    // The writer fell behind and the next chunk would overwrite entries not saved yet - drain the buffer on this
+    // thread, so the memory used by the path stays bounded.
+    if (published - __atomic_load_n(&buffer->drained, __ATOMIC_ACQUIRE) > PATH_BUFFER_ENTRIES - PATH_CHUNK_ENTRIES) {
+        path_writer* writer = buffer->writer;
+
+        pthread_mutex_lock(&writer->lock);
+        drain(writer, buffer);
+        writer->stalls++;
+        pthread_mutex_unlock(&writer->lock);
+    }
+}
+
+void path_put_blocks(path_buffer* buffer, cfg_node** nodes, uint64_t count, module_table* modules) {
+    uint8_t* record = (uint8_t *) malloc((3 + 2 * count) * MTRACE_MAX_VARINT_SIZE);
+    if (record == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the blocks record!\n");
+        exit(-1);
+    }
+
+    size_t size = mtrace_put_varint(record, MTRACE_PATH_RECORD_BLOCKS);
+    size += mtrace_put_varint(record + size, (uint64_t) buffer->thread_id);
+    size += mtrace_put_varint(record + size, count);
+
+    uint64_t order_id = 0;
+
+    for (uint64_t idx = 0; idx < count; idx++) {
+        // Ids are saved as they are recorded by the instrumentation.
+        uint32_t node_id = (uint32_t) nodes[idx]->order_id;
+
+        size += mtrace_put_varint(record + size, mtrace_zigzag_encode((int64_t) node_id - (int64_t) order_id));
+        size += mtrace_put_varint(record + size, module_table_encode(modules, (uintptr_t) nodes[idx]->start_addr));
+        order_id = node_id;
+    }
+
+    path_writer* writer = buffer->writer;
+
+    pthread_mutex_lock(&writer->lock);
+    write_all(writer->fd, record, size);
+    writer->written += size;
+    pthread_mutex_unlock(&writer->lock);
+
+    free(record);
+}
+
+#endif
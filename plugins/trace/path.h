@@ -0,0 +1,136 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../../plugins.h"
+
+#include "cfg.h"
+#include "config.h"
+#include "modules.h"
+#include "mtrace_format.h"
+
+#ifdef PATH_RECORDING
+
+// TYPEDEFS
+
+struct path_buffer;
+typedef struct path_buffer path_buffer;
+
+struct path_writer;
+typedef struct path_writer path_writer;
+
+// STRUCTS
+
+/*
+    Ring buffer of the ids of the blocks executed by a single thread. The instrumentation appends the ids without any
+    locking and hands every PATH_CHUNK_ENTRIES of them over to the writer. NOTE: The layout of the first fields is used
+    by the instrumentation emitted in lift_pre_inst_cb.
+*/
+struct path_buffer {
+    uint64_t head; // Index of the next entry (only accessed by the producer).
+    uint64_t published; // Number of entries handed over to the writer, published by the producer.
+    path_writer* writer; // Writer draining the buffer.
+    int thread_id; // Id of the thread.
+    bool closed; // Set when the thread exits, the buffer is released once drained.
+    path_buffer* next; // Next buffer drained by the writer.
+
+    // Fields only accessed with the lock of the writer held, kept apart from the ones written by the producer.
+    uint64_t drained __attribute__((aligned(64))); // Number of entries already written to the file.
+    uint32_t history[MTRACE_PATH_MAX_DISTANCE]; // Most recent ids written, so repetitions span the records.
+    uint64_t history_size; // Number of valid entries of the history.
+
+    uint32_t entries[PATH_BUFFER_ENTRIES] __attribute__((aligned(64))); // Order ids of the executed blocks.
+};
+
+/*
+    Background thread saving the paths of all the threads.
+*/
+struct path_writer {
+    int fd; // File descriptor of the path.
+    pthread_t thread; // Thread draining the buffers.
+    pthread_mutex_t lock; // Lock guarding the list of buffers and the file.
+    pthread_cond_t wakeup; // Used to wake the writer up early when stopping.
+    bool stop; // Set when the application exits.
+    path_buffer* buffers; // Buffers of all the threads.
+    uint32_t* window; // History followed by the entries being encoded.
+    uint8_t* record; // Encoded record.
+    uint64_t blocks; // Total number of blocks saved.
+    uint64_t written; // Total number of bytes written to the file.
+    uint64_t encode_time; // Time spent encoding the paths (virtual counter ticks).
+    uint64_t stalls; // Number of times a thread had to drain its own buffer, as the writer fell behind.
+    char path[128]; // Path of the file.
+};
+
+// FUNCTIONS
+
+/**
+ * Create the path file and start the writer thread.
+ *
+ * @param writer Writer to be initialized.
+ * @param family Family of the process (see trace_family).
+ * @return 0 on success, -1 on failure.
+ */
+int path_writer_start(path_writer* writer, const char* family);
+
+/**
+ * Stop the writer thread, save the remaining entries and close the file.
+ *
+ * @param writer Running writer.
+ */
+void path_writer_stop(path_writer* writer);
+
+/**
+ * Create a buffer of a new thread and register it with the writer.
+ *
+ * @param writer Running writer.
+ * @param thread_id Id of the thread.
+ * @return The buffer or NULL if the memory couldn't be allocated.
+ */
+path_buffer* path_open(path_writer* writer, int thread_id);
+
+/**
+ * Hand the remaining entries over to the writer and mark the buffer as complete. The writer releases it once all the
+ * entries are saved.
+ *
+ * @param buffer Buffer of the exiting thread.
+ */
+void path_close(path_buffer* buffer);
+
+/**
+ * Hand the chunk of entries just filled by the instrumentation over to the writer. Called from the instrumentation
+ * every PATH_CHUNK_ENTRIES blocks.
+ *
+ * @param buffer Buffer of the thread.
+ */
+void path_buffer_full(path_buffer* buffer);
+
+/**
+ * Save the start addresses of the blocks discovered by the thread, which the order ids of its path refer to.
+ *
+ * @param buffer Buffer of the thread.
+ * @param nodes Nodes of the thread CFG.
+ * @param count Number of the nodes.
+ * @param modules Modules the addresses are encoded against.
+ */
+void path_put_blocks(path_buffer* buffer, cfg_node** nodes, uint64_t count, module_table* modules);
+
+#endif
@@ -0,0 +1,210 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Telemetry of the plugin (see TELEMETRY). Everything is compiled out when the switch is disabled.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry.h"
+
+#ifdef TELEMETRY
+
+// CONSTANTS
+
+static const char* phase_names[TELEMETRY_THREAD_PHASES] = {"thread_init", "scan", "merge", "merge_wait"};
+
+// FUNCTIONS
+
+void telemetry_init(telemetry* telemetry) {
+    memset(telemetry, 0, sizeof(*telemetry));
+    telemetry->start = get_virtual_counter();
+}
+
+void telemetry_thread_init(telemetry_thread* thread, int thread_id) {
+    memset(thread, 0, sizeof(telemetry_thread));
+    thread->thread_id = thread_id;
+}
+
+static void measure_targets(telemetry_cfg* stats, cfg_targets* targets) {
+    for (int idx = 0; idx < CFG_INLINE_TARGETS; idx++) {
+        if (targets->inline_targets[idx] != 0) {
+            stats->indirect_targets++;
+        }
+    }
+
+    stats->target_bytes += cfg_targets_footprint(targets);
+
+    if (targets->table == NULL) {
+        return;
+    }
+
+    uint64_t entries = cfg_targets_probe_lengths(targets, &stats->target_probe_total, &stats->target_probe_max);
+
+    stats->target_tables++;
+    stats->target_slots += targets->mask + 1;
+    stats->target_table_entries += entries;
+    stats->indirect_targets += entries;
+}
+
+void telemetry_measure_nodes(telemetry_cfg* stats, cfg_node** nodes, uint64_t count) {
+    stats->nodes += count;
+
+    for (uint64_t index = 0; index < count; index++) {
+        cfg_node* node = nodes[index];
+
+        for (cfg_edge* edge = node->edges; edge != NULL; edge = edge->next) {
+            if (edge->node != NULL) {
+                stats->edges++;
+            }
+        }
+
+        if (node->targets != NULL) {
+            uint64_t targets = stats->indirect_targets;
+
+            stats->indirect_sites++;
+            measure_targets(stats, node->targets);
+            stats->edges += stats->indirect_targets - targets;
+        }
+    }
+}
+
+void telemetry_measure_index(telemetry_cfg* stats, cfg_index* index) {
+    uint64_t total, max;
+
+    cfg_index_probe_lengths(index, &total, &max);
+
+    stats->index_slots += index->mask + 1;
+    stats->index_probe_total += total;
+    if (max > stats->index_probe_max) {
+        stats->index_probe_max = max;
+    }
+    stats->index_bytes += (index->mask + 1) * sizeof(cfg_index_entry) + index->capacity * sizeof(cfg_node *);
+    if (index->old_entries != NULL) {
+        stats->index_bytes += (index->old_mask + 1) * sizeof(cfg_index_entry);
+    }
+}
+
+void telemetry_add_thread(telemetry* telemetry, telemetry_thread* thread) {
+    if (telemetry->thread_count == telemetry->thread_capacity) {
+        uint64_t capacity = telemetry->thread_capacity ? 2 * telemetry->thread_capacity : 32;
+        telemetry_thread* threads = (telemetry_thread *) realloc(telemetry->threads,
+                                                                 capacity * sizeof(telemetry_thread));
+        if (threads == NULL) {
+            fprintf(stderr, "mclift: Couldn't allocate the telemetry of threads!\n");
+            exit(-1);
+        }
+        telemetry->threads = threads;
+        telemetry->thread_capacity = capacity;
+    }
+
+    telemetry->threads[telemetry->thread_count++] = *thread;
+}
+
+static double to_seconds(uint64_t ticks) {
+    return (double) ticks / (double) get_virtual_counter_frequency();
+}
+
+static void write_cfg(FILE* file, telemetry_cfg* stats, const char* indent) {
+    fprintf(file, "{\n"
+            "%s  \"nodes\": %lu,\n"
+            "%s  \"edges\": %lu,\n"
+            "%s  \"indirect_sites\": %lu,\n"
+            "%s  \"indirect_targets\": %lu,\n"
+            "%s  \"target_tables\": %lu,\n"
+            "%s  \"target_slots\": %lu,\n"
+            "%s  \"target_table_entries\": %lu,\n"
+            "%s  \"target_probe_total\": %lu,\n"
+            "%s  \"target_probe_max\": %lu,\n"
+            "%s  \"target_bytes\": %lu,\n"
+            "%s  \"index_slots\": %lu,\n"
+            "%s  \"index_probe_total\": %lu,\n"
+            "%s  \"index_probe_max\": %lu,\n"
+            "%s  \"index_bytes\": %lu\n"
+            "%s}",
+            indent, stats->nodes, indent, stats->edges, indent, stats->indirect_sites, indent,
+            stats->indirect_targets, indent, stats->target_tables, indent, stats->target_slots, indent,
+            stats->target_table_entries, indent, stats->target_probe_total, indent, stats->target_probe_max, indent,
+            stats->target_bytes, indent, stats->index_slots, indent, stats->index_probe_total, indent,
+            stats->index_probe_max, indent, stats->index_bytes, indent);
+}
+
+void telemetry_write(telemetry* telemetry, telemetry_cfg* global, const char* trace_path) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s.json", trace_path);
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "mclift: Couldn't open %s: %s!\n", path, strerror(errno));
+        return;
+    }
+
+    uint64_t totals[TELEMETRY_THREAD_PHASES] = {0};
+    uint64_t branches = 0;
+    uint64_t rescans = 0;
+    uint64_t arena_bytes = 0;
+
+    for (uint64_t idx = 0; idx < telemetry->thread_count; idx++) {
+        for (int phase = 0; phase < TELEMETRY_THREAD_PHASES; phase++) {
+            totals[phase] += telemetry->threads[idx].time[phase];
+        }
+        branches += telemetry->threads[idx].branches;
+        rescans += telemetry->threads[idx].rescans;
+        arena_bytes += telemetry->threads[idx].arena_bytes;
+    }
+
+    fprintf(file, "{\n  \"trace\": \"%s\",\n  \"thread_count\": %lu,\n  \"phases\": {\n", trace_path,
+            telemetry->thread_count);
+    fprintf(file, "    \"execution\": %lf,\n", to_seconds(get_virtual_counter() - telemetry->start));
+    for (int phase = 0; phase < TELEMETRY_THREAD_PHASES; phase++) {
+        fprintf(file, "    \"%s\": %lf,\n", phase_names[phase], to_seconds(totals[phase]));
+    }
+    fprintf(file, "    \"exit\": %lf,\n    \"write\": %lf\n  },\n", to_seconds(telemetry->exit_time),
+            to_seconds(telemetry->write_time));
+
+    fprintf(file, "  \"branches\": %lu,\n  \"rescans\": %lu,\n  \"arena_bytes\": %lu,\n  \"cfg\": ", branches, rescans,
+            arena_bytes);
+    write_cfg(file, global, "  ");
+
+    fprintf(file, ",\n  \"threads\": [");
+    for (uint64_t idx = 0; idx < telemetry->thread_count; idx++) {
+        telemetry_thread* thread = &telemetry->threads[idx];
+
+        fprintf(file, "%s\n    {\n      \"thread_id\": %d,\n", idx > 0 ? "," : "", thread->thread_id);
+        for (int phase = 0; phase < TELEMETRY_THREAD_PHASES; phase++) {
+            fprintf(file, "      \"%s\": %lf,\n", phase_names[phase], to_seconds(thread->time[phase]));
+        }
+        fprintf(file, "      \"branches\": %lu,\n      \"rescans\": %lu,\n      \"arena_bytes\": %lu,\n"
+                "      \"cfg\": ", thread->branches, thread->rescans, thread->arena_bytes);
+        write_cfg(file, &thread->cfg, "      ");
+        fprintf(file, "\n    }");
+    }
+    fprintf(file, "\n  ]\n}\n");
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "mclift: Couldn't write %s: %s!\n", path, strerror(errno));
+    }
+
+    free(telemetry->threads);
+    telemetry->threads = NULL;
+}
+
+#endif
@@ -0,0 +1,150 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "aarch64_utils.h"
+#include "arena.h"
+#include "cfg.h"
+#include "cfg_index.h"
+#include "config.h"
+
+// ENUMS
+
+/*
+    Phases of the plugin timed on every thread.
+*/
+typedef enum {
+    TELEMETRY_THREAD_INIT, // Set up of the thread data (lift_pre_thread_cb).
+    TELEMETRY_SCAN, // Instrumentation of the branches at scan time (lift_pre_inst_cb).
+    TELEMETRY_MERGE, // Merge of the thread CFG into the global CFG, including waiting for locks (lift_post_thread_cb).
+    TELEMETRY_MERGE_WAIT, // Part of the merge spent blocked on the locks of the shards.
+    TELEMETRY_THREAD_PHASES
+} telemetry_phase;
+
+// STRUCTS
+
+/*
+    Size and shape of a CFG: nodes, edges, targets of the indirect branches and the occupancy of the hash tables.
+    Probe lengths are the number of slots (buckets for the tables of targets) visited to find an existing key,
+    accumulated over all keys.
+*/
+typedef struct {
+    uint64_t nodes; // Number of nodes.
+    uint64_t edges; // Number of edges with a known target, including targets of indirect branches.
+    uint64_t indirect_sites; // Number of nodes ending in an indirect branch.
+    uint64_t indirect_targets; // Number of targets of indirect branches (inline slots and tables).
+    uint64_t target_tables; // Number of indirect branches that allocated a table of targets.
+    uint64_t target_slots; // Total number of slots of the tables of targets.
+    uint64_t target_table_entries; // Number of targets stored in the tables.
+    uint64_t target_probe_total; // Sum of the probe lengths of the targets stored in the tables.
+    uint64_t target_probe_max; // Longest probe of a target stored in a table.
+    uint64_t target_bytes; // Memory used by the targets, including the tables.
+    uint64_t index_slots; // Number of slots of the CFG index.
+    uint64_t index_probe_total; // Sum of the probe lengths of the blocks in the index.
+    uint64_t index_probe_max; // Longest probe of a block in the index.
+    uint64_t index_bytes; // Memory used by the index.
+} telemetry_cfg;
+
+/*
+    Measurements of a single thread. Only the thread itself updates them, so no synchronization is needed until the
+    thread exits and its record is added to the global telemetry.
+*/
+typedef struct {
+    int thread_id; // MAMBO id of the thread.
+    uint64_t time[TELEMETRY_THREAD_PHASES]; // Ticks of the virtual counter spent in every phase.
+    uint64_t branches; // Number of branches (and SVC/BRK instructions) instrumented at scan time.
+    uint64_t rescans; // Number of branches scanned again as a part of a MAMBO trace.
+    uint64_t arena_bytes; // Memory allocated by the arena of the thread.
+    telemetry_cfg cfg; // CFG of the thread just before the merge.
+} telemetry_thread;
+
+/*
+    Global telemetry. Records of the threads are added when they exit.
+*/
+typedef struct {
+    uint64_t start; // Value of the virtual counter when the plugin was initialized.
+    uint64_t exit_time; // Ticks spent in lift_exit_cb before writing the trace.
+    uint64_t write_time; // Ticks spent writing the trace (or flushing the journals with STREAMING_WRITER).
+    telemetry_thread* threads; // Records of the exited threads.
+    uint64_t thread_count; // Number of records.
+    uint64_t thread_capacity; // Number of records allocated.
+} telemetry;
+
+// FUNCTIONS
+
+/**
+ * Initialize the global telemetry and start measuring the execution.
+ *
+ * @param telemetry Telemetry to be initialized.
+ */
+void telemetry_init(telemetry* telemetry);
+
+/**
+ * Initialize the record of a new thread.
+ *
+ * @param thread Record to be initialized.
+ * @param thread_id MAMBO id of the thread.
+ */
+void telemetry_thread_init(telemetry_thread* thread, int thread_id);
+
+/**
+ * Add the time elapsed since start to the phase.
+ *
+ * @param thread Record of the current thread.
+ * @param phase Measured phase.
+ * @param start Value of the virtual counter at the beginning of the phase.
+ */
+static inline void telemetry_add_time(telemetry_thread* thread, telemetry_phase phase, uint64_t start) {
+    thread->time[phase] += get_virtual_counter() - start;
+}
+
+/**
+ * Measure the CFG and add the results to stats.
+ *
+ * @param stats Accumulated statistics.
+ * @param nodes Nodes of the CFG.
+ * @param count Number of nodes.
+ */
+void telemetry_measure_nodes(telemetry_cfg* stats, cfg_node** nodes, uint64_t count);
+
+/**
+ * Measure the occupancy of the index and add the results to stats.
+ *
+ * @param stats Accumulated statistics.
+ * @param index Index of the CFG.
+ */
+void telemetry_measure_index(telemetry_cfg* stats, cfg_index* index);
+
+/**
+ * Add the record of the exited thread to the global telemetry. The caller has to serialize the calls.
+ *
+ * @param telemetry Global telemetry.
+ * @param thread Record of the thread (copied).
+ */
+void telemetry_add_thread(telemetry* telemetry, telemetry_thread* thread);
+
+/**
+ * Save the telemetry as JSON to <trace_path>.json.
+ *
+ * @param telemetry Global telemetry.
+ * @param global Statistics of the global CFG.
+ * @param trace_path Path of the trace the telemetry belongs to.
+ */
+void telemetry_write(telemetry* telemetry, telemetry_cfg* global, const char* trace_path);
@@ -0,0 +1,538 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Warm start from the trace of a previous run (see WARM_START). The trace is decoded when the plugin is initialized,
+    before any thread runs, so all the memory except for the nodes merged into the CFG is allocated with malloc.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "warm_start.h"
+
+#ifdef WARM_START
+
+#include "mtrace_format.h"
+
+// CONSTANTS
+
+/*
+    Maximum number of edges of a node that are not targets of an indirect branch (the two directions of a conditional
+    branch).
+*/
+#define WARM_MAX_NODE_EDGES 2
+
+// FUNCTIONS
+
+static inline int read_varint(const uint8_t** position, const uint8_t* end, uint64_t* value) {
+    size_t size = mtrace_get_varint(*position, end, value);
+    *position += size;
+    return size != 0;
+}
+
+/*
+    Decode the module table of the trace. Returns 0 if the table is malformed.
+*/
+static int load_modules(warm_start* warm, const uint8_t** position, const uint8_t* end) {
+    uint64_t count;
+
+    if (!read_varint(position, end, &count) || count > (uint64_t) (end - *position)) {
+        return 0;
+    }
+
+    warm->modules = (warm_module *) calloc(count + 1, sizeof(warm_module));
+    if (warm->modules == NULL) {
+        return 0;
+    }
+    warm->module_count = count;
+
+    for (uint64_t id = 0; id < count; id++) {
+        warm_module* module = &warm->modules[id];
+        uint64_t base, size, path_size, build_id_size;
+
+        if (!read_varint(position, end, &base) || !read_varint(position, end, &size)
+            || !read_varint(position, end, &path_size) || path_size > (uint64_t) (end - *position)) {
+            return 0;
+        }
+
+        module->id = id;
+        module->path = (const char *) *position;
+        module->path_size = path_size;
+        *position += path_size;
+
+        if (!read_varint(position, end, &build_id_size) || build_id_size > (uint64_t) (end - *position)) {
+            return 0;
+        }
+
+        module->build_id = *position;
+        module->build_id_size = build_id_size;
+        *position += build_id_size;
+    }
+
+    return 1;
+}
+
+/*
+    Skip the edges of the node. Returns 0 if the edges are truncated.
+*/
+static int skip_edges(warm_start* warm, const uint8_t** position, uint64_t edge_count) {
+    uint64_t fields = (warm->flags & MTRACE_FLAG_EXEC_COUNTS) ? 3 : 2;
+    uint64_t value;
+
+    for (uint64_t idx = 0; idx < fields * edge_count; idx++) {
+        if (!read_varint(position, warm->nodes_end, &value)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+    Decode all the nodes of the trace. Returns 0 if the nodes are malformed.
+*/
+static int load_nodes(warm_start* warm, const uint8_t* position, uint64_t node_count) {
+    // Every node takes at least 5 bytes, which bounds the allocation for malformed counts.
+    if (node_count > (uint64_t) (warm->nodes_end - position) / 5) {
+        return 0;
+    }
+
+    warm->nodes = (warm_node *) malloc((node_count + 1) * sizeof(warm_node));
+    if (warm->nodes == NULL) {
+        return 0;
+    }
+
+    uint64_t previous_start = 0;
+
+    for (uint64_t idx = 0; idx < node_count; idx++) {
+        warm_node* node = &warm->nodes[idx];
+        uint64_t start, type, branch_reg;
+
+        node->order_id = UINT64_MAX;
+        node->exec_count = 0;
+
+        if (!read_varint(&position, warm->nodes_end, &start) || !read_varint(&position, warm->nodes_end, &node->size)
+            || !read_varint(&position, warm->nodes_end, &type)
+            || !read_varint(&position, warm->nodes_end, &branch_reg)
+            || ((warm->flags & MTRACE_FLAG_ORDER) && !read_varint(&position, warm->nodes_end, &node->order_id))
+            || ((warm->flags & MTRACE_FLAG_EXEC_COUNTS)
+                && !read_varint(&position, warm->nodes_end, &node->exec_count))
+            || !read_varint(&position, warm->nodes_end, &node->edge_count)) {
+            return 0;
+        }
+
+        if (idx % MTRACE_INDEX_INTERVAL != 0) {
+            start += previous_start;
+        }
+
+        // Nodes are sorted by the start address, which warm_start_find relies on.
+        if (idx > 0 && start <= previous_start) {
+            return 0;
+        }
+
+        node->start = start;
+        node->type = (uint32_t) type;
+        node->branch_reg = (uint32_t) (branch_reg - 1);
+        node->edges = position;
+
+        if (!skip_edges(warm, &position, node->edge_count)) {
+            return 0;
+        }
+
+        if (node->order_id != UINT64_MAX && node->order_id >= warm->next_order_id) {
+            warm->next_order_id = node->order_id + 1;
+        }
+
+        previous_start = start;
+    }
+
+    warm->node_count = node_count;
+
+    return 1;
+}
+
+int warm_start_load(warm_start* warm, const char* path) {
+    memset(warm, 0, sizeof(*warm));
+    arena_init(&warm->arena);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    if (info.st_size < (off_t) sizeof(mtrace_header)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+
+    warm->data = (const uint8_t *) data;
+    warm->size = info.st_size;
+
+    mtrace_header header;
+    memcpy(&header, warm->data, sizeof(header));
+
+    // Version 1 traces don't carry the order ids and journals have no index, so both have to be converted first.
+    if (header.magic != MTRACE_MAGIC || (header.flags & MTRACE_FLAG_JOURNAL)) {
+        warm_start_destroy(warm);
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    if (header.version != MTRACE_VERSION || header.index_offset < sizeof(header) || header.index_offset > warm->size
+        || ((header.flags & MTRACE_FLAG_THREADS)
+            && (header.threads_offset < sizeof(header) || header.threads_offset > warm->size))) {
+        warm_start_destroy(warm);
+        errno = EINVAL;
+        return -1;
+    }
+
+    const uint8_t* position = warm->data + sizeof(header);
+
+    warm->flags = header.flags;
+    warm->nodes_end = warm->data + header.index_offset;
+    if (header.flags & MTRACE_FLAG_THREADS) {
+        warm->threads = warm->data + header.threads_offset;
+    }
+
+    int valid;
+    if (header.flags & MTRACE_FLAG_MODULES) {
+        valid = load_modules(warm, &position, warm->nodes_end);
+    } else {
+        // Addresses are offsets from the base of the traced binary, i.e., all of them are in module 0.
+        warm->modules = (warm_module *) calloc(1, sizeof(warm_module));
+        warm->module_count = 1;
+        valid = warm->modules != NULL;
+    }
+
+    if (!valid || !load_nodes(warm, position, header.node_count)) {
+        warm_start_destroy(warm);
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void warm_start_destroy(warm_start* warm) {
+    free(warm->nodes);
+    free(warm->modules);
+    if (warm->data != NULL) {
+        munmap((void *) warm->data, warm->size);
+    }
+
+    warm->nodes = NULL;
+    warm->node_count = 0;
+    warm->modules = NULL;
+    warm->module_count = 0;
+    warm->data = NULL;
+}
+
+static bool same_build(warm_module* known, trace_module* module) {
+    if (known->build_id_size == 0 || module->build_id_size == 0) {
+        return true;
+    }
+
+    return known->build_id_size == module->build_id_size
+           && memcmp(known->build_id, module->build_id, known->build_id_size) == 0;
+}
+
+void warm_start_match(warm_start* warm, trace_module* module) {
+    warm_module* match = NULL;
+
+    if (module->id == 0) {
+        match = warm->module_count > 0 ? &warm->modules[0] : NULL;
+
+        if (match != NULL && !same_build(match, module)) {
+            fprintf(stderr, "mclift: The warm-start trace was saved for a different build of %s, ignoring it!\n",
+                    module->path);
+            return;
+        }
+    } else if (module->path[0] != '\0') {
+        size_t path_size = strlen(module->path);
+
+        for (uint64_t id = 1; id < warm->module_count; id++) {
+            warm_module* known = &warm->modules[id];
+
+            if (known->path_size != path_size || memcmp(known->path, module->path, path_size) != 0
+                || !same_build(known, module)) {
+                continue;
+            }
+
+            // A module loaded again (e.g., after dlclose) takes over the module of the trace only if no other one
+            // matches.
+            if (match == NULL || (match->current != NULL && known->current == NULL)) {
+                match = known;
+            }
+        }
+    }
+
+    if (match != NULL) {
+        module->warm = match;
+        __atomic_store_n(&match->current, module, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+    Translate the address of the trace to the address in this run. Returns 0 if the module of the address is not
+    mapped (yet).
+*/
+static uintptr_t translate_addr(warm_start* warm, uint64_t addr) {
+    uint64_t id = mtrace_module_id(addr);
+    uint64_t offset = mtrace_module_offset(addr);
+
+    if (id >= warm->module_count) {
+        return 0;
+    }
+
+    trace_module* module = __atomic_load_n(&warm->modules[id].current, __ATOMIC_ACQUIRE);
+    if (module == NULL || offset >= module->size) {
+        return 0;
+    }
+
+    return module->base + offset;
+}
+
+warm_node* warm_start_find(warm_start* warm, trace_module* module, uintptr_t addr) {
+    if (module == NULL || module->warm == NULL) {
+        return NULL;
+    }
+
+    uint64_t key = mtrace_module_addr(module->warm->id, addr - module->base);
+    uint64_t low = 0;
+    uint64_t high = warm->node_count;
+
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+
+        if (warm->nodes[middle].start < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low < warm->node_count && warm->nodes[low].start == key) {
+        return &warm->nodes[low];
+    }
+
+    return NULL;
+}
+
+/*
+    Decode the edges of the node and call the callback for every edge. Targets are translated to this run, 0 if their
+    module is not mapped.
+*/
+static void for_each_edge(warm_start* warm, warm_node* node, void (*callback)(void* arg, uintptr_t target,
+                          uint32_t type, uint64_t exec_count), void* arg) {
+    const uint8_t* position = node->edges;
+    uint64_t target = node->start;
+
+    for (uint64_t idx = 0; idx < node->edge_count; idx++) {
+        uint64_t delta, type, exec_count = 0;
+
+        // The edges were validated by load_nodes.
+        read_varint(&position, warm->nodes_end, &delta);
+        read_varint(&position, warm->nodes_end, &type);
+        if (warm->flags & MTRACE_FLAG_EXEC_COUNTS) {
+            read_varint(&position, warm->nodes_end, &exec_count);
+        }
+
+        target = idx == 0 ? node->start + (uint64_t) mtrace_zigzag_decode(delta) : target + delta;
+
+        callback(arg, translate_addr(warm, target), (uint32_t) type, exec_count);
+    }
+}
+
+static inline bool is_indirect(uint32_t type) {
+    return (type & (CFG_INDIRECT_BLOCK | CFG_RETURN)) != 0;
+}
+
+typedef struct {
+    cfg_targets* targets; // Targets the known targets are added to.
+    bool complete; // Whether all the known targets were translated.
+    uint64_t added; // Number of targets added.
+} seed_state;
+
+static void seed_target(void* arg, uintptr_t target, uint32_t type, uint64_t exec_count) {
+    seed_state* state = (seed_state *) arg;
+
+    if (type != CFG_EDGE_NOTYPE) {
+        return;
+    }
+
+    if (target == 0) {
+        state->complete = false;
+        return;
+    }
+
+    cfg_targets_add(state->targets, target);
+    state->added++;
+}
+
+bool warm_start_seed(warm_start* warm, warm_node* node, cfg_targets* targets) {
+    seed_state state = {targets, true, 0};
+
+    if (!is_indirect(node->type)) {
+        return false;
+    }
+
+    for_each_edge(warm, node, seed_target, &state);
+
+    if (state.added == 0) {
+        return false;
+    }
+
+    __atomic_fetch_add(&warm->seeded_sites, 1, __ATOMIC_RELAXED);
+    if (state.complete) {
+        __atomic_fetch_add(&warm->complete_sites, 1, __ATOMIC_RELAXED);
+    }
+
+    return state.complete;
+}
+
+typedef struct {
+    mambo_context* ctx;
+    warm_start* warm;
+    cfg_node* node; // Node the edges are added to.
+    int edge_count; // Number of edges of the node that are not targets.
+} build_state;
+
+static void build_edge(void* arg, uintptr_t target, uint32_t type, uint64_t exec_count) {
+    build_state* state = (build_state *) arg;
+    cfg_node* node = state->node;
+
+    if (target == 0) {
+        return;
+    }
+
+    if (is_indirect(node->type) && type == CFG_EDGE_NOTYPE) {
+        if (node->targets == NULL) {
+            node->targets = (cfg_targets *) arena_alloc(state->ctx, &state->warm->arena, sizeof(cfg_targets));
+            if (node->targets == NULL) {
+                fprintf(stderr, "mclift: Couldn't allocate the warm-start targets!\n");
+                exit(-1);
+            }
+            initialize_targets(node->targets);
+        }
+
+        cfg_targets_add(node->targets, target);
+        return;
+    }
+
+    if (state->edge_count == WARM_MAX_NODE_EDGES) {
+        return;
+    }
+
+    cfg_edge* edge = (cfg_edge *) arena_alloc(state->ctx, &state->warm->arena, sizeof(cfg_edge));
+    if (edge == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the warm-start edge!\n");
+        exit(-1);
+    }
+
+    initialize_edge(edge, (cfg_edge_type) type);
+    edge->node = (cfg_node *) target;
+    edge->exec_count = exec_count;
+    edge->next = node->edges;
+    node->edges = edge;
+    state->edge_count++;
+}
+
+uint64_t warm_start_build_nodes(mambo_context* ctx, warm_start* warm, cfg_node** nodes) {
+    uint64_t count = 0;
+
+    for (uint64_t idx = 0; idx < warm->node_count; idx++) {
+        warm_node* known = &warm->nodes[idx];
+        uintptr_t start = translate_addr(warm, known->start);
+
+        // Blocks of modules not mapped in this run are dropped.
+        if (start == 0) {
+            continue;
+        }
+
+        cfg_node* node = (cfg_node *) arena_alloc(ctx, &warm->arena, sizeof(cfg_node));
+        if (node == NULL) {
+            fprintf(stderr, "mclift: Couldn't allocate the warm-start node!\n");
+            exit(-1);
+        }
+
+        initialize_node(node);
+        node->start_addr = (void *) start;
+        node->end_addr = (void *) (start + known->size);
+        node->type = (cfg_node_type) known->type;
+        node->branch_reg = known->branch_reg;
+        node->order_id = known->order_id;
+        node->exec_count = known->exec_count;
+
+        build_state state = {ctx, warm, node, 0};
+        for_each_edge(warm, known, build_edge, &state);
+
+        nodes[count++] = node;
+    }
+
+    return count;
+}
+
+void warm_start_threads(warm_start* warm, void (*callback)(void* arg, void* entry_addr, void* call_site), void* arg) {
+    if (warm->threads == NULL) {
+        return;
+    }
+
+    const uint8_t* position = warm->threads;
+    const uint8_t* end = warm->data + warm->size;
+    uint64_t count;
+
+    if (!read_varint(&position, end, &count)) {
+        return;
+    }
+
+    for (uint64_t idx = 0; idx < count; idx++) {
+        uint64_t entry_addr, call_site;
+
+        if (!read_varint(&position, end, &entry_addr) || !read_varint(&position, end, &call_site)) {
+            return;
+        }
+
+        uintptr_t entry = translate_addr(warm, entry_addr);
+        uintptr_t call = translate_addr(warm, call_site);
+
+        if (entry != 0 && call != 0) {
+            callback(arg, (void *) entry, (void *) call);
+        }
+    }
+}
+
+#endif
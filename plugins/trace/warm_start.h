@@ -0,0 +1,163 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../../plugins.h"
+
+#include "arena.h"
+#include "cfg.h"
+#include "config.h"
+#include "modules.h"
+
+#ifdef WARM_START
+
+// TYPEDEFS
+
+struct warm_node;
+typedef struct warm_node warm_node;
+
+struct warm_module;
+typedef struct warm_module warm_module;
+
+struct warm_start;
+typedef struct warm_start warm_start;
+
+// STRUCTS
+
+/*
+    Node of the warm-start trace. Addresses are encoded as in the trace, i.e., as (module id, offset).
+*/
+struct warm_node {
+    uint64_t start; // Start address of the block.
+    uint64_t size; // Offset of the last instruction of the block from its start.
+    uint32_t type; // Bitmask of cfg_node_type.
+    uint32_t branch_reg; // Register used by the indirect branch or UINT32_MAX if none.
+    uint64_t order_id; // Order of the first execution of the block.
+    uint64_t exec_count; // Number of executions (0 unless the trace has MTRACE_FLAG_EXEC_COUNTS).
+    uint64_t edge_count; // Number of edges.
+    const uint8_t* edges; // Encoded edges of the node within the mapped trace.
+};
+
+/*
+    Module of the warm-start trace. Traces without MTRACE_FLAG_MODULES have a single module for the traced binary.
+*/
+struct warm_module {
+    uint64_t id; // Id of the module in the warm-start trace.
+    const char* path; // Path of the module (not NUL-terminated), empty for anonymous code.
+    size_t path_size; // Length of the path.
+    const uint8_t* build_id; // GNU build-id of the module.
+    size_t build_id_size; // Size of the build-id, 0 if unknown.
+    trace_module* current; // The same module in this run, NULL until it is mapped (published atomically).
+};
+
+/*
+    CFG of a previous run of the same binary, loaded when the plugin is initialized. Blocks are translated to the
+    addresses of this run as their modules are mapped, so they survive ASLR and different load orders of libraries.
+*/
+struct warm_start {
+    const uint8_t* data; // Mapped trace.
+    size_t size; // Size of the mapped trace.
+    uint16_t flags; // Flags of the trace (MTRACE_FLAG_*).
+    const uint8_t* nodes_end; // First byte after the nodes section.
+    const uint8_t* threads; // Thread spawns (only with MTRACE_FLAG_THREADS).
+    warm_module* modules; // Modules indexed by their ids in the trace.
+    uint64_t module_count; // Number of modules.
+    warm_node* nodes; // Nodes sorted by the start address.
+    uint64_t node_count; // Number of nodes.
+    uint64_t next_order_id; // First order id not used by the trace, new blocks are ordered after the known ones.
+    cfg_arena arena; // Allocator of the nodes merged into the CFG at exit.
+    uint64_t seeded_sites; // Indirect branches that started with known targets.
+    uint64_t complete_sites; // Indirect branches all the known targets of which were mapped when seeded.
+};
+
+// FUNCTIONS
+
+/**
+ * Map the warm-start trace and decode its nodes. Only uncompressed version 2 traces (written by the plugin,
+ * mtrace-compact or mtrace-merge) are supported.
+ *
+ * @param warm Warm start to be initialized.
+ * @param path Path of the trace.
+ * @return 0 on success, -1 on failure (errno is ENOENT if the trace doesn't exist and EINVAL or ENOTSUP if it is
+ *         malformed or in an unsupported format).
+ */
+int warm_start_load(warm_start* warm, const char* path);
+
+/**
+ * Release the decoded nodes and unmap the trace. The nodes merged into the CFG are not released.
+ *
+ * @param warm Loaded warm start.
+ */
+void warm_start_destroy(warm_start* warm);
+
+/**
+ * Match the module mapped in this run against the modules of the trace. The traced binary matches the binary of the
+ * trace, other modules match by the path. Modules with different build-ids never match. Called by the module table
+ * with its lock held, before the module is published.
+ *
+ * @param warm Loaded warm start.
+ * @param module New module.
+ */
+void warm_start_match(warm_start* warm, trace_module* module);
+
+/**
+ * Find the node of the trace starting at the address.
+ *
+ * @param warm Loaded warm start.
+ * @param module Module containing the address (see module_table_resolve), may be NULL.
+ * @param addr Start address of the block in this run.
+ * @return The node or NULL if the block is not in the trace.
+ */
+warm_node* warm_start_find(warm_start* warm, trace_module* module, uintptr_t addr);
+
+/**
+ * Add the known targets of the indirect branch ending the node to the targets of the branch in this run. Targets in
+ * modules not mapped yet are skipped.
+ *
+ * @param warm Loaded warm start.
+ * @param node Node of the trace.
+ * @param targets Targets of the branch.
+ * @return Whether all the known targets were added, i.e., the branch only needs to be guarded.
+ */
+bool warm_start_seed(warm_start* warm, warm_node* node, cfg_targets* targets);
+
+/**
+ * Build CFG nodes of all the nodes of the trace whose modules were mapped in this run. The nodes can be merged into
+ * the CFG with merge_nodes.
+ *
+ * @param ctx Mambo context of the plugin.
+ * @param warm Loaded warm start.
+ * @param nodes Output array of at least node_count nodes.
+ * @return Number of nodes built.
+ */
+uint64_t warm_start_build_nodes(mambo_context* ctx, warm_start* warm, cfg_node** nodes);
+
+/**
+ * Translate the thread spawns of the trace whose modules were mapped in this run.
+ *
+ * @param warm Loaded warm start.
+ * @param callback Called for every translated thread spawn.
+ * @param arg Argument passed to the callback.
+ */
+void warm_start_threads(warm_start* warm, void (*callback)(void* arg, void* entry_addr, void* call_site), void* arg);
+
+#endif
@@ -16,50 +16,489 @@
 */
 
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "compressor.h"
+#include "modules.h"
+#include "mtrace_format.h"
 #include "writer.h"
 
-void write_trace(mambo_context* ctx, mambo_ht_t* cfg, void* main_addr, lift_thread_metadata threads[NUMBER_THREAD_ENTRIES]) {
-    time_t timestamp = time(NULL);
-    char tracename[128];
+#include "aarch64_utils.h"
 
-    sprintf(tracename, "%ld.mtrace", (long) timestamp);
+// CONSTANTS
 
-    FILE *trace = fopen(tracename, "wb");
+/*
+    Maximum number of edges of a single node: all the indirect targets (the table is at most half full) and the edges
+    stored in the linked list.
+*/
+#define MAX_NODE_EDGES (CFG_INLINE_TARGETS + CFG_TARGETS_MAX_CAPACITY / 2 + 2)
+
+// STRUCTS
+
+/*
+    Output buffer of the trace. All fields are encoded into the buffer and it is only written to the file once full,
+    so the whole trace is saved with a handful of large writes instead of several small writes per node.
+*/
+typedef struct {
+    int fd; // File descriptor of the trace.
+    uint8_t* data; // Encoded data not yet written to the file.
+    size_t used; // Number of bytes used in data.
+    uint64_t written; // Total number of bytes written to the file (before compression).
+#ifdef COMPRESSED_OUTPUT
+    trace_compressor compressor; // Compression thread the full buffers are handed over to.
+#endif
+} trace_buffer;
+
+/*
+    Edge of the node gathered from either the linked list of edges or the set of indirect targets.
+*/
+typedef struct {
+    uintptr_t target; // Target address of the edge (encoded against the modules in version 2).
+    cfg_edge_type type; // Type of the edge.
+    uint64_t exec_count; // Number of times the edge was followed.
+} trace_edge;
+
+/*
+    Node together with its encoded start address, so the nodes are sorted without looking the modules up repeatedly.
+*/
+typedef struct {
+    uint64_t start; // Start address of the node encoded against the modules.
+    cfg_node* node; // The node.
+} trace_node;
+
+// FUNCTIONS
+
+void write_all(int fd, const uint8_t* data, size_t size) {
+    size_t offset = 0;
+
+    while (offset < size) {
+        ssize_t ret = write(fd, data + offset, size - offset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "mclift: Couldn't write the trace: %s!\n", strerror(errno));
+            exit(-1);
+        }
+        offset += ret;
+    }
+}
+
+static void trace_buffer_flush(trace_buffer* buffer) {
+#ifdef COMPRESSED_OUTPUT
+    buffer->data = trace_compressor_submit(&buffer->compressor, buffer->data, buffer->used);
+#else
+    write_all(buffer->fd, buffer->data, buffer->used);
+#endif
+
+    buffer->written += buffer->used;
+    buffer->used = 0;
+}
+
+static inline void trace_buffer_put(trace_buffer* buffer, const void* data, size_t size) {
+    if (buffer->used + size > TRACE_BUFFER_SIZE) {
+        trace_buffer_flush(buffer);
+
+        // Data that doesn't fit into the buffer (e.g., the index) is written directly.
+        if (size > TRACE_BUFFER_SIZE) {
+#ifdef COMPRESSED_OUTPUT
+            // Chunks can't be larger than the buffer, so the data is split instead.
+            while (size > TRACE_BUFFER_SIZE) {
+                memcpy(buffer->data, data, TRACE_BUFFER_SIZE);
+                buffer->used = TRACE_BUFFER_SIZE;
+                trace_buffer_flush(buffer);
+
+                data = (const uint8_t *) data + TRACE_BUFFER_SIZE;
+                size -= TRACE_BUFFER_SIZE;
+            }
+#else
+            write_all(buffer->fd, (const uint8_t *) data, size);
+            buffer->written += size;
+            return;
+#endif
+        }
+    }
+
+    memcpy(buffer->data + buffer->used, data, size);
+    buffer->used += size;
+}
+
+static inline void trace_buffer_put_varint(trace_buffer* buffer, uint64_t value) {
+    if (buffer->used + MTRACE_MAX_VARINT_SIZE > TRACE_BUFFER_SIZE) {
+        trace_buffer_flush(buffer);
+    }
+
+    buffer->used += mtrace_put_varint(buffer->data + buffer->used, value);
+}
+
+static inline uintptr_t relative_addr(void* addr) {
+    return (uintptr_t) addr - global_data.base_addr;
+}
+
+static inline void trace_buffer_put_addr(trace_buffer* buffer, void* addr) {
+    uintptr_t addr_offset = relative_addr(addr);
+    trace_buffer_put(buffer, &addr_offset, sizeof(addr_offset));
+}
+
+static inline void trace_buffer_put_edge(trace_buffer* buffer, trace_edge* edge) {
+    trace_buffer_put_addr(buffer, (void *) edge->target);
+    trace_buffer_put(buffer, &edge->type, sizeof(edge->type));
+}
+
+/*
+    Store all the edges of the node that have a known target into edges and return their number. The array has to be
+    able to hold at least MAX_NODE_EDGES edges.
+*/
+static size_t collect_edges(cfg_node* node, trace_edge* edges) {
+    size_t count = 0;
+
+    if (node->targets != NULL) {
+        cfg_targets* targets = node->targets;
+
+        for (int idx = 0; idx < CFG_INLINE_TARGETS; idx++) {
+            if (targets->inline_targets[idx] != 0) {
+                edges[count].target = targets->inline_targets[idx];
+                edges[count].exec_count = 0;
+                edges[count++].type = CFG_EDGE_NOTYPE;
+            }
+        }
+
+        if (targets->table != NULL) {
+            for (uint64_t idx = 0; idx <= targets->mask; idx++) {
+                if (targets->table[idx] != 0) {
+                    edges[count].target = targets->table[idx];
+                    edges[count].exec_count = 0;
+                    edges[count++].type = CFG_EDGE_NOTYPE;
+                }
+            }
+        }
+    }
+
+    for (cfg_edge* edge = node->edges; edge != NULL; edge = edge->next) {
+        if (edge->node != NULL) {
+            edges[count].target = (uintptr_t) edge->node;
+            edges[count].exec_count = edge->exec_count;
+            edges[count++].type = edge->type;
+        }
+    }
+
+    return count;
+}
+
+static int compare_nodes(const void* lhs, const void* rhs) {
+    uint64_t lhs_addr = ((trace_node *) lhs)->start;
+    uint64_t rhs_addr = ((trace_node *) rhs)->start;
+
+    return (lhs_addr > rhs_addr) - (lhs_addr < rhs_addr);
+}
+
+static int compare_order(const void* lhs, const void* rhs) {
+    uint64_t lhs_order = (*(cfg_node **) lhs)->order_id;
+    uint64_t rhs_order = (*(cfg_node **) rhs)->order_id;
+
+    return (lhs_order > rhs_order) - (lhs_order < rhs_order);
+}
+
+static int compare_edges(const void* lhs, const void* rhs) {
+    uint64_t lhs_addr = ((trace_edge *) lhs)->target;
+    uint64_t rhs_addr = ((trace_edge *) rhs)->target;
+
+    return (lhs_addr > rhs_addr) - (lhs_addr < rhs_addr);
+}
+
+/*
+    Save the trace in the legacy (version 1) format. See mtrace_format.h. The format has no field for the order ids, so
+    nodes are saved in the order of their first execution instead.
+*/
+static void write_trace_v1(mambo_context* ctx, trace_buffer* buffer, cfg_node** cfg_nodes, uint64_t node_count,
+                           void* main_addr) {
+    // Always allocate at least one element, so empty traces don't need special handling.
+    cfg_node** nodes = (cfg_node **) mambo_alloc(ctx, sizeof(cfg_node *) * (node_count + 1));
+    trace_edge* edges = (trace_edge *) mambo_alloc(ctx, sizeof(trace_edge) * MAX_NODE_EDGES);
+    if (nodes == NULL || edges == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the edges buffer!\n");
+        exit(-1);
+    }
+
+    memcpy(nodes, cfg_nodes, sizeof(cfg_node *) * node_count);
+
+    qsort(nodes, node_count, sizeof(cfg_node *), compare_order);
+
+    trace_buffer_put_addr(buffer, main_addr);
+
+    const int64_t begin_node = MTRACE_V1_BEGIN_NODE;
+
+    for (uint64_t index = 0; index < node_count; index++) {
+        cfg_node *node = nodes[index];
+
+        trace_buffer_put(buffer, &begin_node, sizeof(begin_node));
 
-    uintptr_t main_relative_addr = (uintptr_t) main_addr - global_data.base_addr;
-    fwrite(&main_relative_addr, sizeof(main_addr), 1, trace);
+        trace_buffer_put_addr(buffer, node->start_addr);
+        trace_buffer_put_addr(buffer, node->end_addr);
+        trace_buffer_put(buffer, &node->branch_reg, sizeof(node->branch_reg));
+        trace_buffer_put(buffer, &node->type, sizeof(node->type));
 
-    for (int index = 0; index < cfg->size; index++) {
-        if (cfg->entries[index].key != 0) {
-            cfg_node *node = (cfg_node *) cfg->entries[index].value;
+        size_t edge_count = collect_edges(node, edges);
+        for (size_t idx = 0; idx < edge_count; idx++) {
+            trace_buffer_put_edge(buffer, &edges[idx]);
+        }
+    }
+
+    // The legacy format has no room for the thread information, it is only saved in version 2.
+
+    trace_buffer_flush(buffer);
+
+    mambo_free(ctx, edges);
+    mambo_free(ctx, nodes);
+}
 
-            int64_t begin_node = -1;
+/*
+    Store all the edges of the node into edges (see collect_edges) with their targets encoded against the modules.
+*/
+static size_t collect_encoded_edges(module_table* modules, cfg_node* node, trace_edge* edges) {
+    size_t count = collect_edges(node, edges);
 
-            fwrite(&begin_node, sizeof(int64_t), 1, trace);
+    for (size_t idx = 0; idx < count; idx++) {
+        edges[idx].target = module_table_encode(modules, edges[idx].target);
+    }
 
-            uintptr_t start_addr = (uintptr_t) node->start_addr - global_data.base_addr;
-            fwrite(&start_addr, sizeof(node->start_addr), 1, trace);
-            uintptr_t end_addr = (uintptr_t) node->end_addr - global_data.base_addr;
-            fwrite(&end_addr, sizeof(node->end_addr), 1, trace);
-            fwrite(&node->branch_reg, sizeof(node->branch_reg), 1, trace);
-            fwrite(&node->type, sizeof(node->type), 1, trace);
+    return count;
+}
 
-            cfg_edge* edge = node->edges;
-            while(edge != NULL) {
-                if(edge->node != NULL) {
-                    uintptr_t edge_addr = (uintptr_t) edge->node - global_data.base_addr;
-                    fwrite(&edge_addr, sizeof(edge->node), 1, trace);
-                    fwrite(&edge->type, sizeof(edge->type), 1, trace);
+/*
+    Add the modules of all the edge targets of the node to the table, without collecting the edges.
+*/
+static void resolve_edge_modules(module_table* modules, cfg_node* node) {
+    if (node->targets != NULL) {
+        cfg_targets* targets = node->targets;
+
+        for (int idx = 0; idx < CFG_INLINE_TARGETS; idx++) {
+            if (targets->inline_targets[idx] != 0) {
+                module_table_encode(modules, targets->inline_targets[idx]);
+            }
+        }
+
+        if (targets->table != NULL) {
+            for (uint64_t idx = 0; idx <= targets->mask; idx++) {
+                if (targets->table[idx] != 0) {
+                    module_table_encode(modules, targets->table[idx]);
                 }
-                edge = edge->next;
             }
         }
     }
 
-    // TODO: Save thread information to the file.
+    for (cfg_edge* edge = node->edges; edge != NULL; edge = edge->next) {
+        if (edge->node != NULL) {
+            module_table_encode(modules, (uintptr_t) edge->node);
+        }
+    }
+}
+
+/*
+    Save the trace in the compact (version 2) format. See mtrace_format.h.
+*/
+static void write_trace_v2(mambo_context* ctx, trace_buffer* buffer, cfg_node** cfg_nodes, uint64_t node_count,
+                           void* main_addr, lift_thread_registry* threads, module_table* modules) {
+    size_t index_count = (node_count + MTRACE_INDEX_INTERVAL - 1) / MTRACE_INDEX_INTERVAL;
+
+    // Always allocate at least one element, so empty traces don't need special handling.
+    trace_node* nodes = (trace_node *) mambo_alloc(ctx, sizeof(trace_node) * (node_count + 1));
+    uint64_t* node_index = (uint64_t *) mambo_alloc(ctx, sizeof(uint64_t) * (index_count + 1));
+    trace_edge* edges = (trace_edge *) mambo_alloc(ctx, sizeof(trace_edge) * MAX_NODE_EDGES);
+    uint8_t* module = (uint8_t *) mambo_alloc(ctx, MODULE_MAX_ENCODED_SIZE);
+    if (nodes == NULL || node_index == NULL || edges == NULL || module == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the trace index!\n");
+        exit(-1);
+    }
+
+    // The module table precedes the nodes, so all the modules have to be resolved before anything is written.
+    for (size_t idx = 0; idx < node_count; idx++) {
+        nodes[idx].start = module_table_encode(modules, (uintptr_t) cfg_nodes[idx]->start_addr);
+        nodes[idx].node = cfg_nodes[idx];
+
+        resolve_edge_modules(modules, cfg_nodes[idx]);
+    }
+
+    qsort(nodes, node_count, sizeof(trace_node), compare_nodes);
+
+    mtrace_header header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic = MTRACE_MAGIC;
+    header.version = MTRACE_VERSION;
+    header.base_addr = global_data.base_addr;
+    header.main_addr = module_table_encode(modules, (uintptr_t) main_addr);
+    header.node_count = node_count;
+    header.index_count = index_count;
+    header.flags |= MTRACE_FLAG_ORDER | MTRACE_FLAG_MODULES;
+#ifdef EXECUTION_COUNTERS
+    header.flags |= MTRACE_FLAG_EXEC_COUNTS;
+#endif
+
+    if (threads != NULL) {
+        for (uint64_t idx = 0; idx <= threads->mask; idx++) {
+            if (threads->entries[idx].entry_addr != NULL) {
+                module_table_encode(modules, (uintptr_t) threads->entries[idx].entry_addr);
+                module_table_encode(modules, (uintptr_t) threads->entries[idx].call_site);
+            }
+        }
+    }
+
+    // The header is rewritten once the offset of the index and the number of edges are known.
+    trace_buffer_put(buffer, &header, sizeof(header));
+
+    trace_buffer_put_varint(buffer, modules->count);
+    for (uint64_t id = 0; id < modules->count; id++) {
+        trace_buffer_put(buffer, module, module_encode(modules->modules[id], module, MODULE_MAX_ENCODED_SIZE));
+    }
+
+    uint64_t previous_start = 0;
+
+    for (size_t idx = 0; idx < node_count; idx++) {
+        cfg_node* node = nodes[idx].node;
+        uint64_t start_addr = nodes[idx].start;
+
+        if (idx % MTRACE_INDEX_INTERVAL == 0) {
+            node_index[idx / MTRACE_INDEX_INTERVAL] = buffer->written + buffer->used;
+            trace_buffer_put_varint(buffer, start_addr);
+        } else {
+            trace_buffer_put_varint(buffer, start_addr - previous_start);
+        }
+        previous_start = start_addr;
+
+        trace_buffer_put_varint(buffer, (uintptr_t) node->end_addr - (uintptr_t) node->start_addr);
+        trace_buffer_put_varint(buffer, node->type);
+        trace_buffer_put_varint(buffer, (uint32_t) (node->branch_reg + 1));
+        trace_buffer_put_varint(buffer, node->order_id);
+#ifdef EXECUTION_COUNTERS
+        trace_buffer_put_varint(buffer, node->exec_count);
+#endif
+
+        size_t edge_count = collect_encoded_edges(modules, node, edges);
+        qsort(edges, edge_count, sizeof(trace_edge), compare_edges);
+
+        trace_buffer_put_varint(buffer, edge_count);
+
+        uint64_t previous_target = 0;
+        for (size_t edge_idx = 0; edge_idx < edge_count; edge_idx++) {
+            uint64_t target = edges[edge_idx].target;
+
+            if (edge_idx == 0) {
+                trace_buffer_put_varint(buffer, mtrace_zigzag_encode((int64_t) (target - start_addr)));
+            } else {
+                trace_buffer_put_varint(buffer, target - previous_target);
+            }
+            trace_buffer_put_varint(buffer, edges[edge_idx].type);
+#ifdef EXECUTION_COUNTERS
+            trace_buffer_put_varint(buffer, edges[edge_idx].exec_count);
+#endif
+
+            previous_target = target;
+        }
+
+        header.edge_count += edge_count;
+    }
+
+    header.index_offset = buffer->written + buffer->used;
+    trace_buffer_put(buffer, node_index, sizeof(uint64_t) * index_count);
+
+    if (threads != NULL && threads->count > 0) {
+        header.flags |= MTRACE_FLAG_THREADS;
+        header.threads_offset = buffer->written + buffer->used;
+
+        trace_buffer_put_varint(buffer, threads->count);
+        for (uint64_t idx = 0; idx <= threads->mask; idx++) {
+            if (threads->entries[idx].entry_addr != NULL) {
+                trace_buffer_put_varint(buffer, module_table_encode(modules,
+                                                                    (uintptr_t) threads->entries[idx].entry_addr));
+                trace_buffer_put_varint(buffer, module_table_encode(modules,
+                                                                    (uintptr_t) threads->entries[idx].call_site));
+            }
+        }
+    }
+
+    trace_buffer_flush(buffer);
+
+#ifdef COMPRESSED_OUTPUT
+    trace_compressor_patch(&buffer->compressor, &header, sizeof(header));
+#else
+    if (pwrite(buffer->fd, &header, sizeof(header), 0) != sizeof(header)) {
+        fprintf(stderr, "mclift: Couldn't write the trace header: %s!\n", strerror(errno));
+        exit(-1);
+    }
+#endif
+
+    mambo_free(ctx, module);
+    mambo_free(ctx, edges);
+    mambo_free(ctx, node_index);
+    mambo_free(ctx, nodes);
+}
+
+void trace_family(char* family, size_t size) {
+    snprintf(family, size, "%ld-%d", (long) time(NULL), (int) getpid());
+}
+
+void trace_path(char* path, size_t size, const char* family, const char* extension) {
+    snprintf(path, size, "%s.%d.%lu.%s", family, (int) getpid(), get_virtual_counter(), extension);
+}
+
+void write_trace(mambo_context* ctx, const char* tracename, cfg_node** nodes, uint64_t node_count, void* main_addr,
+                 lift_thread_registry* threads, module_table* modules) {
+#ifdef PERFORMANCE_MONITORING
+    uint64_t start_time = get_virtual_counter();
+#endif
+
+    trace_buffer buffer;
+
+    buffer.fd = open(tracename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (buffer.fd < 0) {
+        fprintf(stderr, "mclift: Couldn't open %s: %s!\n", tracename, strerror(errno));
+        exit(-1);
+    }
+
+#ifdef COMPRESSED_OUTPUT
+    buffer.data = trace_compressor_start(&buffer.compressor, buffer.fd);
+#else
+    buffer.data = (uint8_t *) mambo_alloc(ctx, TRACE_BUFFER_SIZE);
+#endif
+    if (buffer.data == NULL) {
+        fprintf(stderr, "mclift: Couldn't allocate the trace buffer!\n");
+        exit(-1);
+    }
+
+    buffer.used = 0;
+    buffer.written = 0;
+
+#if TRACE_FORMAT_VERSION == 1
+    write_trace_v1(ctx, &buffer, nodes, node_count, main_addr);
+#elif TRACE_FORMAT_VERSION == 2
+    write_trace_v2(ctx, &buffer, nodes, node_count, main_addr, threads, modules);
+#else
+    #error Unsupported TRACE_FORMAT_VERSION!
+#endif
+
+#ifdef COMPRESSED_OUTPUT
+    uint64_t compressed = trace_compressor_finish(&buffer.compressor);
+#else
+    mambo_free(ctx, buffer.data);
+#endif
+
+    close(buffer.fd);
 
-    fclose(trace);
+#ifdef PERFORMANCE_MONITORING
+    double elapsed = (double) (get_virtual_counter() - start_time) / (double) get_virtual_counter_frequency();
+    fprintf(stderr, "mclift: Wrote %lu bytes to %s in %lfs (%lf MiB/s)\n", buffer.written, tracename, elapsed,
+            (double) buffer.written / (1024.0 * 1024.0) / elapsed);
+#ifdef COMPRESSED_OUTPUT
+    double frequency = (double) get_virtual_counter_frequency();
+    fprintf(stderr, "mclift: Compressed the trace to %lu bytes (ratio %.2lf); compression took %lfs, encoding waited "
+            "for it %lfs\n", compressed, (double) buffer.written / (double) compressed,
+            (double) buffer.compressor.compress_time / frequency, (double) buffer.compressor.wait_time / frequency);
+#endif
+#endif
 }
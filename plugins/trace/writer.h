@@ -19,6 +19,7 @@
 
 #include "cfg.h"
 #include "instrumentation.h"
+#include "modules.h"
 
 // FUNCTIONS
 
@@ -26,8 +27,42 @@
  * Save execution trace into a file.
  *
  * @param ctx Mambo context of the plugin.
- * @param cfg Hash map with all traced basic blocks of the program.
+ * @param path Path of the trace (see trace_path).
+ * @param nodes All traced basic blocks of the program.
+ * @param node_count Number of the nodes.
  * @param main_addr Address of the main function.
- * @param thread_entries Dynamically discovered addresses of threads spawned by the application.
+ * @param threads Dynamically discovered threads spawned by the application (saved in version 2 only).
+ * @param modules Modules the addresses are encoded against (version 2 only, version 1 addresses are relative to the
+ *                base of the binary).
  */
-void write_trace(mambo_context* ctx, mambo_ht_t* cfg, void* main_addr, lift_thread_metadata threads[NUMBER_THREAD_ENTRIES]);
+void write_trace(mambo_context* ctx, const char* path, cfg_node** nodes, uint64_t node_count, void* main_addr,
+                 lift_thread_registry* threads, module_table* modules);
+
+/**
+ * Generate the name of the family of processes the traces of which belong together (<timestamp>-<pid> of the first
+ * traced process). Forked processes keep the family of their parent.
+ *
+ * @param family Output buffer.
+ * @param size Size of the output buffer.
+ */
+void trace_family(char* family, size_t size);
+
+/**
+ * Generate the path of a new trace (<family>.<pid>.<counter>.<extension> in the working directory). The value of the
+ * virtual counter makes the path unique even if the pid is reused by another process of the family.
+ *
+ * @param path Output buffer.
+ * @param size Size of the output buffer.
+ * @param family Family of the process (see trace_family).
+ * @param extension Extension of the file ("mtrace" for the trace).
+ */
+void trace_path(char* path, size_t size, const char* family, const char* extension);
+
+/**
+ * Write the whole buffer to the file, retrying interrupted and partial writes. Exits on failure.
+ *
+ * @param fd File descriptor.
+ * @param data Data to be written.
+ * @param size Size of the data.
+ */
+void write_all(int fd, const uint8_t* data, size_t size);
@@ -0,0 +1,173 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Measure parsing throughput of the reader on a synthetic trace. The trace is generated with a shape similar to the
+    traces of real binaries (short blocks, ~10% of indirect branches with a few targets each) until it reaches the
+    requested size, and then it is parsed several times. Generate the trace on a file system backed by a disk to
+    include the page cache effects, or on tmpfs to measure the decoding alone.
+
+    Usage: mtrace-bench <trace> <size-in-MiB> [version] [iterations]
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mtrace_reader.h"
+#include "mtrace_writer.h"
+
+// CONSTANTS
+
+#define MAX_SYNTHETIC_TARGETS 64
+
+// Values of cfg_node_type used for synthetic nodes.
+#define SYNTHETIC_CONDITIONAL_BLOCK 0x1
+#define SYNTHETIC_INDIRECT_BLOCK 0x40
+
+// FUNCTIONS
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec * 1e-9;
+}
+
+static int generate_trace(const char* path, int version, uint64_t size) {
+    mtrace_writer writer;
+    mtrace_edge edges[MAX_SYNTHETIC_TARGETS];
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    uint64_t addr = 0x1000;
+
+    if (mtrace_writer_open(&writer, path, version, 0x400000, 0x1000, 0)) {
+        return -1;
+    }
+
+    while (writer.offset < size) {
+        mtrace_node node;
+        uint64_t edge_count = 0;
+        uint64_t random = next_random(&state);
+
+        node.start_addr = addr;
+        node.end_addr = addr + 4 * (random % 16);
+        node.branch_reg = UINT32_MAX;
+        node.type = SYNTHETIC_CONDITIONAL_BLOCK;
+        node.exec_count = 0;
+        node.order_id = UINT64_MAX;
+
+        if (random % 10 == 0) {
+            node.type = SYNTHETIC_INDIRECT_BLOCK;
+            node.branch_reg = (random >> 8) % 31;
+            edge_count = (random >> 16) % 100 == 0 ? MAX_SYNTHETIC_TARGETS : 1 + (random >> 24) % 4;
+
+            uint64_t target = 0x1000 + 4 * ((random >> 32) % (1 << 20));
+            for (uint64_t idx = 0; idx < edge_count; idx++) {
+                edges[idx].target = target;
+                edges[idx].type = 0;
+                edges[idx].exec_count = 0;
+                target += 4 * (1 + next_random(&state) % 4096);
+            }
+        }
+
+        if (mtrace_writer_add_node(&writer, &node, edges, edge_count)) {
+            mtrace_writer_close(&writer);
+            return -1;
+        }
+
+        addr = node.end_addr + 4 * (1 + (random >> 40) % 4);
+    }
+
+    return mtrace_writer_close(&writer);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || argc > 5) {
+        fprintf(stderr, "Usage: %s <trace> <size-in-MiB> [version] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    uint64_t size = strtoull(argv[2], NULL, 0) << 20;
+    int version = argc > 3 ? atoi(argv[3]) : MTRACE_VERSION;
+    int iterations = argc > 4 ? atoi(argv[4]) : 3;
+
+    double start = now();
+    if (generate_trace(argv[1], version, size)) {
+        fprintf(stderr, "mtrace-bench: Couldn't generate %s: %s!\n", argv[1], strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "mtrace-bench: Generated %s in %lfs\n", argv[1], now() - start);
+
+    mtrace_file trace;
+    if (mtrace_open(&trace, argv[1])) {
+        fprintf(stderr, "mtrace-bench: Couldn't open %s: %s!\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        mtrace_node_iter node_iter;
+        mtrace_node node;
+        uint64_t nodes = 0;
+        uint64_t edges = 0;
+        uint64_t checksum = 0;
+        int ret;
+
+        start = now();
+
+        mtrace_node_iter_init(&node_iter, &trace);
+        while ((ret = mtrace_node_iter_next(&node_iter, &node)) == 1) {
+            mtrace_edge_iter edge_iter;
+            mtrace_edge edge;
+
+            mtrace_edge_iter_init(&edge_iter, &trace, &node);
+            while (mtrace_edge_iter_next(&edge_iter, &edge) == 1) {
+                checksum += edge.target;
+                edges++;
+            }
+
+            checksum ^= node.start_addr;
+            nodes++;
+        }
+
+        double elapsed = now() - start;
+
+        if (ret < 0) {
+            fprintf(stderr, "mtrace-bench: Malformed trace %s!\n", argv[1]);
+            mtrace_close(&trace);
+            return 1;
+        }
+
+        printf("version %d size %zu nodes %" PRIu64 " edges %" PRIu64 " time %lfs throughput %lf MiB/s "
+               "%lf Mnodes/s checksum %" PRIx64 "\n", trace.version, trace.size, nodes, edges, elapsed,
+               (double) trace.size / (1024.0 * 1024.0) / elapsed, (double) nodes / 1e6 / elapsed, checksum);
+    }
+
+    mtrace_close(&trace);
+
+    return 0;
+}
@@ -0,0 +1,256 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Convert the journal written with STREAMING_WRITER into the indexed version 2 trace. Nodes logged by several threads
+    are merged (types are combined, the earliest order id is kept and edges are deduplicated). A journal of a killed
+    process may end with a truncated record, which is skipped.
+
+    Usage: mtrace-compact <journal> <output>
+*/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mtrace_writer.h"
+
+// STRUCTS
+
+typedef struct {
+    uint64_t source; // Start address of the node the edge belongs to.
+    mtrace_edge edge;
+} compact_edge;
+
+typedef struct {
+    void* data;
+    size_t count;
+    size_t capacity;
+} compact_array;
+
+// FUNCTIONS
+
+static void* array_push(compact_array* array, size_t element_size) {
+    if (array->count == array->capacity) {
+        size_t capacity = array->capacity ? 2 * array->capacity : 1024;
+        void* data = realloc(array->data, capacity * element_size);
+        if (data == NULL) {
+            fprintf(stderr, "mtrace-compact: Out of memory!\n");
+            exit(1);
+        }
+        array->data = data;
+        array->capacity = capacity;
+    }
+
+    return (uint8_t *) array->data + element_size * array->count++;
+}
+
+static int compare_nodes(const void* lhs, const void* rhs) {
+    uint64_t lhs_addr = ((const mtrace_node *) lhs)->start_addr;
+    uint64_t rhs_addr = ((const mtrace_node *) rhs)->start_addr;
+
+    return (lhs_addr > rhs_addr) - (lhs_addr < rhs_addr);
+}
+
+static int compare_edges(const void* lhs, const void* rhs) {
+    const compact_edge* lhs_edge = (const compact_edge *) lhs;
+    const compact_edge* rhs_edge = (const compact_edge *) rhs;
+
+    if (lhs_edge->source != rhs_edge->source) {
+        return lhs_edge->source > rhs_edge->source ? 1 : -1;
+    }
+    if (lhs_edge->edge.target != rhs_edge->edge.target) {
+        return lhs_edge->edge.target > rhs_edge->edge.target ? 1 : -1;
+    }
+
+    return (lhs_edge->edge.type > rhs_edge->edge.type) - (lhs_edge->edge.type < rhs_edge->edge.type);
+}
+
+static int compare_modules(const void* lhs, const void* rhs) {
+    uint64_t lhs_id = ((const mtrace_module *) lhs)->id;
+    uint64_t rhs_id = ((const mtrace_module *) rhs)->id;
+
+    return (lhs_id > rhs_id) - (lhs_id < rhs_id);
+}
+
+static int compare_threads(const void* lhs, const void* rhs) {
+    const mtrace_thread* lhs_thread = (const mtrace_thread *) lhs;
+    const mtrace_thread* rhs_thread = (const mtrace_thread *) rhs;
+
+    if (lhs_thread->entry_addr != rhs_thread->entry_addr) {
+        return lhs_thread->entry_addr > rhs_thread->entry_addr ? 1 : -1;
+    }
+
+    return (lhs_thread->call_site > rhs_thread->call_site) - (lhs_thread->call_site < rhs_thread->call_site);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <journal> <output>\n", argv[0]);
+        return 1;
+    }
+
+    mtrace_file trace;
+    if (mtrace_open(&trace, argv[1])) {
+        fprintf(stderr, "mtrace-compact: Couldn't open %s: %s!\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    if (!(trace.flags & MTRACE_FLAG_JOURNAL)) {
+        fprintf(stderr, "mtrace-compact: %s is not a journal!\n", argv[1]);
+        return 1;
+    }
+
+    compact_array nodes = {NULL, 0, 0};
+    compact_array edges = {NULL, 0, 0};
+    compact_array threads = {NULL, 0, 0};
+    compact_array modules = {NULL, 0, 0};
+    uint64_t main_addr = 0;
+    uint64_t record_count = 0;
+
+    mtrace_record_iter iter;
+    mtrace_record record;
+    int ret;
+
+    mtrace_record_iter_init(&iter, &trace);
+    while ((ret = mtrace_record_iter_next(&iter, &record)) == 1) {
+        record_count++;
+
+        if (record.kind == MTRACE_RECORD_NODE) {
+            *(mtrace_node *) array_push(&nodes, sizeof(mtrace_node)) = record.node;
+
+            mtrace_edge_iter edge_iter;
+            mtrace_edge edge;
+
+            mtrace_edge_iter_init(&edge_iter, &trace, &record.node);
+            while (mtrace_edge_iter_next(&edge_iter, &edge) == 1) {
+                compact_edge* added = (compact_edge *) array_push(&edges, sizeof(compact_edge));
+                added->source = record.node.start_addr;
+                added->edge = edge;
+            }
+        } else if (record.kind == MTRACE_RECORD_TARGET) {
+            compact_edge* added = (compact_edge *) array_push(&edges, sizeof(compact_edge));
+            added->source = record.addr;
+            added->edge.target = record.target;
+            added->edge.type = 0;
+            added->edge.exec_count = 0;
+        } else if (record.kind == MTRACE_RECORD_THREAD) {
+            mtrace_thread* added = (mtrace_thread *) array_push(&threads, sizeof(mtrace_thread));
+            added->entry_addr = record.addr;
+            added->call_site = record.target;
+        } else if (record.kind == MTRACE_RECORD_MAIN) {
+            main_addr = record.addr;
+        } else if (record.kind == MTRACE_RECORD_MODULE) {
+            *(mtrace_module *) array_push(&modules, sizeof(mtrace_module)) = record.module;
+        }
+    }
+
+    if (ret < 0) {
+        fprintf(stderr, "mtrace-compact: Journal truncated after %" PRIu64 " records, the rest is skipped\n",
+                record_count);
+    }
+
+    mtrace_node* node_array = (mtrace_node *) nodes.data;
+    compact_edge* edge_array = (compact_edge *) edges.data;
+    mtrace_thread* thread_array = (mtrace_thread *) threads.data;
+    mtrace_module* module_array = (mtrace_module *) modules.data;
+
+    qsort(node_array, nodes.count, sizeof(mtrace_node), compare_nodes);
+    qsort(edge_array, edges.count, sizeof(compact_edge), compare_edges);
+    qsort(thread_array, threads.count, sizeof(mtrace_thread), compare_threads);
+    qsort(module_array, modules.count, sizeof(mtrace_module), compare_modules);
+
+    mtrace_writer writer;
+    if (mtrace_writer_open(&writer, argv[2], 2, trace.base_addr, main_addr, MTRACE_FLAG_ORDER)) {
+        fprintf(stderr, "mtrace-compact: Couldn't create %s: %s!\n", argv[2], strerror(errno));
+        return 1;
+    }
+
+    mtrace_edge* node_edges = NULL;
+    size_t node_edges_capacity = 0;
+    size_t edge_idx = 0;
+    int status = 0;
+
+    // Modules are logged in the order of their ids, so the ids of a complete journal are contiguous.
+    if (trace.flags & MTRACE_FLAG_MODULES) {
+        status = mtrace_writer_set_modules(&writer, module_array, modules.count);
+    }
+
+    for (size_t idx = 0; idx < nodes.count && status == 0; idx++) {
+        mtrace_node node = node_array[idx];
+
+        // Merge the copies of the node logged by different threads.
+        while (idx + 1 < nodes.count && node_array[idx + 1].start_addr == node.start_addr) {
+            idx++;
+            node.type |= node_array[idx].type;
+            if (node.branch_reg == UINT32_MAX) {
+                node.branch_reg = node_array[idx].branch_reg;
+            }
+            if (node_array[idx].order_id < node.order_id) {
+                node.order_id = node_array[idx].order_id;
+            }
+        }
+
+        // Skip edges of the nodes that were not logged (e.g., the record was truncated).
+        while (edge_idx < edges.count && edge_array[edge_idx].source < node.start_addr) {
+            edge_idx++;
+        }
+
+        size_t edge_count = 0;
+
+        for (; edge_idx < edges.count && edge_array[edge_idx].source == node.start_addr; edge_idx++) {
+            if (edge_count > 0 && compare_edges(&edge_array[edge_idx], &edge_array[edge_idx - 1]) == 0) {
+                continue;
+            }
+
+            if (edge_count == node_edges_capacity) {
+                node_edges_capacity = node_edges_capacity ? 2 * node_edges_capacity : 64;
+                node_edges = (mtrace_edge *) realloc(node_edges, node_edges_capacity * sizeof(mtrace_edge));
+                if (node_edges == NULL) {
+                    fprintf(stderr, "mtrace-compact: Out of memory!\n");
+                    return 1;
+                }
+            }
+
+            node_edges[edge_count++] = edge_array[edge_idx].edge;
+        }
+
+        status = mtrace_writer_add_node(&writer, &node, node_edges, edge_count);
+    }
+
+    for (size_t idx = 0; idx < threads.count && status == 0; idx++) {
+        if (idx == 0 || compare_threads(&thread_array[idx], &thread_array[idx - 1]) != 0) {
+            status = mtrace_writer_add_thread(&writer, &thread_array[idx]);
+        }
+    }
+
+    if (mtrace_writer_close(&writer) || status) {
+        fprintf(stderr, "mtrace-compact: Couldn't write %s: %s!\n", argv[2], strerror(errno));
+        return 1;
+    }
+
+    mtrace_close(&trace);
+    free(node_edges);
+    free(nodes.data);
+    free(edges.data);
+    free(threads.data);
+    free(modules.data);
+
+    return 0;
+}
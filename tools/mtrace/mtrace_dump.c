@@ -0,0 +1,176 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+
+/*
+    Print the whole trace in a human-readable form.
+
+    Usage: mtrace-dump <trace>
+*/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mtrace_reader.h"
+
+static void print_node(const mtrace_file* trace, const mtrace_node* node) {
+    char start[MTRACE_ADDR_STRING_SIZE], end[MTRACE_ADDR_STRING_SIZE];
+
+    printf("node %s-%s type 0x%x", mtrace_format_addr(trace, node->start_addr, start),
+           mtrace_format_addr(trace, node->end_addr, end), node->type);
+    if (node->branch_reg != UINT32_MAX) {
+        printf(" reg x%u", node->branch_reg);
+    }
+    if (node->order_id != UINT64_MAX) {
+        printf(" order %" PRIu64, node->order_id);
+    }
+    if (trace->flags & MTRACE_FLAG_EXEC_COUNTS) {
+        printf(" count %" PRIu64, node->exec_count);
+    }
+    printf(" edges %" PRIu64 "\n", node->edge_count);
+
+    mtrace_edge_iter iter;
+    mtrace_edge edge;
+
+    mtrace_edge_iter_init(&iter, trace, node);
+    while (mtrace_edge_iter_next(&iter, &edge) == 1) {
+        printf("  -> %s type %u", mtrace_format_addr(trace, edge.target, start), edge.type);
+        if (trace->flags & MTRACE_FLAG_EXEC_COUNTS) {
+            printf(" count %" PRIu64, edge.exec_count);
+        }
+        printf("\n");
+    }
+}
+
+static void print_module(const mtrace_module* module) {
+    printf("module %" PRIu64 " 0x%" PRIx64 "-0x%" PRIx64 " %.*s", module->id, module->base,
+           module->base + module->size, (int) module->path_size, module->path_size ? module->path : "[anonymous]");
+    if (module->build_id_size > 0) {
+        printf(" build-id ");
+        for (size_t idx = 0; idx < module->build_id_size; idx++) {
+            printf("%02x", module->build_id[idx]);
+        }
+    }
+    printf("\n");
+}
+
+/*
+    Print the records of the journal in the order they were saved.
+*/
+static int dump_journal(mtrace_file* trace, const char* path) {
+    char addr[MTRACE_ADDR_STRING_SIZE], target[MTRACE_ADDR_STRING_SIZE];
+    mtrace_record_iter iter;
+    mtrace_record record;
+    int ret;
+
+    mtrace_record_iter_init(&iter, trace);
+    while ((ret = mtrace_record_iter_next(&iter, &record)) == 1) {
+        switch (record.kind) {
+            case MTRACE_RECORD_NODE:
+                print_node(trace, &record.node);
+                break;
+            case MTRACE_RECORD_TARGET:
+                printf("target %s -> %s\n", mtrace_format_addr(trace, record.addr, addr),
+                       mtrace_format_addr(trace, record.target, target));
+                break;
+            case MTRACE_RECORD_THREAD:
+                printf("thread %s spawned at %s\n", mtrace_format_addr(trace, record.addr, addr),
+                       mtrace_format_addr(trace, record.target, target));
+                break;
+            case MTRACE_RECORD_MAIN:
+                printf("main %s\n", mtrace_format_addr(trace, record.addr, addr));
+                break;
+            case MTRACE_RECORD_MODULE:
+                print_module(&record.module);
+                break;
+        }
+    }
+
+    mtrace_close(trace);
+
+    if (ret < 0) {
+        fprintf(stderr, "mtrace-dump: Journal %s ends with a truncated or malformed record!\n", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <trace>\n", argv[0]);
+        return 1;
+    }
+
+    mtrace_file trace;
+    if (mtrace_open(&trace, argv[1])) {
+        fprintf(stderr, "mtrace-dump: Couldn't open %s: %s!\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    char addr[MTRACE_ADDR_STRING_SIZE], call_site[MTRACE_ADDR_STRING_SIZE];
+
+    printf("version %d base 0x%" PRIx64 " main %s", trace.version, trace.base_addr,
+           mtrace_format_addr(&trace, trace.main_addr, addr));
+    if (trace.version > 1) {
+        printf(" nodes %" PRIu64 " edges %" PRIu64, trace.node_count, trace.edge_count);
+    }
+    printf("\n");
+
+    if (trace.flags & MTRACE_FLAG_JOURNAL) {
+        return dump_journal(&trace, argv[1]);
+    }
+
+    mtrace_module_iter module_iter;
+    mtrace_module module;
+    int ret;
+
+    mtrace_module_iter_init(&module_iter, &trace);
+    while ((ret = mtrace_module_iter_next(&module_iter, &module)) == 1) {
+        print_module(&module);
+    }
+
+    mtrace_node_iter iter;
+    mtrace_node node;
+
+    mtrace_node_iter_init(&iter, &trace);
+    while ((ret = mtrace_node_iter_next(&iter, &node)) == 1) {
+        print_node(&trace, &node);
+    }
+
+    if (ret == 0) {
+        mtrace_thread_iter thread_iter;
+        mtrace_thread thread;
+
+        mtrace_thread_iter_init(&thread_iter, &trace);
+        while ((ret = mtrace_thread_iter_next(&thread_iter, &thread)) == 1) {
+            printf("thread %s spawned at %s\n", mtrace_format_addr(&trace, thread.entry_addr, addr),
+                   mtrace_format_addr(&trace, thread.call_site, call_site));
+        }
+    }
+
+    mtrace_close(&trace);
+
+    if (ret < 0) {
+        fprintf(stderr, "mtrace-dump: Malformed trace %s!\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,994 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Merge traces of many runs into a single version 2 trace, or report what one trace discovered on top of another.
+
+    Merging takes the union of the nodes (types are combined and the first known branch register is kept), edges and
+    indirect targets, and thread spawns. Execution counts are summed if all the traces have them. Order ids are only
+    meaningful within a single run, so they are not saved. Traces are parsed concurrently, each worker thread
+    batches the nodes of its trace by shard and inserts every batch into the sharded hash tables holding one lock.
+
+    Modules (see MTRACE_FLAG_MODULES) are matched by their path and build-id, so traces of PIE binaries and of runs
+    with different library load addresses merge correctly. The binary of the first trace is module 0 of the output.
+    Journals have to be converted with mtrace-compact first.
+
+    Usage: mtrace-merge [-j <threads>] <output> <trace>...
+           mtrace-merge -d <old-trace> <new-trace>
+
+    A trace path of - reads further paths from the standard input, one per line. The diff mode prints the nodes, edges
+    and node types of the new trace missing from the old trace, with addresses as stored in the new trace.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mtrace_writer.h"
+
+// CONSTANTS
+
+/*
+    Number of shards of the hash tables. Nodes and edges are assigned to shards by the start address of the node, so a
+    node and all its edges are always inserted holding a single lock.
+*/
+#define MERGE_SHARD_BITS 6
+#define MERGE_SHARDS (1 << MERGE_SHARD_BITS)
+
+#define MERGE_INITIAL_SLOTS 1024
+
+// STRUCTS
+
+typedef struct {
+    uint64_t source; // Start address of the node the edge belongs to.
+    mtrace_edge edge;
+} merge_edge;
+
+typedef struct {
+    void* data;
+    size_t count;
+    size_t capacity;
+} merge_array;
+
+/*
+    Open addressing table of the indices (+ 1, so 0 marks an empty slot) into an array of records.
+*/
+typedef struct {
+    uint64_t* slots;
+    uint64_t mask;
+} merge_table;
+
+typedef struct {
+    pthread_mutex_t lock;
+    merge_array nodes; // Array of mtrace_node.
+    merge_table node_table; // Nodes by their start address.
+    merge_array edges; // Array of merge_edge.
+    merge_table edge_table; // Edges by their source, target and type.
+} merge_shard;
+
+/*
+    Module of the output, identified by the path and the build-id.
+*/
+typedef struct {
+    mtrace_module module; // Path and build-id point into the copies below.
+    char* path;
+    uint8_t* build_id;
+} merge_module;
+
+/*
+    State shared by all the workers.
+*/
+typedef struct {
+    char** paths; // Input traces (owned copies).
+    size_t path_count;
+    size_t next_path; // Next trace to be parsed (taken atomically).
+    merge_shard shards[MERGE_SHARDS];
+    pthread_mutex_t lock; // Guards the modules, the threads and the error.
+    merge_array modules; // Array of merge_module, indexed by the output ids.
+    merge_array threads; // Array of mtrace_thread.
+    bool modules_flag; // Whether the traces encode the addresses against modules.
+    bool exec_counts; // Whether all the traces carry execution counts (the summed counts are only saved if so).
+    char error[512]; // First error, empty if none.
+} merge_state;
+
+/*
+    Nodes and edges of a single trace batched by shard.
+*/
+typedef struct {
+    merge_array nodes[MERGE_SHARDS];
+    merge_array edges[MERGE_SHARDS];
+    uint64_t* module_map; // Output ids of the modules of the trace.
+    size_t module_map_size;
+} merge_batch;
+
+// FUNCTIONS
+
+static void* array_push(merge_array* array, size_t element_size) {
+    if (array->count == array->capacity) {
+        size_t capacity = array->capacity ? 2 * array->capacity : 1024;
+        void* data = realloc(array->data, capacity * element_size);
+        if (data == NULL) {
+            fprintf(stderr, "mtrace-merge: Out of memory!\n");
+            exit(1);
+        }
+        array->data = data;
+        array->capacity = capacity;
+    }
+
+    return (uint8_t *) array->data + element_size * array->count++;
+}
+
+/*
+    Finalizer of splitmix64, all the bits of the result depend on all the bits of the value.
+*/
+static inline uint64_t mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    value = (value ^ (value >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return value ^ (value >> 31);
+}
+
+static inline uint64_t shard_of(uint64_t start) {
+    return mix(start) & (MERGE_SHARDS - 1);
+}
+
+static inline uint64_t node_hash(uint64_t start) {
+    return mix(start) >> MERGE_SHARD_BITS;
+}
+
+static inline uint64_t edge_hash(const merge_edge* edge) {
+    return mix(mix(edge->source) ^ edge->edge.target ^ ((uint64_t) edge->edge.type << 56));
+}
+
+static inline bool same_edge(const merge_edge* lhs, const merge_edge* rhs) {
+    return lhs->source == rhs->source && lhs->edge.target == rhs->edge.target && lhs->edge.type == rhs->edge.type;
+}
+
+static void table_init(merge_table* table) {
+    table->slots = (uint64_t *) calloc(MERGE_INITIAL_SLOTS, sizeof(uint64_t));
+    if (table->slots == NULL) {
+        fprintf(stderr, "mtrace-merge: Out of memory!\n");
+        exit(1);
+    }
+    table->mask = MERGE_INITIAL_SLOTS - 1;
+}
+
+/*
+    Double the table once it is half full. The hash of a record is recomputed from the array of records.
+*/
+static void table_grow(merge_table* table, merge_array* records, bool edges) {
+    uint64_t slot_count = 2 * (table->mask + 1);
+    uint64_t* slots = (uint64_t *) calloc(slot_count, sizeof(uint64_t));
+    if (slots == NULL) {
+        fprintf(stderr, "mtrace-merge: Out of memory!\n");
+        exit(1);
+    }
+
+    for (uint64_t idx = 0; idx <= table->mask; idx++) {
+        uint64_t record = table->slots[idx];
+        if (record == 0) {
+            continue;
+        }
+
+        uint64_t hash = edges ? edge_hash(&((merge_edge *) records->data)[record - 1])
+                              : node_hash(((mtrace_node *) records->data)[record - 1].start_addr);
+        uint64_t slot = hash & (slot_count - 1);
+
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = record;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->mask = slot_count - 1;
+}
+
+/*
+    Find the node starting at start. Returns NULL if the shard doesn't contain it.
+*/
+static mtrace_node* find_node(merge_shard* shard, uint64_t start) {
+    mtrace_node* nodes = (mtrace_node *) shard->nodes.data;
+
+    for (uint64_t slot = node_hash(start) & shard->node_table.mask; shard->node_table.slots[slot] != 0;
+         slot = (slot + 1) & shard->node_table.mask) {
+        mtrace_node* node = &nodes[shard->node_table.slots[slot] - 1];
+        if (node->start_addr == start) {
+            return node;
+        }
+    }
+
+    return NULL;
+}
+
+static merge_edge* find_edge(merge_shard* shard, const merge_edge* edge) {
+    merge_edge* edges = (merge_edge *) shard->edges.data;
+
+    for (uint64_t slot = edge_hash(edge) & shard->edge_table.mask; shard->edge_table.slots[slot] != 0;
+         slot = (slot + 1) & shard->edge_table.mask) {
+        merge_edge* candidate = &edges[shard->edge_table.slots[slot] - 1];
+        if (same_edge(candidate, edge)) {
+            return candidate;
+        }
+    }
+
+    return NULL;
+}
+
+static void insert_node(merge_shard* shard, const mtrace_node* node) {
+    mtrace_node* existing = find_node(shard, node->start_addr);
+
+    if (existing != NULL) {
+        existing->type |= node->type;
+        if (existing->branch_reg == UINT32_MAX) {
+            existing->branch_reg = node->branch_reg;
+        }
+        if (node->end_addr > existing->end_addr) {
+            existing->end_addr = node->end_addr;
+        }
+        existing->exec_count += node->exec_count;
+        return;
+    }
+
+    if (2 * (shard->nodes.count + 1) > shard->node_table.mask + 1) {
+        table_grow(&shard->node_table, &shard->nodes, false);
+    }
+
+    *(mtrace_node *) array_push(&shard->nodes, sizeof(mtrace_node)) = *node;
+
+    uint64_t slot = node_hash(node->start_addr) & shard->node_table.mask;
+    while (shard->node_table.slots[slot] != 0) {
+        slot = (slot + 1) & shard->node_table.mask;
+    }
+    shard->node_table.slots[slot] = shard->nodes.count;
+}
+
+static void insert_edge(merge_shard* shard, const merge_edge* edge) {
+    merge_edge* existing = find_edge(shard, edge);
+
+    if (existing != NULL) {
+        existing->edge.exec_count += edge->edge.exec_count;
+        return;
+    }
+
+    if (2 * (shard->edges.count + 1) > shard->edge_table.mask + 1) {
+        table_grow(&shard->edge_table, &shard->edges, true);
+    }
+
+    *(merge_edge *) array_push(&shard->edges, sizeof(merge_edge)) = *edge;
+
+    uint64_t slot = edge_hash(edge) & shard->edge_table.mask;
+    while (shard->edge_table.slots[slot] != 0) {
+        slot = (slot + 1) & shard->edge_table.mask;
+    }
+    shard->edge_table.slots[slot] = shard->edges.count;
+}
+
+static void set_error(merge_state* state, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    pthread_mutex_lock(&state->lock);
+    if (state->error[0] == '\0') {
+        vsnprintf(state->error, sizeof(state->error), format, args);
+    }
+    pthread_mutex_unlock(&state->lock);
+
+    va_end(args);
+}
+
+/*
+    Return the output id of the module, adding the module if it wasn't seen before. The caller has to hold the lock.
+*/
+static uint64_t register_module(merge_state* state, const mtrace_module* module) {
+    merge_module* modules = (merge_module *) state->modules.data;
+
+    for (size_t idx = 0; idx < state->modules.count; idx++) {
+        const mtrace_module* known = &modules[idx].module;
+
+        if (known->path_size == module->path_size && known->build_id_size == module->build_id_size
+            && memcmp(known->path, module->path, module->path_size) == 0
+            && memcmp(known->build_id, module->build_id, module->build_id_size) == 0) {
+            // Anonymous code has no identity, it is only matched if it was mapped at the same address.
+            if (module->path_size > 0 || known->base == module->base) {
+                return idx;
+            }
+        }
+    }
+
+    merge_module* added = (merge_module *) array_push(&state->modules, sizeof(merge_module));
+
+    added->path = (char *) malloc(module->path_size + 1);
+    added->build_id = (uint8_t *) malloc(module->build_id_size + 1);
+    if (added->path == NULL || added->build_id == NULL) {
+        fprintf(stderr, "mtrace-merge: Out of memory!\n");
+        exit(1);
+    }
+    memcpy(added->path, module->path, module->path_size);
+    memcpy(added->build_id, module->build_id, module->build_id_size);
+
+    added->module = *module;
+    added->module.id = state->modules.count - 1;
+    added->module.path = added->path;
+    added->module.build_id = added->build_id;
+
+    return added->module.id;
+}
+
+/*
+    Map the module ids of the trace to the output ids. Returns 0 on success, -1 if the module table is malformed.
+*/
+static int map_modules(merge_state* state, const mtrace_file* trace, merge_batch* batch) {
+    if (trace->module_count > batch->module_map_size) {
+        free(batch->module_map);
+        batch->module_map = (uint64_t *) malloc(trace->module_count * sizeof(uint64_t));
+        if (batch->module_map == NULL) {
+            fprintf(stderr, "mtrace-merge: Out of memory!\n");
+            exit(1);
+        }
+        batch->module_map_size = trace->module_count;
+    }
+
+    mtrace_module_iter iter;
+    mtrace_module module;
+    int ret;
+
+    pthread_mutex_lock(&state->lock);
+    mtrace_module_iter_init(&iter, trace);
+    while ((ret = mtrace_module_iter_next(&iter, &module)) == 1) {
+        batch->module_map[module.id] = register_module(state, &module);
+    }
+    pthread_mutex_unlock(&state->lock);
+
+    return ret;
+}
+
+/*
+    Translate the address of the trace to the output encoding. Returns false if the module id is not in the table.
+*/
+static inline bool map_addr(const mtrace_file* trace, const merge_batch* batch, uint64_t* addr) {
+    if (!(trace->flags & MTRACE_FLAG_MODULES)) {
+        return true;
+    }
+
+    uint64_t id = mtrace_module_id(*addr);
+
+    if (id == MTRACE_MODULE_UNKNOWN) {
+        return true;
+    }
+    if (id >= trace->module_count) {
+        return false;
+    }
+
+    *addr = mtrace_module_addr(batch->module_map[id], mtrace_module_offset(*addr));
+
+    return true;
+}
+
+/*
+    Check that the trace can be merged with the others and map its modules.
+*/
+static int open_input(merge_state* state, mtrace_file* trace, const char* path, merge_batch* batch) {
+    if (mtrace_open(trace, path)) {
+        set_error(state, "Couldn't open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    if (trace->flags & MTRACE_FLAG_JOURNAL) {
+        set_error(state, "%s is a journal, convert it with mtrace-compact first", path);
+        mtrace_close(trace);
+        return -1;
+    }
+
+    if (((trace->flags & MTRACE_FLAG_MODULES) != 0) != state->modules_flag) {
+        set_error(state, "%s can't be merged with traces from a different version of the plugin", path);
+        mtrace_close(trace);
+        return -1;
+    }
+
+    if (!(trace->flags & MTRACE_FLAG_EXEC_COUNTS)) {
+        __atomic_store_n(&state->exec_counts, false, __ATOMIC_RELAXED);
+    }
+
+    if (map_modules(state, trace, batch)) {
+        set_error(state, "Malformed trace %s", path);
+        mtrace_close(trace);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+    Parse the trace into the batch. Returns 0 on success, -1 if the trace is malformed.
+*/
+static int read_trace(const mtrace_file* trace, merge_batch* batch) {
+    mtrace_node_iter iter;
+    mtrace_node node;
+    int ret;
+
+    mtrace_node_iter_init(&iter, trace);
+    while ((ret = mtrace_node_iter_next(&iter, &node)) == 1) {
+        uint64_t size = node.end_addr - node.start_addr;
+
+        if (!map_addr(trace, batch, &node.start_addr)) {
+            return -1;
+        }
+        node.end_addr = node.start_addr + size;
+
+        uint64_t shard = shard_of(node.start_addr);
+        mtrace_edge_iter edge_iter;
+        mtrace_edge edge;
+
+        mtrace_edge_iter_init(&edge_iter, trace, &node);
+        while ((ret = mtrace_edge_iter_next(&edge_iter, &edge)) == 1) {
+            merge_edge* added = (merge_edge *) array_push(&batch->edges[shard], sizeof(merge_edge));
+
+            added->source = node.start_addr;
+            added->edge = edge;
+            if (!map_addr(trace, batch, &added->edge.target)) {
+                return -1;
+            }
+        }
+        if (ret < 0) {
+            return -1;
+        }
+
+        node.order_id = UINT64_MAX;
+        *(mtrace_node *) array_push(&batch->nodes[shard], sizeof(mtrace_node)) = node;
+    }
+
+    return ret;
+}
+
+static void flush_batch(merge_state* state, merge_batch* batch) {
+    for (int idx = 0; idx < MERGE_SHARDS; idx++) {
+        merge_shard* shard = &state->shards[idx];
+
+        if (batch->nodes[idx].count == 0 && batch->edges[idx].count == 0) {
+            continue;
+        }
+
+        pthread_mutex_lock(&shard->lock);
+        for (size_t node = 0; node < batch->nodes[idx].count; node++) {
+            insert_node(shard, &((mtrace_node *) batch->nodes[idx].data)[node]);
+        }
+        for (size_t edge = 0; edge < batch->edges[idx].count; edge++) {
+            insert_edge(shard, &((merge_edge *) batch->edges[idx].data)[edge]);
+        }
+        pthread_mutex_unlock(&shard->lock);
+
+        batch->nodes[idx].count = 0;
+        batch->edges[idx].count = 0;
+    }
+}
+
+/*
+    Merge a single trace into the shared tables. Returns 0 on success, -1 on failure (the error is set).
+*/
+static int merge_trace(merge_state* state, const char* path, merge_batch* batch) {
+    mtrace_file trace;
+
+    if (open_input(state, &trace, path, batch)) {
+        return -1;
+    }
+
+    if (read_trace(&trace, batch)) {
+        set_error(state, "Malformed trace %s", path);
+        mtrace_close(&trace);
+        return -1;
+    }
+
+    flush_batch(state, batch);
+
+    mtrace_thread_iter iter;
+    mtrace_thread thread;
+    int ret;
+
+    pthread_mutex_lock(&state->lock);
+    mtrace_thread_iter_init(&iter, &trace);
+    while ((ret = mtrace_thread_iter_next(&iter, &thread)) == 1) {
+        if (map_addr(&trace, batch, &thread.entry_addr) && map_addr(&trace, batch, &thread.call_site)) {
+            *(mtrace_thread *) array_push(&state->threads, sizeof(mtrace_thread)) = thread;
+        }
+    }
+    pthread_mutex_unlock(&state->lock);
+
+    mtrace_close(&trace);
+
+    if (ret < 0) {
+        set_error(state, "Malformed trace %s", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void free_batch(merge_batch* batch) {
+    for (int idx = 0; idx < MERGE_SHARDS; idx++) {
+        free(batch->nodes[idx].data);
+        free(batch->edges[idx].data);
+    }
+    free(batch->module_map);
+}
+
+static void* merge_worker(void* arg) {
+    merge_state* state = (merge_state *) arg;
+    merge_batch batch;
+
+    memset(&batch, 0, sizeof(batch));
+
+    while (true) {
+        size_t idx = __atomic_fetch_add(&state->next_path, 1, __ATOMIC_RELAXED);
+
+        if (idx >= state->path_count || merge_trace(state, state->paths[idx], &batch)) {
+            break;
+        }
+    }
+
+    free_batch(&batch);
+
+    return NULL;
+}
+
+static void init_state(merge_state* state) {
+    memset(state, 0, sizeof(*state));
+
+    pthread_mutex_init(&state->lock, NULL);
+    for (int idx = 0; idx < MERGE_SHARDS; idx++) {
+        pthread_mutex_init(&state->shards[idx].lock, NULL);
+        table_init(&state->shards[idx].node_table);
+        table_init(&state->shards[idx].edge_table);
+    }
+}
+
+static void destroy_state(merge_state* state) {
+    for (int idx = 0; idx < MERGE_SHARDS; idx++) {
+        free(state->shards[idx].nodes.data);
+        free(state->shards[idx].node_table.slots);
+        free(state->shards[idx].edges.data);
+        free(state->shards[idx].edge_table.slots);
+    }
+
+    merge_module* modules = (merge_module *) state->modules.data;
+    for (size_t idx = 0; idx < state->modules.count; idx++) {
+        free(modules[idx].path);
+        free(modules[idx].build_id);
+    }
+    free(state->modules.data);
+    free(state->threads.data);
+
+    for (size_t idx = 0; idx < state->path_count; idx++) {
+        free(state->paths[idx]);
+    }
+    free(state->paths);
+}
+
+static int compare_nodes(const void* lhs, const void* rhs) {
+    uint64_t lhs_addr = ((const mtrace_node *) lhs)->start_addr;
+    uint64_t rhs_addr = ((const mtrace_node *) rhs)->start_addr;
+
+    return (lhs_addr > rhs_addr) - (lhs_addr < rhs_addr);
+}
+
+static int compare_edges(const void* lhs, const void* rhs) {
+    const merge_edge* lhs_edge = (const merge_edge *) lhs;
+    const merge_edge* rhs_edge = (const merge_edge *) rhs;
+
+    if (lhs_edge->source != rhs_edge->source) {
+        return lhs_edge->source > rhs_edge->source ? 1 : -1;
+    }
+    if (lhs_edge->edge.target != rhs_edge->edge.target) {
+        return lhs_edge->edge.target > rhs_edge->edge.target ? 1 : -1;
+    }
+
+    return (lhs_edge->edge.type > rhs_edge->edge.type) - (lhs_edge->edge.type < rhs_edge->edge.type);
+}
+
+static int compare_threads(const void* lhs, const void* rhs) {
+    const mtrace_thread* lhs_thread = (const mtrace_thread *) lhs;
+    const mtrace_thread* rhs_thread = (const mtrace_thread *) rhs;
+
+    if (lhs_thread->entry_addr != rhs_thread->entry_addr) {
+        return lhs_thread->entry_addr > rhs_thread->entry_addr ? 1 : -1;
+    }
+
+    return (lhs_thread->call_site > rhs_thread->call_site) - (lhs_thread->call_site < rhs_thread->call_site);
+}
+
+/*
+    Gather the records of all the shards into a single array.
+*/
+static void* gather(merge_state* state, bool edges, size_t* count) {
+    size_t size = edges ? sizeof(merge_edge) : sizeof(mtrace_node);
+    size_t total = 0;
+
+    for (int idx = 0; idx < MERGE_SHARDS; idx++) {
+        total += edges ? state->shards[idx].edges.count : state->shards[idx].nodes.count;
+    }
+
+    uint8_t* records = (uint8_t *) malloc((total + 1) * size);
+    if (records == NULL) {
+        fprintf(stderr, "mtrace-merge: Out of memory!\n");
+        exit(1);
+    }
+
+    *count = 0;
+    for (int idx = 0; idx < MERGE_SHARDS; idx++) {
+        merge_array* array = edges ? &state->shards[idx].edges : &state->shards[idx].nodes;
+
+        memcpy(records + *count * size, array->data, array->count * size);
+        *count += array->count;
+    }
+
+    return records;
+}
+
+static int write_output(merge_state* state, const char* path, uint64_t base_addr, uint64_t main_addr) {
+    size_t node_count, edge_count;
+    mtrace_node* nodes = (mtrace_node *) gather(state, false, &node_count);
+    merge_edge* edges = (merge_edge *) gather(state, true, &edge_count);
+    mtrace_thread* threads = (mtrace_thread *) state->threads.data;
+
+    qsort(nodes, node_count, sizeof(mtrace_node), compare_nodes);
+    qsort(edges, edge_count, sizeof(merge_edge), compare_edges);
+    if (state->threads.count > 0) {
+        qsort(threads, state->threads.count, sizeof(mtrace_thread), compare_threads);
+    }
+
+    mtrace_writer writer;
+    if (mtrace_writer_open(&writer, path, 2, base_addr, main_addr,
+                           state->exec_counts ? MTRACE_FLAG_EXEC_COUNTS : 0)) {
+        fprintf(stderr, "mtrace-merge: Couldn't create %s: %s!\n", path, strerror(errno));
+        free(edges);
+        free(nodes);
+        return 1;
+    }
+
+    int status = 0;
+
+    if (state->modules_flag) {
+        merge_module* modules = (merge_module *) state->modules.data;
+        mtrace_module* table = (mtrace_module *) malloc((state->modules.count + 1) * sizeof(mtrace_module));
+        if (table == NULL) {
+            fprintf(stderr, "mtrace-merge: Out of memory!\n");
+            exit(1);
+        }
+
+        for (size_t idx = 0; idx < state->modules.count; idx++) {
+            table[idx] = modules[idx].module;
+        }
+
+        status = mtrace_writer_set_modules(&writer, table, state->modules.count);
+        free(table);
+    }
+
+    mtrace_edge* node_edges = NULL;
+    size_t node_edges_capacity = 0;
+    size_t edge_idx = 0;
+
+    for (size_t idx = 0; idx < node_count && status == 0; idx++) {
+        // Edges of the nodes that were never recorded can't be saved.
+        while (edge_idx < edge_count && edges[edge_idx].source < nodes[idx].start_addr) {
+            edge_idx++;
+        }
+
+        size_t count = 0;
+
+        for (; edge_idx < edge_count && edges[edge_idx].source == nodes[idx].start_addr; edge_idx++) {
+            if (count == node_edges_capacity) {
+                node_edges_capacity = node_edges_capacity ? 2 * node_edges_capacity : 64;
+                node_edges = (mtrace_edge *) realloc(node_edges, node_edges_capacity * sizeof(mtrace_edge));
+                if (node_edges == NULL) {
+                    fprintf(stderr, "mtrace-merge: Out of memory!\n");
+                    exit(1);
+                }
+            }
+
+            node_edges[count++] = edges[edge_idx].edge;
+        }
+
+        status = mtrace_writer_add_node(&writer, &nodes[idx], node_edges, count);
+    }
+
+    for (size_t idx = 0; idx < state->threads.count && status == 0; idx++) {
+        if (idx == 0 || compare_threads(&threads[idx], &threads[idx - 1]) != 0) {
+            status = mtrace_writer_add_thread(&writer, &threads[idx]);
+        }
+    }
+
+    if (mtrace_writer_close(&writer) || status) {
+        fprintf(stderr, "mtrace-merge: Couldn't write %s: %s!\n", path, strerror(errno));
+        status = 1;
+    }
+
+    fprintf(stderr, "mtrace-merge: Merged %zu traces into %zu nodes and %zu edges\n", state->path_count, node_count,
+            edge_count);
+
+    free(node_edges);
+    free(edges);
+    free(nodes);
+
+    return status;
+}
+
+/*
+    Copy the path of a trace into the array of paths.
+*/
+static void push_path(merge_array* paths, const char* path) {
+    char* copy = strdup(path);
+    if (copy == NULL) {
+        fprintf(stderr, "mtrace-merge: Out of memory!\n");
+        exit(1);
+    }
+
+    *(char **) array_push(paths, sizeof(char *)) = copy;
+}
+
+/*
+    Read the paths of the traces from the arguments, expanding - to the lines of the standard input. The paths are
+    copies released by destroy_state.
+*/
+static char** read_paths(char** args, int arg_count, size_t* count) {
+    merge_array paths = {NULL, 0, 0};
+
+    for (int arg = 0; arg < arg_count; arg++) {
+        if (strcmp(args[arg], "-") != 0) {
+            push_path(&paths, args[arg]);
+            continue;
+        }
+
+        char* line = NULL;
+        size_t size = 0;
+        ssize_t length;
+
+        while ((length = getline(&line, &size, stdin)) > 0) {
+            line[strcspn(line, "\n")] = '\0';
+            if (line[0] != '\0') {
+                push_path(&paths, line);
+            }
+        }
+        free(line);
+    }
+
+    *count = paths.count;
+
+    return (char **) paths.data;
+}
+
+static int merge(int thread_count, const char* output, char** args, int arg_count) {
+    merge_state state;
+    init_state(&state);
+
+    int status = 1;
+
+    state.paths = read_paths(args, arg_count, &state.path_count);
+    if (state.path_count == 0) {
+        fprintf(stderr, "mtrace-merge: No traces to merge!\n");
+        goto out;
+    }
+
+    // The first trace determines the encoding of the output, its binary becomes module 0 and its main is kept.
+    mtrace_file first;
+    merge_batch batch;
+    memset(&batch, 0, sizeof(batch));
+
+    if (mtrace_open(&first, state.paths[0])) {
+        fprintf(stderr, "mtrace-merge: Couldn't open %s: %s!\n", state.paths[0], strerror(errno));
+        goto out;
+    }
+
+    state.modules_flag = (first.flags & MTRACE_FLAG_MODULES) != 0;
+    state.exec_counts = true;
+
+    uint64_t base_addr = first.base_addr;
+    uint64_t main_addr = first.main_addr;
+
+    bool malformed = map_modules(&state, &first, &batch) || !map_addr(&first, &batch, &main_addr);
+
+    mtrace_close(&first);
+    free_batch(&batch);
+
+    if (malformed) {
+        fprintf(stderr, "mtrace-merge: Malformed trace %s!\n", state.paths[0]);
+        goto out;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if ((size_t) thread_count > state.path_count) {
+        thread_count = state.path_count;
+    }
+
+    pthread_t* threads = (pthread_t *) malloc(thread_count * sizeof(pthread_t));
+    if (threads == NULL) {
+        fprintf(stderr, "mtrace-merge: Out of memory!\n");
+        goto out;
+    }
+
+    int started = 0;
+    for (; started < thread_count; started++) {
+        if (pthread_create(&threads[started], NULL, merge_worker, &state)) {
+            break;
+        }
+    }
+    if (started == 0) {
+        merge_worker(&state);
+    }
+    for (int idx = 0; idx < started; idx++) {
+        pthread_join(threads[idx], NULL);
+    }
+    free(threads);
+
+    if (state.error[0] != '\0') {
+        fprintf(stderr, "mtrace-merge: %s!\n", state.error);
+        goto out;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) * 1e-9;
+    fprintf(stderr, "mtrace-merge: Parsed %zu traces on %d threads in %lfs\n", state.path_count,
+            started ? started : 1, elapsed);
+
+    status = write_output(&state, output, base_addr, main_addr);
+
+out:
+    destroy_state(&state);
+
+    return status;
+}
+
+/*
+    Print the nodes, node types and edges of the new trace that are missing from the old trace.
+*/
+static int diff(const char* old_path, const char* new_path) {
+    merge_state state;
+    merge_batch batch;
+    mtrace_file old_trace;
+
+    init_state(&state);
+    memset(&batch, 0, sizeof(batch));
+
+    if (mtrace_open(&old_trace, old_path)) {
+        fprintf(stderr, "mtrace-merge: Couldn't open %s: %s!\n", old_path, strerror(errno));
+        destroy_state(&state);
+        return 1;
+    }
+    state.modules_flag = (old_trace.flags & MTRACE_FLAG_MODULES) != 0;
+    mtrace_close(&old_trace);
+
+    mtrace_file trace;
+
+    if (merge_trace(&state, old_path, &batch) || open_input(&state, &trace, new_path, &batch)) {
+        fprintf(stderr, "mtrace-merge: %s!\n", state.error);
+        free_batch(&batch);
+        destroy_state(&state);
+        return 1;
+    }
+
+    char start[MTRACE_ADDR_STRING_SIZE], end[MTRACE_ADDR_STRING_SIZE], target[MTRACE_ADDR_STRING_SIZE];
+    uint64_t new_nodes = 0;
+    uint64_t new_types = 0;
+    uint64_t new_edges = 0;
+
+    mtrace_node_iter iter;
+    mtrace_node node;
+    int ret;
+
+    // Lookups use the output encoding of the addresses, but the addresses are printed as stored in the new trace.
+    mtrace_node_iter_init(&iter, &trace);
+    while ((ret = mtrace_node_iter_next(&iter, &node)) == 1) {
+        uint64_t mapped_start = node.start_addr;
+        if (!map_addr(&trace, &batch, &mapped_start)) {
+            ret = -1;
+            break;
+        }
+
+        merge_shard* shard = &state.shards[shard_of(mapped_start)];
+        mtrace_node* known = find_node(shard, mapped_start);
+
+        mtrace_format_addr(&trace, node.start_addr, start);
+        mtrace_format_addr(&trace, node.end_addr, end);
+
+        if (known == NULL) {
+            printf("new node %s-%s type 0x%x\n", start, end, node.type);
+            new_nodes++;
+        } else if ((known->type | node.type) != known->type) {
+            printf("new type %s-%s type 0x%x (was 0x%x)\n", start, end, node.type, known->type);
+            new_types++;
+        }
+
+        mtrace_edge_iter edge_iter;
+        mtrace_edge edge;
+
+        mtrace_edge_iter_init(&edge_iter, &trace, &node);
+        while ((ret = mtrace_edge_iter_next(&edge_iter, &edge)) == 1) {
+            merge_edge mapped;
+
+            mapped.source = mapped_start;
+            mapped.edge = edge;
+            if (!map_addr(&trace, &batch, &mapped.edge.target)) {
+                ret = -1;
+                break;
+            }
+
+            if (find_edge(shard, &mapped) == NULL) {
+                printf("new edge %s -> %s type %u\n", start, mtrace_format_addr(&trace, edge.target, target),
+                       edge.type);
+                new_edges++;
+            }
+        }
+        if (ret < 0) {
+            break;
+        }
+    }
+
+    mtrace_close(&trace);
+    free_batch(&batch);
+    destroy_state(&state);
+
+    if (ret < 0) {
+        fprintf(stderr, "mtrace-merge: Malformed trace %s!\n", new_path);
+        return 1;
+    }
+
+    printf("%" PRIu64 " new nodes, %" PRIu64 " new node types, %" PRIu64 " new edges\n", new_nodes, new_types,
+           new_edges);
+
+    return 0;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-j <threads>] <output> <trace>...\n"
+            "       %s -d <old-trace> <new-trace>\n", name, name);
+}
+
+int main(int argc, char** argv) {
+    long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    int arg = 1;
+
+    if (argc == 4 && strcmp(argv[1], "-d") == 0) {
+        return diff(argv[2], argv[3]);
+    }
+
+    if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+        char* end;
+        thread_count = strtol(argv[2], &end, 10);
+        if (*end != '\0' || thread_count < 1) {
+            usage(argv[0]);
+            return 1;
+        }
+        arg = 3;
+    }
+
+    if (argc - arg < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    return merge(thread_count > 0 ? (int) thread_count : 1, argv[arg], argv + arg + 1, argc - arg - 1);
+}
@@ -0,0 +1,387 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Decode the paths saved with PATH_RECORDING. Prints the number of executed and unique blocks of every thread, the
+    size of its path and how many blocks were saved as repetitions. With -p prints every executed block instead, as
+    <thread id> <start address> in the order of execution, with addresses formatted as by mtrace-dump (blocks of a
+    thread killed before it saved its blocks are printed as #<order id>).
+
+    Usage: mtrace-path [-p] <path>
+*/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mtrace_reader.h"
+
+// STRUCTS
+
+typedef struct {
+    uint64_t order_id; // Order id of the block in the thread.
+    uint64_t addr; // Start address of the block (encoded as with MTRACE_FLAG_MODULES).
+} path_block;
+
+/*
+    Decoding state and statistics of a single thread.
+*/
+typedef struct {
+    uint64_t id; // Id of the thread.
+    uint32_t history[MTRACE_PATH_MAX_DISTANCE]; // Ring of the most recent ids.
+    uint64_t executed; // Number of blocks decoded so far.
+    uint64_t repeated; // Number of blocks decoded from repetitions.
+    uint64_t repetitions; // Number of repetitions.
+    uint64_t bytes; // Size of the records of the path.
+    path_block* blocks; // Blocks of the thread sorted by the order id.
+    uint64_t block_count; // Number of blocks.
+} path_thread;
+
+typedef struct {
+    path_thread* threads; // Threads in the order of their first record.
+    uint64_t count; // Number of threads.
+    uint64_t capacity; // Number of allocated threads.
+} path_threads;
+
+// FUNCTIONS
+
+static path_thread* get_thread(path_threads* threads, uint64_t id) {
+    for (uint64_t idx = 0; idx < threads->count; idx++) {
+        if (threads->threads[idx].id == id) {
+            return &threads->threads[idx];
+        }
+    }
+
+    if (threads->count == threads->capacity) {
+        uint64_t capacity = threads->capacity ? 2 * threads->capacity : 16;
+        path_thread* grown = (path_thread *) realloc(threads->threads, capacity * sizeof(path_thread));
+        if (grown == NULL) {
+            return NULL;
+        }
+        threads->threads = grown;
+        threads->capacity = capacity;
+    }
+
+    path_thread* thread = &threads->threads[threads->count++];
+    memset(thread, 0, sizeof(path_thread));
+    thread->id = id;
+
+    return thread;
+}
+
+static int compare_blocks(const void* left, const void* right) {
+    uint64_t left_id = ((const path_block *) left)->order_id;
+    uint64_t right_id = ((const path_block *) right)->order_id;
+
+    return left_id < right_id ? -1 : left_id > right_id;
+}
+
+/*
+    Format the block the same way as mtrace_format_addr formats the addresses of the traces with modules.
+*/
+static const char* format_block(const path_thread* thread, uint32_t order_id, char* out) {
+    path_block key = {order_id, 0};
+    const path_block* block = (const path_block *) bsearch(&key, thread->blocks, thread->block_count,
+                                                           sizeof(path_block), compare_blocks);
+
+    if (block == NULL) {
+        snprintf(out, MTRACE_ADDR_STRING_SIZE, "#%" PRIu32, order_id);
+    } else if (mtrace_module_id(block->addr) == 0) {
+        snprintf(out, MTRACE_ADDR_STRING_SIZE, "0x%" PRIx64, block->addr);
+    } else if (mtrace_module_id(block->addr) == MTRACE_MODULE_UNKNOWN) {
+        snprintf(out, MTRACE_ADDR_STRING_SIZE, "?:0x%" PRIx64, mtrace_module_offset(block->addr));
+    } else {
+        snprintf(out, MTRACE_ADDR_STRING_SIZE, "%" PRIu64 ":0x%" PRIx64, mtrace_module_id(block->addr),
+                 mtrace_module_offset(block->addr));
+    }
+
+    return out;
+}
+
+/*
+    Decode the blocks record. Returns 0 on success.
+*/
+static int read_blocks(path_thread* thread, const uint8_t* in, const uint8_t* end, const uint8_t** next) {
+    uint64_t count, order_id = 0;
+    size_t size = mtrace_get_varint(in, end, &count);
+
+    // Every block takes at least two bytes.
+    if (size == 0 || count > (uint64_t) (end - in) / 2) {
+        return -1;
+    }
+    in += size;
+
+    path_block* blocks = (path_block *) realloc(thread->blocks, (thread->block_count + count) * sizeof(path_block));
+    if (blocks == NULL) {
+        return -1;
+    }
+    thread->blocks = blocks;
+
+    for (uint64_t idx = 0; idx < count; idx++) {
+        uint64_t delta, addr;
+
+        if ((size = mtrace_get_varint(in, end, &delta)) == 0) {
+            return -1;
+        }
+        in += size;
+        if ((size = mtrace_get_varint(in, end, &addr)) == 0) {
+            return -1;
+        }
+        in += size;
+
+        order_id = (uint32_t) (order_id + mtrace_zigzag_decode(delta));
+        blocks[thread->block_count].order_id = order_id;
+        blocks[thread->block_count].addr = addr;
+        thread->block_count++;
+    }
+
+    *next = in;
+
+    return 0;
+}
+
+static inline void push_block(path_thread* thread, uint32_t order_id, bool print) {
+    thread->history[thread->executed % MTRACE_PATH_MAX_DISTANCE] = order_id;
+    thread->executed++;
+
+    if (print) {
+        char addr[MTRACE_ADDR_STRING_SIZE];
+        printf("%" PRIu64 " %s\n", thread->id, format_block(thread, order_id, addr));
+    }
+}
+
+/*
+    Decode the tokens of the path record. Returns 0 on success.
+*/
+static int read_path(path_thread* thread, uint64_t count, const uint8_t* in, const uint8_t* end, bool print) {
+    uint64_t last = thread->executed + count;
+
+    while (in < end) {
+        uint64_t token;
+        size_t size = mtrace_get_varint(in, end, &token);
+        if (size == 0) {
+            return -1;
+        }
+        in += size;
+
+        if (token & 1) {
+            uint64_t distance = (token >> 1) + 1, length;
+
+            if ((size = mtrace_get_varint(in, end, &length)) == 0) {
+                return -1;
+            }
+            in += size;
+            length += MTRACE_PATH_MIN_RUN;
+
+            if (distance > MTRACE_PATH_MAX_DISTANCE || distance > thread->executed
+                || length > last - thread->executed) {
+                return -1;
+            }
+
+            for (uint64_t idx = 0; idx < length; idx++) {
+                push_block(thread, thread->history[(thread->executed - distance) % MTRACE_PATH_MAX_DISTANCE], print);
+            }
+
+            thread->repeated += length;
+            thread->repetitions++;
+        } else {
+            uint32_t previous = thread->executed ? thread->history[(thread->executed - 1) % MTRACE_PATH_MAX_DISTANCE]
+                                                 : 0;
+
+            if (thread->executed == last) {
+                return -1;
+            }
+
+            push_block(thread, (uint32_t) (previous + mtrace_zigzag_decode(token >> 1)), print);
+        }
+    }
+
+    return thread->executed == last ? 0 : -1;
+}
+
+/*
+    Decode all the records of one kind. Returns 0 on success.
+*/
+static int read_records(path_threads* threads, const uint8_t* data, size_t data_size, uint64_t kind, bool print) {
+    const uint8_t* in = data + sizeof(mtrace_path_header);
+    const uint8_t* end = data + data_size;
+
+    while (in < end) {
+        uint64_t record_kind, thread_id, count, tokens_size;
+        const uint8_t* start = in;
+        size_t size;
+
+        if ((size = mtrace_get_varint(in, end, &record_kind)) == 0) {
+            return -1;
+        }
+        in += size;
+        if ((size = mtrace_get_varint(in, end, &thread_id)) == 0) {
+            return -1;
+        }
+        in += size;
+
+        path_thread* thread = get_thread(threads, thread_id);
+        if (thread == NULL) {
+            return -1;
+        }
+
+        if (record_kind == MTRACE_PATH_RECORD_BLOCKS) {
+            const uint8_t* next = NULL;
+
+            if (kind == MTRACE_PATH_RECORD_BLOCKS) {
+                if (read_blocks(thread, in, end, &next)) {
+                    return -1;
+                }
+            } else {
+                // Blocks were already read in the first pass, only their size is needed.
+                path_thread skipped;
+                memset(&skipped, 0, sizeof(skipped));
+                int ret = read_blocks(&skipped, in, end, &next);
+                free(skipped.blocks);
+                if (ret) {
+                    return -1;
+                }
+            }
+
+            in = next;
+        } else if (record_kind == MTRACE_PATH_RECORD_PATH) {
+            if ((size = mtrace_get_varint(in, end, &count)) == 0) {
+                return -1;
+            }
+            in += size;
+            if ((size = mtrace_get_varint(in, end, &tokens_size)) == 0 || tokens_size > (uint64_t) (end - in - size)) {
+                return -1;
+            }
+            in += size;
+
+            if (kind == MTRACE_PATH_RECORD_PATH) {
+                if (read_path(thread, count, in, in + tokens_size, print)) {
+                    return -1;
+                }
+                thread->bytes += (in + tokens_size) - start;
+            }
+
+            in += tokens_size;
+        } else {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    bool print = argc == 3 && strcmp(argv[1], "-p") == 0;
+
+    if (argc != 2 && !print) {
+        fprintf(stderr, "Usage: %s [-p] <path>\n", argv[0]);
+        return 1;
+    }
+
+    const char* file_path = argv[argc - 1];
+    FILE* file = fopen(file_path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "mtrace-path: Couldn't open %s: %s!\n", file_path, strerror(errno));
+        return 1;
+    }
+
+    uint8_t* data = NULL;
+    size_t data_size = 0, capacity = 0;
+
+    while (true) {
+        if (data_size == capacity) {
+            capacity = capacity ? 2 * capacity : 1 << 20;
+            uint8_t* grown = (uint8_t *) realloc(data, capacity);
+            if (grown == NULL) {
+                fprintf(stderr, "mtrace-path: Couldn't allocate memory for %s!\n", file_path);
+                fclose(file);
+                free(data);
+                return 1;
+            }
+            data = grown;
+        }
+
+        size_t read = fread(data + data_size, 1, capacity - data_size, file);
+        if (read == 0) {
+            break;
+        }
+        data_size += read;
+    }
+
+    bool failed = ferror(file);
+    fclose(file);
+
+    mtrace_path_header header;
+    if (failed || data_size < sizeof(header)) {
+        fprintf(stderr, "mtrace-path: Couldn't read %s!\n", file_path);
+        free(data);
+        return 1;
+    }
+
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != MTRACE_PATH_MAGIC || header.version != MTRACE_PATH_VERSION) {
+        fprintf(stderr, "mtrace-path: %s is not a path of a supported version!\n", file_path);
+        free(data);
+        return 1;
+    }
+
+    // Threads save their blocks when they exit, after their path, so the blocks are read first. A truncated or
+    // malformed record stops both passes at the same place, so it is only reported once.
+    path_threads threads = {NULL, 0, 0};
+    int status = 0;
+
+    read_records(&threads, data, data_size, MTRACE_PATH_RECORD_BLOCKS, false);
+
+    for (uint64_t idx = 0; idx < threads.count; idx++) {
+        qsort(threads.threads[idx].blocks, threads.threads[idx].block_count, sizeof(path_block), compare_blocks);
+    }
+
+    if (read_records(&threads, data, data_size, MTRACE_PATH_RECORD_PATH, print)) {
+        fprintf(stderr, "mtrace-path: Path %s ends with a truncated or malformed record!\n", file_path);
+        status = 1;
+    }
+
+    if (!print) {
+        uint64_t executed = 0;
+
+        for (uint64_t idx = 0; idx < threads.count; idx++) {
+            path_thread* thread = &threads.threads[idx];
+
+            printf("thread %" PRIu64 " blocks %" PRIu64 " unique %" PRIu64 " bytes %" PRIu64
+                   " (%.3lf per block) repetitions %" PRIu64 " covering %" PRIu64 " blocks\n", thread->id,
+                   thread->executed, thread->block_count, thread->bytes,
+                   thread->executed ? thread->bytes / (double) thread->executed : 0.0, thread->repetitions,
+                   thread->repeated);
+
+            executed += thread->executed;
+        }
+
+        printf("total threads %" PRIu64 " blocks %" PRIu64 " bytes %zu (%.3lf per block)\n", threads.count, executed,
+               data_size, executed ? data_size / (double) executed : 0.0);
+    }
+
+    for (uint64_t idx = 0; idx < threads.count; idx++) {
+        free(threads.threads[idx].blocks);
+    }
+    free(threads.threads);
+    free(data);
+
+    return status;
+}
@@ -0,0 +1,104 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+
+/*
+    Print the nodes containing given addresses together with their edges. Addresses are relative to the base address
+    of the traced binary, as stored in the trace. Addresses in other modules are given as <module id>:<offset> (see
+    mtrace-dump for the module ids).
+
+    Usage: mtrace-query <trace> <address>...
+*/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mtrace_reader.h"
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <trace> <address>...\n", argv[0]);
+        return 1;
+    }
+
+    mtrace_file trace;
+    if (mtrace_open(&trace, argv[1])) {
+        fprintf(stderr, "mtrace-query: Couldn't open %s: %s!\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    int status = 0;
+
+    for (int arg = 2; arg < argc; arg++) {
+        char addr_string[MTRACE_ADDR_STRING_SIZE], start[MTRACE_ADDR_STRING_SIZE], end[MTRACE_ADDR_STRING_SIZE];
+        uint64_t addr;
+
+        if (mtrace_parse_addr(argv[arg], &addr)) {
+            fprintf(stderr, "mtrace-query: Invalid address %s!\n", argv[arg]);
+            status = 1;
+            continue;
+        }
+
+        mtrace_node node;
+        int ret = mtrace_find_node(&trace, addr, &node);
+
+        if (ret < 0) {
+            fprintf(stderr, "mtrace-query: Malformed trace %s!\n", argv[1]);
+            status = 1;
+            break;
+        }
+
+        if (ret == 0) {
+            printf("%s: not found\n", mtrace_format_addr(&trace, addr, addr_string));
+            status = 1;
+            continue;
+        }
+
+        printf("%s: node %s-%s type 0x%x", mtrace_format_addr(&trace, addr, addr_string),
+               mtrace_format_addr(&trace, node.start_addr, start), mtrace_format_addr(&trace, node.end_addr, end),
+               node.type);
+        if (node.branch_reg != UINT32_MAX) {
+            printf(" reg x%u", node.branch_reg);
+        }
+        if (node.order_id != UINT64_MAX) {
+            printf(" order %" PRIu64, node.order_id);
+        }
+        if (trace.flags & MTRACE_FLAG_EXEC_COUNTS) {
+            printf(" count %" PRIu64, node.exec_count);
+        }
+        printf("\n");
+
+        mtrace_edge_iter iter;
+        mtrace_edge edge;
+
+        mtrace_edge_iter_init(&iter, &trace, &node);
+        while (mtrace_edge_iter_next(&iter, &edge) == 1) {
+            printf("  -> %s type %u", mtrace_format_addr(&trace, edge.target, start), edge.type);
+            if (trace.flags & MTRACE_FLAG_EXEC_COUNTS) {
+                printf(" count %" PRIu64, edge.exec_count);
+            }
+            printf("\n");
+        }
+    }
+
+    mtrace_close(&trace);
+
+    return status;
+}
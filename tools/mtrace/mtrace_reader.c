@@ -0,0 +1,708 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mtrace_reader.h"
+
+#ifdef MTRACE_WITH_ZSTD
+    #include <zstd.h>
+#endif
+#ifdef MTRACE_WITH_LZ4
+    #include <lz4.h>
+#endif
+
+// CONSTANTS
+
+/*
+    Size of the fixed part of the node in version 1: begin marker, start and end address, branch register and type.
+*/
+#define V1_NODE_SIZE (3 * sizeof(uint64_t) + 2 * sizeof(uint32_t))
+
+/*
+    Size of the edge in version 1: target and type.
+*/
+#define V1_EDGE_SIZE (sizeof(uint64_t) + sizeof(uint32_t))
+
+// FUNCTIONS
+
+static inline uint64_t load_u64(const uint8_t* data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint32_t load_u32(const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+/*
+    Skip a varint without decoding it. Returns NULL if the varint is truncated.
+*/
+static inline const uint8_t* skip_varint(const uint8_t* position, const uint8_t* end) {
+    for (int size = 0; size < MTRACE_MAX_VARINT_SIZE && position < end; size++) {
+        if ((*position++ & 0x80) == 0) {
+            return position;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+    Decode a varint and advance the position. Returns 0 if the varint is truncated.
+*/
+static inline int read_varint(const uint8_t** position, const uint8_t* end, uint64_t* value) {
+    size_t size = mtrace_get_varint(*position, end, value);
+    *position += size;
+    return size != 0;
+}
+
+/*
+    Decode a module (without the id) and advance the position. Returns 0 if the module is truncated.
+*/
+static int read_module(const uint8_t** position, const uint8_t* end, mtrace_module* module) {
+    uint64_t path_size, build_id_size;
+
+    if (!read_varint(position, end, &module->base) || !read_varint(position, end, &module->size)
+        || !read_varint(position, end, &path_size) || path_size > (uint64_t) (end - *position)) {
+        return 0;
+    }
+
+    module->path = (const char *) *position;
+    module->path_size = path_size;
+    *position += path_size;
+
+    if (!read_varint(position, end, &build_id_size) || build_id_size > (uint64_t) (end - *position)) {
+        return 0;
+    }
+
+    module->build_id = *position;
+    module->build_id_size = build_id_size;
+    *position += build_id_size;
+
+    return 1;
+}
+
+/*
+    Decompress a single chunk. Returns 0 if the codec is not supported or the chunk is malformed.
+*/
+static int decompress_chunk(uint16_t codec, uint8_t* out, size_t size, const uint8_t* data, size_t compressed) {
+    switch (codec) {
+#ifdef MTRACE_WITH_ZSTD
+        case MTRACE_CODEC_ZSTD:
+            return ZSTD_decompress(out, size, data, compressed) == size;
+#endif
+#ifdef MTRACE_WITH_LZ4
+        case MTRACE_CODEC_LZ4:
+            return compressed <= INT32_MAX && size <= INT32_MAX
+                   && LZ4_decompress_safe((const char *) data, (char *) out, compressed, size) == (int) size;
+#endif
+        default:
+            (void) out;
+            (void) size;
+            (void) data;
+            (void) compressed;
+            errno = ENOTSUP;
+            return 0;
+    }
+}
+
+/*
+    Replace the mapped compressed trace with its decompressed copy. All the chunks are decompressed upfront, so the
+    iterators work the same as for uncompressed traces.
+*/
+static int decompress_trace(mtrace_file* trace) {
+    mtrace_compressed_header header;
+    memcpy(&header, trace->data, sizeof(header));
+
+    if (header.chunk_table_offset < sizeof(header) || header.chunk_table_offset > trace->size
+        || header.chunk_count > (trace->size - header.chunk_table_offset) / (3 * sizeof(uint64_t))
+        || header.size < sizeof(uint64_t) || header.size > SIZE_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint8_t* data = (uint8_t *) malloc(header.size);
+    if (data == NULL) {
+        return -1;
+    }
+
+    const uint8_t* table = trace->data + header.chunk_table_offset;
+    uint64_t size = 0;
+    errno = EINVAL;
+
+    for (uint64_t idx = 0; idx < header.chunk_count; idx++) {
+        uint64_t offset = load_u64(table + (3 * idx) * sizeof(uint64_t));
+        uint64_t compressed = load_u64(table + (3 * idx + 1) * sizeof(uint64_t));
+        uint64_t chunk_size = load_u64(table + (3 * idx + 2) * sizeof(uint64_t));
+
+        if (offset < sizeof(header) || offset > header.chunk_table_offset
+            || compressed > header.chunk_table_offset - offset || chunk_size > header.size - size
+            || !decompress_chunk(header.codec, data + size, chunk_size, trace->data + offset, compressed)) {
+            free(data);
+            return -1;
+        }
+
+        size += chunk_size;
+    }
+
+    if (size != header.size) {
+        free(data);
+        return -1;
+    }
+
+    munmap((void *) trace->data, trace->size);
+    trace->data = data;
+    trace->size = size;
+    trace->compressed = 1;
+
+    return 0;
+}
+
+int mtrace_open(mtrace_file* trace, const char* path) {
+    memset(trace, 0, sizeof(*trace));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    if (info.st_size < (off_t) sizeof(uint64_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+
+    trace->data = (const uint8_t *) data;
+    trace->size = info.st_size;
+
+    if (trace->size >= sizeof(mtrace_compressed_header) && load_u32(trace->data) == MTRACE_COMPRESSED_MAGIC
+        && decompress_trace(trace) != 0) {
+        int error = errno;
+        mtrace_close(trace);
+        errno = error;
+        return -1;
+    }
+
+    mtrace_header header;
+    if (trace->size >= sizeof(header)) {
+        memcpy(&header, trace->data, sizeof(header));
+    }
+
+    if (trace->size >= sizeof(header) && header.magic == MTRACE_MAGIC && (header.flags & MTRACE_FLAG_JOURNAL)) {
+        if (header.version != MTRACE_VERSION) {
+            mtrace_close(trace);
+            errno = EINVAL;
+            return -1;
+        }
+
+        // Journals don't have the nodes section, the nodes are only available as records.
+        trace->version = 2;
+        trace->flags = header.flags;
+        trace->base_addr = header.base_addr;
+        trace->nodes_begin = trace->data + trace->size;
+        trace->nodes_end = trace->data + trace->size;
+        trace->records = trace->data + sizeof(header);
+    } else if (trace->size >= sizeof(header) && header.magic == MTRACE_MAGIC) {
+        if (header.version != MTRACE_VERSION || header.index_offset < sizeof(header)
+            || header.index_offset > trace->size
+            || header.index_count > (trace->size - header.index_offset) / sizeof(uint64_t)
+            || ((header.flags & MTRACE_FLAG_THREADS)
+                && (header.threads_offset < sizeof(header) || header.threads_offset > trace->size))) {
+            mtrace_close(trace);
+            errno = EINVAL;
+            return -1;
+        }
+
+        trace->version = 2;
+        trace->flags = header.flags;
+        trace->base_addr = header.base_addr;
+        trace->main_addr = header.main_addr;
+        trace->node_count = header.node_count;
+        trace->edge_count = header.edge_count;
+        trace->nodes_begin = trace->data + sizeof(header);
+        trace->nodes_end = trace->data + header.index_offset;
+        trace->index = trace->data + header.index_offset;
+        trace->index_count = header.index_count;
+        if (header.flags & MTRACE_FLAG_THREADS) {
+            trace->threads = trace->data + header.threads_offset;
+        }
+
+        // The module table has no offset in the header, the nodes start right after it.
+        if (header.flags & MTRACE_FLAG_MODULES) {
+            const uint8_t* position = trace->nodes_begin;
+            mtrace_module module;
+
+            trace->modules = position;
+            int valid = read_varint(&position, trace->nodes_end, &trace->module_count);
+
+            for (uint64_t idx = 0; valid && idx < trace->module_count; idx++) {
+                valid = read_module(&position, trace->nodes_end, &module);
+            }
+
+            if (!valid) {
+                mtrace_close(trace);
+                errno = EINVAL;
+                return -1;
+            }
+
+            trace->nodes_begin = position;
+        }
+    } else {
+        trace->version = 1;
+        trace->main_addr = load_u64(trace->data);
+        trace->nodes_begin = trace->data + sizeof(uint64_t);
+        trace->nodes_end = trace->data + trace->size;
+    }
+
+    return 0;
+}
+
+void mtrace_close(mtrace_file* trace) {
+    if (trace->compressed) {
+        free((void *) trace->data);
+    } else if (trace->data != NULL) {
+        munmap((void *) trace->data, trace->size);
+    }
+    memset(trace, 0, sizeof(*trace));
+}
+
+void mtrace_node_iter_init(mtrace_node_iter* iter, const mtrace_file* trace) {
+    iter->trace = trace;
+    iter->position = trace->nodes_begin;
+    iter->node_idx = 0;
+    iter->previous_start = 0;
+}
+
+static int node_iter_next_v1(mtrace_node_iter* iter, mtrace_node* node) {
+    const uint8_t* position = iter->position;
+    const uint8_t* end = iter->trace->nodes_end;
+
+    if (position == end) {
+        return 0;
+    }
+
+    if ((size_t) (end - position) < V1_NODE_SIZE || (int64_t) load_u64(position) != MTRACE_V1_BEGIN_NODE) {
+        return -1;
+    }
+
+    node->start_addr = load_u64(position + 8);
+    node->end_addr = load_u64(position + 16);
+    node->branch_reg = load_u32(position + 24);
+    node->type = load_u32(position + 28);
+    node->exec_count = 0;
+    node->order_id = UINT64_MAX;
+    node->version = 1;
+    node->flags = 0;
+
+    position += V1_NODE_SIZE;
+    node->edges = position;
+    node->edge_count = 0;
+
+    // Edges are not counted in version 1, so they have to be skipped until the beginning of the next node.
+    while (position < end) {
+        if ((size_t) (end - position) >= sizeof(uint64_t)
+            && (int64_t) load_u64(position) == MTRACE_V1_BEGIN_NODE) {
+            break;
+        }
+        if ((size_t) (end - position) < V1_EDGE_SIZE) {
+            return -1;
+        }
+        position += V1_EDGE_SIZE;
+        node->edge_count++;
+    }
+
+    iter->position = position;
+    iter->node_idx++;
+
+    return 1;
+}
+
+static int node_iter_next_v2(mtrace_node_iter* iter, mtrace_node* node) {
+    const uint8_t* position = iter->position;
+    const uint8_t* end = iter->trace->nodes_end;
+
+    if (iter->node_idx == iter->trace->node_count) {
+        return 0;
+    }
+
+    uint16_t flags = iter->trace->flags;
+    uint64_t start, size, type, branch_reg, edge_count;
+    uint64_t order_id = UINT64_MAX;
+    uint64_t exec_count = 0;
+
+    if (!read_varint(&position, end, &start) || !read_varint(&position, end, &size)
+        || !read_varint(&position, end, &type) || !read_varint(&position, end, &branch_reg)
+        || ((flags & MTRACE_FLAG_ORDER) && !read_varint(&position, end, &order_id))
+        || ((flags & MTRACE_FLAG_EXEC_COUNTS) && !read_varint(&position, end, &exec_count))
+        || !read_varint(&position, end, &edge_count)) {
+        return -1;
+    }
+
+    if (iter->node_idx % MTRACE_INDEX_INTERVAL != 0) {
+        start += iter->previous_start;
+    }
+
+    node->start_addr = start;
+    node->end_addr = start + size;
+    node->type = (uint32_t) type;
+    node->branch_reg = (uint32_t) (branch_reg - 1);
+    node->exec_count = exec_count;
+    node->order_id = order_id;
+    node->edge_count = edge_count;
+    node->edges = position;
+    node->version = 2;
+    node->flags = flags;
+
+    uint64_t edge_fields = (flags & MTRACE_FLAG_EXEC_COUNTS) ? 3 : 2;
+
+    for (uint64_t idx = 0; idx < edge_fields * edge_count; idx++) {
+        position = skip_varint(position, end);
+        if (position == NULL) {
+            return -1;
+        }
+    }
+
+    iter->position = position;
+    iter->previous_start = start;
+    iter->node_idx++;
+
+    return 1;
+}
+
+int mtrace_node_iter_next(mtrace_node_iter* iter, mtrace_node* node) {
+    if (iter->trace->version == 1) {
+        return node_iter_next_v1(iter, node);
+    }
+
+    return node_iter_next_v2(iter, node);
+}
+
+void mtrace_edge_iter_init(mtrace_edge_iter* iter, const mtrace_file* trace, const mtrace_node* node) {
+    iter->position = node->edges;
+    iter->end = trace->nodes_end;
+    iter->edge_idx = 0;
+    iter->edge_count = node->edge_count;
+    iter->node_start = node->start_addr;
+    iter->previous_target = 0;
+    iter->version = node->version;
+    iter->flags = node->flags;
+}
+
+int mtrace_edge_iter_next(mtrace_edge_iter* iter, mtrace_edge* edge) {
+    if (iter->edge_idx == iter->edge_count) {
+        return 0;
+    }
+
+    if (iter->version == 1) {
+        if ((size_t) (iter->end - iter->position) < V1_EDGE_SIZE) {
+            return -1;
+        }
+
+        edge->target = load_u64(iter->position);
+        edge->type = load_u32(iter->position + sizeof(uint64_t));
+        edge->exec_count = 0;
+        iter->position += V1_EDGE_SIZE;
+    } else {
+        uint64_t target, type;
+        uint64_t exec_count = 0;
+
+        if (!read_varint(&iter->position, iter->end, &target) || !read_varint(&iter->position, iter->end, &type)
+            || ((iter->flags & MTRACE_FLAG_EXEC_COUNTS) && !read_varint(&iter->position, iter->end, &exec_count))) {
+            return -1;
+        }
+
+        if (iter->edge_idx == 0) {
+            edge->target = iter->node_start + (uint64_t) mtrace_zigzag_decode(target);
+        } else {
+            edge->target = iter->previous_target + target;
+        }
+        edge->type = (uint32_t) type;
+        edge->exec_count = exec_count;
+
+        iter->previous_target = edge->target;
+    }
+
+    iter->edge_idx++;
+
+    return 1;
+}
+
+/*
+    Look for the node containing addr among the nodes starting at the given index entry. Only nodes starting at or
+    before addr are considered and the one starting closest to addr wins.
+*/
+static int find_node_from_index(const mtrace_file* trace, uint64_t index_idx, uint64_t addr, mtrace_node* node) {
+    mtrace_node_iter iter;
+    mtrace_node candidate;
+    int found = 0;
+    int ret;
+
+    mtrace_node_iter_init(&iter, trace);
+    iter.position = trace->data + load_u64(trace->index + index_idx * sizeof(uint64_t));
+    iter.node_idx = index_idx * MTRACE_INDEX_INTERVAL;
+
+    if (iter.position < trace->nodes_begin || iter.position > trace->nodes_end) {
+        return -1;
+    }
+
+    while ((ret = mtrace_node_iter_next(&iter, &candidate)) == 1 && candidate.start_addr <= addr) {
+        if (addr <= candidate.end_addr) {
+            *node = candidate;
+            found = 1;
+        }
+    }
+
+    return ret < 0 ? ret : found;
+}
+
+int mtrace_find_node(const mtrace_file* trace, uint64_t addr, mtrace_node* node) {
+    if (trace->version == 1) {
+        mtrace_node_iter iter;
+        mtrace_node candidate;
+        int found = 0;
+        int ret;
+
+        mtrace_node_iter_init(&iter, trace);
+        while ((ret = mtrace_node_iter_next(&iter, &candidate)) == 1) {
+            if (candidate.start_addr <= addr && addr <= candidate.end_addr
+                && (!found || candidate.start_addr > node->start_addr)) {
+                *node = candidate;
+                found = 1;
+            }
+        }
+
+        return ret < 0 ? ret : found;
+    }
+
+    if (trace->index_count == 0) {
+        return 0;
+    }
+
+    // Binary search for the last index entry whose node starts at or before addr.
+    uint64_t low = 0;
+    uint64_t high = trace->index_count;
+
+    while (high - low > 1) {
+        uint64_t middle = low + (high - low) / 2;
+        const uint8_t* position = trace->data + load_u64(trace->index + middle * sizeof(uint64_t));
+        uint64_t start;
+
+        if (position < trace->nodes_begin || mtrace_get_varint(position, trace->nodes_end, &start) == 0) {
+            return -1;
+        }
+
+        if (start <= addr) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    int ret = find_node_from_index(trace, low, addr, node);
+
+    // A long block starting in the previous interval may still cover addr.
+    if (ret == 0 && low > 0) {
+        ret = find_node_from_index(trace, low - 1, addr, node);
+    }
+
+    return ret;
+}
+
+void mtrace_thread_iter_init(mtrace_thread_iter* iter, const mtrace_file* trace) {
+    iter->position = trace->threads;
+    iter->end = trace->data + trace->size;
+    iter->thread_idx = 0;
+    iter->thread_count = 0;
+
+    // A truncated count is reported by the first call to mtrace_thread_iter_next.
+    if (iter->position != NULL && !read_varint(&iter->position, iter->end, &iter->thread_count)) {
+        iter->thread_count = 1;
+    }
+}
+
+int mtrace_thread_iter_next(mtrace_thread_iter* iter, mtrace_thread* thread) {
+    if (iter->thread_idx == iter->thread_count) {
+        return 0;
+    }
+
+    if (!read_varint(&iter->position, iter->end, &thread->entry_addr)
+        || !read_varint(&iter->position, iter->end, &thread->call_site)) {
+        return -1;
+    }
+
+    iter->thread_idx++;
+
+    return 1;
+}
+
+void mtrace_module_iter_init(mtrace_module_iter* iter, const mtrace_file* trace) {
+    iter->position = trace->modules;
+    iter->end = trace->data + trace->size;
+    iter->module_idx = 0;
+    iter->module_count = 0;
+
+    // The module table was validated by mtrace_open.
+    if (iter->position != NULL) {
+        read_varint(&iter->position, iter->end, &iter->module_count);
+    }
+}
+
+int mtrace_module_iter_next(mtrace_module_iter* iter, mtrace_module* module) {
+    if (iter->module_idx == iter->module_count) {
+        return 0;
+    }
+
+    if (!read_module(&iter->position, iter->end, module)) {
+        return -1;
+    }
+
+    module->id = iter->module_idx++;
+
+    return 1;
+}
+
+void mtrace_record_iter_init(mtrace_record_iter* iter, const mtrace_file* trace) {
+    iter->trace = trace;
+    iter->position = trace->records != NULL ? trace->records : trace->data + trace->size;
+}
+
+int mtrace_record_iter_next(mtrace_record_iter* iter, mtrace_record* record) {
+    const uint8_t* position = iter->position;
+    const uint8_t* end = iter->trace->data + iter->trace->size;
+    uint64_t kind;
+
+    if (position == end) {
+        return 0;
+    }
+
+    if (!read_varint(&position, end, &kind)) {
+        return -1;
+    }
+
+    record->kind = (uint32_t) kind;
+
+    if (kind == MTRACE_RECORD_NODE) {
+        uint64_t start, size, type, branch_reg, edge_count;
+
+        if (!read_varint(&position, end, &start) || !read_varint(&position, end, &size)
+            || !read_varint(&position, end, &type) || !read_varint(&position, end, &branch_reg)
+            || !read_varint(&position, end, &record->node.order_id) || !read_varint(&position, end, &edge_count)) {
+            return -1;
+        }
+
+        record->node.start_addr = start;
+        record->node.end_addr = start + size;
+        record->node.type = (uint32_t) type;
+        record->node.branch_reg = (uint32_t) (branch_reg - 1);
+        record->node.exec_count = 0;
+        record->node.edge_count = edge_count;
+        record->node.edges = position;
+        record->node.version = 2;
+        // Edges of the records never carry execution counts.
+        record->node.flags = 0;
+
+        for (uint64_t idx = 0; idx < 2 * edge_count; idx++) {
+            position = skip_varint(position, end);
+            if (position == NULL) {
+                return -1;
+            }
+        }
+    } else if (kind == MTRACE_RECORD_TARGET || kind == MTRACE_RECORD_THREAD) {
+        if (!read_varint(&position, end, &record->addr) || !read_varint(&position, end, &record->target)) {
+            return -1;
+        }
+    } else if (kind == MTRACE_RECORD_MAIN) {
+        if (!read_varint(&position, end, &record->addr)) {
+            return -1;
+        }
+    } else if (kind == MTRACE_RECORD_MODULE) {
+        if (!read_varint(&position, end, &record->module.id) || !read_module(&position, end, &record->module)) {
+            return -1;
+        }
+    } else {
+        return -1;
+    }
+
+    iter->position = position;
+
+    return 1;
+}
+
+const char* mtrace_format_addr(const mtrace_file* trace, uint64_t addr, char* out) {
+    uint64_t id = mtrace_module_id(addr);
+
+    if (!(trace->flags & MTRACE_FLAG_MODULES) || id == 0) {
+        snprintf(out, MTRACE_ADDR_STRING_SIZE, "0x%" PRIx64, addr);
+    } else if (id == MTRACE_MODULE_UNKNOWN) {
+        snprintf(out, MTRACE_ADDR_STRING_SIZE, "?:0x%" PRIx64, mtrace_module_offset(addr));
+    } else {
+        snprintf(out, MTRACE_ADDR_STRING_SIZE, "%" PRIu64 ":0x%" PRIx64, id, mtrace_module_offset(addr));
+    }
+
+    return out;
+}
+
+int mtrace_parse_addr(const char* text, uint64_t* addr) {
+    const char* separator = strchr(text, ':');
+    uint64_t id = 0;
+    char* end;
+
+    if (separator != NULL) {
+        if (separator == text + 1 && text[0] == '?') {
+            id = MTRACE_MODULE_UNKNOWN;
+        } else {
+            id = strtoull(text, &end, 0);
+            if (end != separator || id > MTRACE_MODULE_UNKNOWN) {
+                return -1;
+            }
+        }
+        text = separator + 1;
+    }
+
+    uint64_t offset = strtoull(text, &end, 0);
+    if (*text == '\0' || *end != '\0' || (separator != NULL && mtrace_module_id(offset) != 0)) {
+        return -1;
+    }
+
+    *addr = mtrace_module_addr(id, offset);
+
+    return 0;
+}
@@ -0,0 +1,311 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Host-portable reader of the .mtrace files. The trace is mapped into memory and nodes and edges are decoded in place
+    by the iterators, so no part of the trace is copied. Both the legacy (version 1) and the compact (version 2)
+    formats are supported; see plugins/trace/mtrace_format.h for their layout. Compressed traces are decompressed into
+    memory when opened, which requires the reader to be built with MTRACE_WITH_ZSTD or MTRACE_WITH_LZ4 (and linked
+    with -lzstd or -llz4 respectively).
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../../plugins/trace/mtrace_format.h"
+
+// STRUCTS
+
+/*
+    Trace mapped into memory.
+*/
+typedef struct {
+    const uint8_t* data; // Mapped file.
+    size_t size; // Size of the mapped file.
+    int compressed; // Whether data is the decompressed copy of a compressed trace (allocated with malloc).
+    int version; // Version of the format (1 or 2).
+    uint16_t flags; // Optional content of the trace (MTRACE_FLAG_*, version 2 only).
+    uint64_t base_addr; // Base address of the traced binary (0 if unknown, i.e., in version 1).
+    uint64_t main_addr; // Address of the main function relative to base_addr (or to its module).
+    uint64_t node_count; // Number of nodes (only known upfront in version 2).
+    uint64_t edge_count; // Number of edges (only known upfront in version 2).
+    const uint8_t* nodes_begin; // First byte of the first node.
+    const uint8_t* nodes_end; // First byte after the last node.
+    const uint8_t* index; // Index of node offsets (version 2 only).
+    uint64_t index_count; // Number of entries in the index.
+    const uint8_t* threads; // Thread spawns (only with MTRACE_FLAG_THREADS).
+    const uint8_t* modules; // Module table (only with MTRACE_FLAG_MODULES, journals log the modules as records).
+    uint64_t module_count; // Number of modules in the module table.
+    const uint8_t* records; // First record of the journal (only with MTRACE_FLAG_JOURNAL).
+} mtrace_file;
+
+/*
+    Node decoded from the trace. Addresses are relative to base_addr of the trace or, with MTRACE_FLAG_MODULES, encoded
+    as (module id, offset), see mtrace_module_addr.
+*/
+typedef struct {
+    uint64_t start_addr; // Start address of the basic block.
+    uint64_t end_addr; // Address of the last instruction of the basic block.
+    uint32_t type; // Bitmask of cfg_node_type.
+    uint32_t branch_reg; // Register used by the indirect branch or UINT32_MAX if none.
+    uint64_t exec_count; // Number of executions of the node (0 unless the trace has MTRACE_FLAG_EXEC_COUNTS).
+    uint64_t order_id; // Order of the first execution of the node or UINT64_MAX if the trace doesn't record it.
+    uint64_t edge_count; // Number of edges of the node.
+    const uint8_t* edges; // Encoded edges of the node.
+    int version; // Version of the format the edges are encoded in.
+    uint16_t flags; // Flags of the trace the node was decoded from.
+} mtrace_node;
+
+/*
+    Edge decoded from the trace.
+*/
+typedef struct {
+    uint64_t target; // Target of the edge, encoded as the addresses of the nodes.
+    uint32_t type; // Value of cfg_edge_type.
+    uint64_t exec_count; // Number of times the edge was followed (0 unless the trace has MTRACE_FLAG_EXEC_COUNTS).
+} mtrace_edge;
+
+/*
+    Thread spawned by the traced application. Addresses are encoded as the addresses of the nodes.
+*/
+typedef struct {
+    uint64_t entry_addr; // Start routine of the thread.
+    uint64_t call_site; // Function call that spawned the thread.
+} mtrace_thread;
+
+/*
+    Module of the traced process (see MTRACE_FLAG_MODULES). The path and the build-id point into the mapped trace and
+    are not NUL-terminated.
+*/
+typedef struct {
+    uint64_t id; // Id of the module used in the encoded addresses.
+    uint64_t base; // Load address of the module in the traced process.
+    uint64_t size; // Size of the address range of the module.
+    const char* path; // Path of the module, empty for anonymous code.
+    size_t path_size; // Length of the path.
+    const uint8_t* build_id; // GNU build-id of the module.
+    size_t build_id_size; // Size of the build-id, 0 if unknown.
+} mtrace_module;
+
+/*
+    Iterator over all the nodes of the trace.
+*/
+typedef struct {
+    const mtrace_file* trace;
+    const uint8_t* position; // Next byte to decode.
+    uint64_t node_idx; // Number of the next node in the trace.
+    uint64_t previous_start; // Start address of the previous node (version 2 only).
+} mtrace_node_iter;
+
+/*
+    Iterator over edges of a single node.
+*/
+typedef struct {
+    const uint8_t* position; // Next byte to decode.
+    const uint8_t* end; // End of the nodes section.
+    uint64_t edge_idx; // Number of the next edge of the node.
+    uint64_t edge_count; // Number of edges of the node.
+    uint64_t node_start; // Start address of the node the edges belong to.
+    uint64_t previous_target; // Target of the previous edge.
+    int version; // Version of the format.
+    uint16_t flags; // Flags of the trace.
+} mtrace_edge_iter;
+
+/*
+    Iterator over the thread spawns of the trace.
+*/
+typedef struct {
+    const uint8_t* position; // Next byte to decode.
+    const uint8_t* end; // End of the trace.
+    uint64_t thread_idx; // Number of the next thread.
+    uint64_t thread_count; // Number of threads.
+} mtrace_thread_iter;
+
+/*
+    Iterator over the module table of the trace.
+*/
+typedef struct {
+    const uint8_t* position; // Next byte to decode.
+    const uint8_t* end; // End of the trace.
+    uint64_t module_idx; // Number (and id) of the next module.
+    uint64_t module_count; // Number of modules.
+} mtrace_module_iter;
+
+/*
+    Record of the journal (see MTRACE_FLAG_JOURNAL).
+*/
+typedef struct {
+    uint32_t kind; // MTRACE_RECORD_*.
+    mtrace_node node; // Discovered node (MTRACE_RECORD_NODE); its edges can be decoded with mtrace_edge_iter.
+    uint64_t addr; // Node ending in the indirect branch (TARGET), thread start routine (THREAD) or main (MAIN).
+    uint64_t target; // Target of the indirect branch (TARGET) or the call site spawning the thread (THREAD).
+    mtrace_module module; // New module (MTRACE_RECORD_MODULE).
+} mtrace_record;
+
+/*
+    Iterator over the records of the journal.
+*/
+typedef struct {
+    const mtrace_file* trace;
+    const uint8_t* position; // Next byte to decode.
+} mtrace_record_iter;
+
+// CONSTANTS
+
+/*
+    Size of the buffer large enough for any address formatted with mtrace_format_addr.
+*/
+#define MTRACE_ADDR_STRING_SIZE 32
+
+// FUNCTIONS
+
+/**
+ * Map the trace into memory and validate its header.
+ *
+ * @param trace Trace to be initialized.
+ * @param path Path of the trace file.
+ * @return 0 on success, -1 on failure (errno is set for I/O errors, EINVAL for malformed traces).
+ */
+int mtrace_open(mtrace_file* trace, const char* path);
+
+/**
+ * Unmap the trace.
+ *
+ * @param trace Trace opened with mtrace_open.
+ */
+void mtrace_close(mtrace_file* trace);
+
+/**
+ * Position the iterator at the first node of the trace.
+ *
+ * @param iter Iterator to be initialized.
+ * @param trace Opened trace.
+ */
+void mtrace_node_iter_init(mtrace_node_iter* iter, const mtrace_file* trace);
+
+/**
+ * Decode the next node of the trace.
+ *
+ * @param iter Node iterator.
+ * @param node Decoded node.
+ * @return 1 if the node was decoded, 0 at the end of the trace and -1 if the trace is malformed.
+ */
+int mtrace_node_iter_next(mtrace_node_iter* iter, mtrace_node* node);
+
+/**
+ * Position the iterator at the first edge of the node.
+ *
+ * @param iter Iterator to be initialized.
+ * @param trace Trace the node was decoded from.
+ * @param node Decoded node.
+ */
+void mtrace_edge_iter_init(mtrace_edge_iter* iter, const mtrace_file* trace, const mtrace_node* node);
+
+/**
+ * Decode the next edge of the node.
+ *
+ * @param iter Edge iterator.
+ * @param edge Decoded edge.
+ * @return 1 if the edge was decoded, 0 if there are no more edges and -1 if the trace is malformed.
+ */
+int mtrace_edge_iter_next(mtrace_edge_iter* iter, mtrace_edge* edge);
+
+/**
+ * Find the node that contains the given address. Version 2 traces are searched using the index, version 1 traces
+ * are scanned linearly.
+ *
+ * @param trace Opened trace.
+ * @param addr Address encoded as the addresses of the nodes.
+ * @param node Found node.
+ * @return 1 if the node was found, 0 if not and -1 if the trace is malformed.
+ */
+int mtrace_find_node(const mtrace_file* trace, uint64_t addr, mtrace_node* node);
+
+/**
+ * Position the iterator at the first thread spawn of the trace. Traces without MTRACE_FLAG_THREADS have no threads.
+ *
+ * @param iter Iterator to be initialized.
+ * @param trace Opened trace.
+ */
+void mtrace_thread_iter_init(mtrace_thread_iter* iter, const mtrace_file* trace);
+
+/**
+ * Decode the next thread spawn.
+ *
+ * @param iter Thread iterator.
+ * @param thread Decoded thread.
+ * @return 1 if the thread was decoded, 0 if there are no more threads and -1 if the trace is malformed.
+ */
+int mtrace_thread_iter_next(mtrace_thread_iter* iter, mtrace_thread* thread);
+
+/**
+ * Position the iterator at the first module of the module table. Traces without MTRACE_FLAG_MODULES and journals
+ * (which log the modules as records) have no module table.
+ *
+ * @param iter Iterator to be initialized.
+ * @param trace Opened trace.
+ */
+void mtrace_module_iter_init(mtrace_module_iter* iter, const mtrace_file* trace);
+
+/**
+ * Decode the next module.
+ *
+ * @param iter Module iterator.
+ * @param module Decoded module.
+ * @return 1 if the module was decoded, 0 if there are no more modules and -1 if the trace is malformed.
+ */
+int mtrace_module_iter_next(mtrace_module_iter* iter, mtrace_module* module);
+
+/**
+ * Position the iterator at the first record of the journal. Traces without MTRACE_FLAG_JOURNAL have no records.
+ *
+ * @param iter Iterator to be initialized.
+ * @param trace Opened trace.
+ */
+void mtrace_record_iter_init(mtrace_record_iter* iter, const mtrace_file* trace);
+
+/**
+ * Decode the next record of the journal.
+ *
+ * @param iter Record iterator.
+ * @param record Decoded record.
+ * @return 1 if the record was decoded, 0 at the end of the journal and -1 if the record is malformed or truncated
+ *         (e.g., the traced process was killed while the record was being written).
+ */
+int mtrace_record_iter_next(mtrace_record_iter* iter, mtrace_record* record);
+
+/**
+ * Format the address for printing: 0x<offset> for addresses in the traced binary (and all the addresses of the traces
+ * without MTRACE_FLAG_MODULES), <module id>:0x<offset> for other modules and ?:0x<address> for unknown code.
+ *
+ * @param trace Trace the address was decoded from.
+ * @param addr Encoded address.
+ * @param out Output buffer of at least MTRACE_ADDR_STRING_SIZE bytes.
+ * @return out.
+ */
+const char* mtrace_format_addr(const mtrace_file* trace, uint64_t addr, char* out);
+
+/**
+ * Parse the address in either of the forms produced by mtrace_format_addr (or a plain decimal/hex number).
+ *
+ * @param text Address to be parsed.
+ * @param addr Encoded address.
+ * @return 0 on success, -1 if the text is not a valid address.
+ */
+int mtrace_parse_addr(const char* text, uint64_t* addr);
@@ -0,0 +1,253 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mtrace_writer.h"
+
+// CONSTANTS
+
+#define WRITER_BUFFER_SIZE (4 << 20)
+
+// FUNCTIONS
+
+static int put(mtrace_writer* writer, const void* data, size_t size) {
+    if (fwrite(data, 1, size, writer->file) != size) {
+        return -1;
+    }
+    writer->offset += size;
+    return 0;
+}
+
+static int put_varint(mtrace_writer* writer, uint64_t value) {
+    uint8_t encoded[MTRACE_MAX_VARINT_SIZE];
+    return put(writer, encoded, mtrace_put_varint(encoded, value));
+}
+
+int mtrace_writer_open(mtrace_writer* writer, const char* path, int version, uint64_t base_addr, uint64_t main_addr,
+                       uint16_t flags) {
+    memset(writer, 0, sizeof(*writer));
+
+    if (version != 1 && version != 2) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        return -1;
+    }
+    setvbuf(writer->file, NULL, _IOFBF, WRITER_BUFFER_SIZE);
+
+    writer->version = version;
+
+    if (version == 1) {
+        return put(writer, &main_addr, sizeof(main_addr));
+    }
+
+    writer->header.magic = MTRACE_MAGIC;
+    writer->header.version = MTRACE_VERSION;
+    writer->header.flags = flags & ~MTRACE_FLAG_MODULES;
+    writer->header.base_addr = base_addr;
+    writer->header.main_addr = main_addr;
+
+    return put(writer, &writer->header, sizeof(writer->header));
+}
+
+int mtrace_writer_set_modules(mtrace_writer* writer, const mtrace_module* modules, uint64_t count) {
+    if (writer->version != 2 || writer->offset != sizeof(writer->header)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    writer->header.flags |= MTRACE_FLAG_MODULES;
+
+    if (put_varint(writer, count)) {
+        return -1;
+    }
+
+    for (uint64_t idx = 0; idx < count; idx++) {
+        const mtrace_module* module = &modules[idx];
+
+        if (module->id != idx) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (put_varint(writer, module->base) || put_varint(writer, module->size)
+            || put_varint(writer, module->path_size) || put(writer, module->path, module->path_size)
+            || put_varint(writer, module->build_id_size) || put(writer, module->build_id, module->build_id_size)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int add_node_v1(mtrace_writer* writer, const mtrace_node* node, const mtrace_edge* edges,
+                       uint64_t edge_count) {
+    const int64_t begin_node = MTRACE_V1_BEGIN_NODE;
+
+    if (put(writer, &begin_node, sizeof(begin_node)) || put(writer, &node->start_addr, sizeof(node->start_addr))
+        || put(writer, &node->end_addr, sizeof(node->end_addr))
+        || put(writer, &node->branch_reg, sizeof(node->branch_reg)) || put(writer, &node->type, sizeof(node->type))) {
+        return -1;
+    }
+
+    for (uint64_t idx = 0; idx < edge_count; idx++) {
+        if (put(writer, &edges[idx].target, sizeof(edges[idx].target))
+            || put(writer, &edges[idx].type, sizeof(edges[idx].type))) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int add_node_v2(mtrace_writer* writer, const mtrace_node* node, const mtrace_edge* edges,
+                       uint64_t edge_count) {
+    uint64_t node_idx = writer->header.node_count;
+    int ret;
+
+    if (node_idx > 0 && node->start_addr < writer->previous_start) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (node_idx % MTRACE_INDEX_INTERVAL == 0) {
+        if (writer->header.index_count == writer->index_capacity) {
+            uint64_t capacity = writer->index_capacity ? 2 * writer->index_capacity : 1024;
+            uint64_t* index = (uint64_t *) realloc(writer->index, capacity * sizeof(uint64_t));
+            if (index == NULL) {
+                return -1;
+            }
+            writer->index = index;
+            writer->index_capacity = capacity;
+        }
+        writer->index[writer->header.index_count++] = writer->offset;
+
+        ret = put_varint(writer, node->start_addr);
+    } else {
+        ret = put_varint(writer, node->start_addr - writer->previous_start);
+    }
+
+    if (ret || put_varint(writer, node->end_addr - node->start_addr) || put_varint(writer, node->type)
+        || put_varint(writer, (uint32_t) (node->branch_reg + 1))
+        || ((writer->header.flags & MTRACE_FLAG_ORDER) && put_varint(writer, node->order_id))
+        || ((writer->header.flags & MTRACE_FLAG_EXEC_COUNTS) && put_varint(writer, node->exec_count))
+        || put_varint(writer, edge_count)) {
+        return -1;
+    }
+
+    for (uint64_t idx = 0; idx < edge_count; idx++) {
+        if (idx > 0 && edges[idx].target < edges[idx - 1].target) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        uint64_t target = idx == 0 ? mtrace_zigzag_encode((int64_t) (edges[idx].target - node->start_addr))
+                                   : edges[idx].target - edges[idx - 1].target;
+
+        if (put_varint(writer, target) || put_varint(writer, edges[idx].type)
+            || ((writer->header.flags & MTRACE_FLAG_EXEC_COUNTS) && put_varint(writer, edges[idx].exec_count))) {
+            return -1;
+        }
+    }
+
+    writer->previous_start = node->start_addr;
+    writer->header.node_count++;
+    writer->header.edge_count += edge_count;
+
+    return 0;
+}
+
+int mtrace_writer_add_node(mtrace_writer* writer, const mtrace_node* node, const mtrace_edge* edges,
+                           uint64_t edge_count) {
+    if (writer->version == 1) {
+        return add_node_v1(writer, node, edges, edge_count);
+    }
+
+    return add_node_v2(writer, node, edges, edge_count);
+}
+
+int mtrace_writer_add_thread(mtrace_writer* writer, const mtrace_thread* thread) {
+    if (writer->version != 2) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (writer->thread_count == writer->thread_capacity) {
+        uint64_t capacity = writer->thread_capacity ? 2 * writer->thread_capacity : 32;
+        mtrace_thread* threads = (mtrace_thread *) realloc(writer->threads, capacity * sizeof(mtrace_thread));
+        if (threads == NULL) {
+            return -1;
+        }
+        writer->threads = threads;
+        writer->thread_capacity = capacity;
+    }
+
+    writer->threads[writer->thread_count++] = *thread;
+
+    return 0;
+}
+
+static int put_threads(mtrace_writer* writer) {
+    if (writer->thread_count == 0) {
+        return 0;
+    }
+
+    writer->header.flags |= MTRACE_FLAG_THREADS;
+    writer->header.threads_offset = writer->offset;
+
+    if (put_varint(writer, writer->thread_count)) {
+        return -1;
+    }
+
+    for (uint64_t idx = 0; idx < writer->thread_count; idx++) {
+        if (put_varint(writer, writer->threads[idx].entry_addr) || put_varint(writer, writer->threads[idx].call_site)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int mtrace_writer_close(mtrace_writer* writer) {
+    int ret = 0;
+
+    if (writer->version == 2) {
+        writer->header.index_offset = writer->offset;
+
+        if (put(writer, writer->index, writer->header.index_count * sizeof(uint64_t)) || put_threads(writer)
+            || fseek(writer->file, 0, SEEK_SET) != 0
+            || fwrite(&writer->header, sizeof(writer->header), 1, writer->file) != 1) {
+            ret = -1;
+        }
+    }
+
+    if (fclose(writer->file) != 0) {
+        ret = -1;
+    }
+
+    free(writer->index);
+    free(writer->threads);
+    memset(writer, 0, sizeof(*writer));
+
+    return ret;
+}
@@ -0,0 +1,102 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Host-portable writer of the .mtrace files, used by the tools that produce traces outside of MAMBO (e.g., synthetic
+    traces for benchmarking). It emits the same layout as plugins/trace/writer.c.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mtrace_reader.h"
+
+// STRUCTS
+
+typedef struct {
+    FILE* file; // Output file.
+    int version; // Version of the format being written (1 or 2).
+    mtrace_header header; // Header of the trace, rewritten when the writer is closed (version 2 only).
+    uint64_t offset; // Number of bytes written so far.
+    uint64_t previous_start; // Start address of the previous node.
+    uint64_t* index; // Offsets of every MTRACE_INDEX_INTERVAL-th node.
+    uint64_t index_capacity; // Number of entries allocated for the index.
+    mtrace_thread* threads; // Thread spawns saved when the writer is closed.
+    uint64_t thread_count; // Number of thread spawns.
+    uint64_t thread_capacity; // Number of entries allocated for the thread spawns.
+} mtrace_writer;
+
+// FUNCTIONS
+
+/**
+ * Create the trace file.
+ *
+ * @param writer Writer to be initialized.
+ * @param path Path of the trace file.
+ * @param version Version of the format (1 or 2).
+ * @param base_addr Base address of the traced binary (ignored by version 1).
+ * @param main_addr Address of the main function relative to base_addr.
+ * @param flags Optional content of the trace (MTRACE_FLAG_*, version 2 only). MTRACE_FLAG_MODULES is ignored, it is
+ *              set by mtrace_writer_set_modules.
+ * @return 0 on success, -1 on failure.
+ */
+int mtrace_writer_open(mtrace_writer* writer, const char* path, int version, uint64_t base_addr, uint64_t main_addr,
+                       uint16_t flags);
+
+/**
+ * Save the module table and encode the addresses as (module id, offset) (version 2 only). Has to be called before
+ * the first node is added.
+ *
+ * @param writer Opened writer.
+ * @param modules Modules sorted by their ids, which have to be 0 to count - 1.
+ * @param count Number of modules.
+ * @return 0 on success, -1 on failure.
+ */
+int mtrace_writer_set_modules(mtrace_writer* writer, const mtrace_module* modules, uint64_t count);
+
+/**
+ * Append the node to the trace. In version 2 nodes have to be added in the ascending order of their start addresses
+ * and edges have to be sorted by their targets.
+ *
+ * @param writer Opened writer.
+ * @param node Node to be added; its edges and edge_count fields are ignored, order_id is only saved with
+ *             MTRACE_FLAG_ORDER.
+ * @param edges Edges of the node.
+ * @param edge_count Number of edges.
+ * @return 0 on success, -1 on failure.
+ */
+int mtrace_writer_add_node(mtrace_writer* writer, const mtrace_node* node, const mtrace_edge* edges,
+                           uint64_t edge_count);
+
+/**
+ * Add the thread spawn to the trace (version 2 only).
+ *
+ * @param writer Opened writer.
+ * @param thread Thread spawn.
+ * @return 0 on success, -1 on failure.
+ */
+int mtrace_writer_add_thread(mtrace_writer* writer, const mtrace_thread* thread);
+
+/**
+ * Write the index and the thread spawns, finalize the header and close the file.
+ *
+ * @param writer Opened writer.
+ * @return 0 on success, -1 on failure.
+ */
+int mtrace_writer_close(mtrace_writer* writer);
@@ -0,0 +1,239 @@
+/*
+    Copyright 2026 Igor Wodiany
+    Copyright 2026 The University of Manchester
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+    Compare the codecs and levels available for COMPRESSED_OUTPUT on a real trace. The trace is split into chunks the
+    same way as by the plugin, and every chunk is compressed and decompressed independently. Prints the compression
+    ratio and the compression and decompression throughput (of the uncompressed data) of every configuration.
+
+    Usage: mtrace-zbench <trace> [chunk-size-in-KiB]
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mtrace_reader.h"
+
+#ifdef MTRACE_WITH_ZSTD
+    #include <zstd.h>
+#endif
+#ifdef MTRACE_WITH_LZ4
+    #include <lz4.h>
+    #include <lz4hc.h>
+#endif
+#if !defined(MTRACE_WITH_ZSTD) && !defined(MTRACE_WITH_LZ4)
+    #error mtrace-zbench requires MTRACE_WITH_ZSTD or MTRACE_WITH_LZ4!
+#endif
+
+// CONSTANTS
+
+/*
+    Default chunk size, the same as TRACE_BUFFER_SIZE of the plugin.
+*/
+#define DEFAULT_CHUNK_SIZE (4 << 20)
+
+// STRUCTS
+
+typedef struct {
+    uint16_t codec; // MTRACE_CODEC_*.
+    int level; // Level of the codec (for LZ4 levels above 1 select LZ4HC).
+} zbench_config;
+
+// GLOBALS
+
+static const zbench_config configs[] = {
+#ifdef MTRACE_WITH_LZ4
+    {MTRACE_CODEC_LZ4, 1},
+    {MTRACE_CODEC_LZ4, 4},
+    {MTRACE_CODEC_LZ4, 9},
+#endif
+#ifdef MTRACE_WITH_ZSTD
+    {MTRACE_CODEC_ZSTD, 1},
+    {MTRACE_CODEC_ZSTD, 3},
+    {MTRACE_CODEC_ZSTD, 6},
+    {MTRACE_CODEC_ZSTD, 9},
+    {MTRACE_CODEC_ZSTD, 19},
+#endif
+};
+
+// FUNCTIONS
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec * 1e-9;
+}
+
+static size_t compress_bound(const zbench_config* config, size_t size) {
+    switch (config->codec) {
+#ifdef MTRACE_WITH_ZSTD
+        case MTRACE_CODEC_ZSTD:
+            return ZSTD_compressBound(size);
+#endif
+#ifdef MTRACE_WITH_LZ4
+        case MTRACE_CODEC_LZ4:
+            return LZ4_compressBound(size);
+#endif
+        default:
+            return 0;
+    }
+}
+
+/*
+    Compress a chunk. Returns the compressed size or 0 on failure.
+*/
+static size_t compress_chunk(const zbench_config* config, uint8_t* out, size_t capacity, const uint8_t* data,
+                             size_t size) {
+    switch (config->codec) {
+#ifdef MTRACE_WITH_ZSTD
+        case MTRACE_CODEC_ZSTD: {
+            size_t compressed = ZSTD_compress(out, capacity, data, size, config->level);
+            return ZSTD_isError(compressed) ? 0 : compressed;
+        }
+#endif
+#ifdef MTRACE_WITH_LZ4
+        case MTRACE_CODEC_LZ4: {
+            int compressed;
+            if (config->level > 1) {
+                compressed = LZ4_compress_HC((const char *) data, (char *) out, size, capacity, config->level);
+            } else {
+                compressed = LZ4_compress_default((const char *) data, (char *) out, size, capacity);
+            }
+            return compressed > 0 ? (size_t) compressed : 0;
+        }
+#endif
+        default:
+            return 0;
+    }
+}
+
+/*
+    Decompress a chunk. Returns 0 if the chunk doesn't decompress to exactly size bytes.
+*/
+static int decompress_chunk(const zbench_config* config, uint8_t* out, size_t size, const uint8_t* data,
+                            size_t compressed) {
+    switch (config->codec) {
+#ifdef MTRACE_WITH_ZSTD
+        case MTRACE_CODEC_ZSTD:
+            return ZSTD_decompress(out, size, data, compressed) == size;
+#endif
+#ifdef MTRACE_WITH_LZ4
+        case MTRACE_CODEC_LZ4:
+            return LZ4_decompress_safe((const char *) data, (char *) out, compressed, size) == (int) size;
+#endif
+        default:
+            return 0;
+    }
+}
+
+/*
+    Compress and decompress the whole trace with the configuration and print the results.
+*/
+static int run_config(const zbench_config* config, const mtrace_file* trace, size_t chunk_size) {
+    uint64_t chunk_count = (trace->size + chunk_size - 1) / chunk_size;
+    size_t capacity = compress_bound(config, chunk_size);
+    uint8_t* compressed = (uint8_t *) malloc(chunk_count * capacity);
+    size_t* compressed_sizes = (size_t *) malloc(chunk_count * sizeof(size_t));
+    uint8_t* decompressed = (uint8_t *) malloc(trace->size);
+    int ret = 1;
+
+    if (compressed == NULL || compressed_sizes == NULL || decompressed == NULL) {
+        goto out;
+    }
+
+    uint64_t total = 0;
+    double start = now();
+    for (uint64_t idx = 0; idx < chunk_count; idx++) {
+        size_t offset = idx * chunk_size;
+        size_t size = trace->size - offset < chunk_size ? trace->size - offset : chunk_size;
+
+        compressed_sizes[idx] = compress_chunk(config, compressed + idx * capacity, capacity, trace->data + offset,
+                                               size);
+        if (compressed_sizes[idx] == 0) {
+            goto out;
+        }
+        total += compressed_sizes[idx];
+    }
+    double compress_time = now() - start;
+
+    start = now();
+    for (uint64_t idx = 0; idx < chunk_count; idx++) {
+        size_t offset = idx * chunk_size;
+        size_t size = trace->size - offset < chunk_size ? trace->size - offset : chunk_size;
+
+        if (!decompress_chunk(config, decompressed + offset, size, compressed + idx * capacity,
+                              compressed_sizes[idx])) {
+            goto out;
+        }
+    }
+    double decompress_time = now() - start;
+
+    if (memcmp(decompressed, trace->data, trace->size) != 0) {
+        goto out;
+    }
+
+    double megabytes = (double) trace->size / (1024.0 * 1024.0);
+    printf("codec %s level %d size %zu compressed %" PRIu64 " ratio %.2lf compress %lf MiB/s decompress %lf MiB/s\n",
+           config->codec == MTRACE_CODEC_ZSTD ? "zstd" : "lz4", config->level, trace->size, total,
+           (double) trace->size / (double) total, megabytes / compress_time, megabytes / decompress_time);
+    ret = 0;
+
+out:
+    free(decompressed);
+    free(compressed_sizes);
+    free(compressed);
+
+    return ret;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <trace> [chunk-size-in-KiB]\n", argv[0]);
+        return 1;
+    }
+
+    size_t chunk_size = argc > 2 ? strtoull(argv[2], NULL, 0) << 10 : DEFAULT_CHUNK_SIZE;
+    if (chunk_size == 0) {
+        fprintf(stderr, "mtrace-zbench: Invalid chunk size %s!\n", argv[2]);
+        return 1;
+    }
+
+    mtrace_file trace;
+    if (mtrace_open(&trace, argv[1])) {
+        fprintf(stderr, "mtrace-zbench: Couldn't open %s: %s!\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    for (size_t idx = 0; idx < sizeof(configs) / sizeof(configs[0]); idx++) {
+        if (run_config(&configs[idx], &trace, chunk_size)) {
+            fprintf(stderr, "mtrace-zbench: Couldn't compress %s with %s level %d!\n", argv[1],
+                    configs[idx].codec == MTRACE_CODEC_ZSTD ? "zstd" : "lz4", configs[idx].level);
+            mtrace_close(&trace);
+            return 1;
+        }
+    }
+
+    mtrace_close(&trace);
+
+    return 0;
+}